@@ -27,6 +27,7 @@ namespace WAVM {
             bool multipleResultsAndBlockParams = true;
             bool bulkMemoryOperations = true;
             bool referenceTypes = true;
+            bool tailCalls = true;
             bool quotedNamesInTextFormat = true; // Enabled by default for everything but wavm-disas,
             // where a command-line flag is required to enable it
             // to ensure the default output uses standard syntax.
@@ -36,6 +37,24 @@ namespace WAVM {
             bool functionRefInstruction = true;
             bool requireSharedFlagForAtomicOperators = false; // (true is standard)
 
+            // Compile explicit bounds checks for memory accesses, instead of relying on each memory
+            // reserving enough address space for any 32-bit address and offset. Memories defined
+            // by such modules only reserve address space for their maximum size. An out-of-bounds
+            // access throws a Runtime::Trap from the invoke that executed it.
+            bool explicitBoundsChecks = false;
+
+            // Compile integer division without explicit checks for a zero divisor or signed
+            // overflow, relying on the hardware division instruction to fault instead. The runtime
+            // catches the fault while invoking functions in a compartment containing such a module,
+            // and throws a Runtime::Trap. Only supported on x86-64.
+            bool hardwareDivideTraps = false;
+
+            // Compile each module instance's code specialized for the values of its immutable
+            // globals and the ids of its tables and memories, so they are constants in the code.
+            // Such modules keep their function bodies to recompile them when instantiated, and
+            // share the specialized code between instances with the same values.
+            bool specializeInstances = false;
+
             Uptr maxLocals = 65536;
             Uptr maxLabelsPerFunction = UINTPTR_MAX;
         };
@@ -38,6 +38,8 @@
     visitOp(0x000f, return_            , "return"                           , NoImm                     , PARAMETRIC           , mvp                    )   \
     visitOp(0x0010, call               , "call"                             , FunctionImm               , PARAMETRIC           , mvp                    )   \
     visitOp(0x0011, call_indirect      , "call_indirect"                    , CallIndirectImm           , PARAMETRIC           , mvp                    )   \
+    visitOp(0x0012, return_call        , "return_call"                      , FunctionImm               , PARAMETRIC           , tailCalls              )   \
+    visitOp(0x0013, return_call_indirect, "return_call_indirect"            , CallIndirectImm           , PARAMETRIC           , tailCalls              )   \
 /* Stack manipulation                                                                                                                                    */ \
     visitOp(0x001a, drop               , "drop"                             , NoImm                     , PARAMETRIC           , mvp                    )   \
     visitOp(0x001b, select             , "select"                           , NoImm                     , PARAMETRIC           , mvp                    )   \
@@ -1,86 +1,102 @@
 #pragma once
 
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
-#include "WAVM/Inline/HashMap.h"
 
 namespace WAVM {
     // A map that's somewhere between an array and a HashMap.
-    // It's keyed by a range of integers, but sparsely maps those integers to elements.
+    // It's keyed by a range of integers, but sparsely maps those integers to elements. The elements
+    // are stored in an array indexed by (index - minIndex), so the Element type must be default
+    // constructible, and lookups are a single array access.
     template<typename Index, typename Element> struct IndexMap {
-        IndexMap(Index inMinIndex, Index inMaxIndex) : lastIndex(inMinIndex - 1), minIndex(inMinIndex),
-                                                       maxIndex(inMaxIndex) {
+        IndexMap(Index inMinIndex, Index inMaxIndex) : minIndex(inMinIndex), maxIndex(inMaxIndex), numElements(0) {
             wavmAssert(maxIndex >= minIndex);
         }
 
-        // Allocates an index, and adds the element to the map. Indices are allocated sequentially,
-        // starting at minIndex, and wrapping back to minIndex after maxIndex. After the allocator
-        // has wrapped back to previously allocated indices, indices are probed sequentially until
-        // an unallocated one is found. Because of this, it takes O(N) time to add an element. If an
-        // index couldn't be allocated, returns false. Otherwise, returns true and the index the
-        // element was allocated at is written to the outIndex argument.
+        // Allocates an index, and adds the element to the map. Indices that were freed by removing
+        // an element are reused before allocating new indices past the highest one allocated so
+        // far, so adding an element takes amortized O(1) time. If an index couldn't be allocated,
+        // returns failIndex. Otherwise, returns the index the element was allocated at.
         template<typename... Args> Index add(Index failIndex, Args &&... args) {
+            // Pop indices off the free list until one is found that is still free: insertOrFail may
+            // have allocated an index after it was added to the free list.
+            while (freeSlotIndices.size()) {
+                const Uptr slotIndex = freeSlotIndices.back();
+                freeSlotIndices.pop_back();
+                if (!isSlotOccupied[slotIndex]) {
+                    occupySlot(slotIndex, std::forward<Args>(args)...);
+                    return Index(minIndex + slotIndex);
+                }
+            }
+
             // If all possible indices are allocated, return failure.
-            if (map.size() > Uptr(maxIndex - minIndex + 1)) {
+            if (elements.size() > Uptr(maxIndex - minIndex)) {
                 return failIndex;
             }
 
-            // Starting from the index after the last index to be allocated, check indices
-            // sequentially until one is found that isn't allocated.
-            do {
-                ++lastIndex;
-                if (lastIndex > maxIndex) {
-                    lastIndex = minIndex;
-                }
-            } while (map.contains(lastIndex));
-
-            // Add the element to the map with the given index.
-            wavmAssert(lastIndex >= minIndex);
-            wavmAssert(lastIndex <= maxIndex);
-            map.addOrFail(lastIndex, std::forward<Args>(args)...);
-
-            return lastIndex;
+            const Uptr slotIndex = elements.size();
+            elements.emplace_back();
+            isSlotOccupied.push_back(false);
+            occupySlot(slotIndex, std::forward<Args>(args)...);
+            return Index(minIndex + slotIndex);
         }
 
         // Inserts an element at a specific index. If the index is already allocated, asserts.
         template<typename... Args> void insertOrFail(Index index, Args &&... args) {
             wavmAssert(index >= minIndex);
             wavmAssert(index <= maxIndex);
-            map.addOrFail(index, std::forward<Args>(args)...);
+            const Uptr slotIndex = Uptr(index - minIndex);
+
+            // If the index is past the highest allocated index, add the indices between them to the
+            // free list.
+            while (elements.size() <= slotIndex) {
+                if (elements.size() != slotIndex) {
+                    freeSlotIndices.push_back(elements.size());
+                }
+                elements.emplace_back();
+                isSlotOccupied.push_back(false);
+            }
+
+            errorUnless(!isSlotOccupied[slotIndex]);
+            occupySlot(slotIndex, std::forward<Args>(args)...);
         }
 
         // Removes an element by index. If there wasn't an allocated at the specified index,
         // asserts.
         void removeOrFail(Index index) {
-            wavmAssert(index >= minIndex);
-            wavmAssert(index <= maxIndex);
-            map.removeOrFail(index);
+            wavmAssert(contains(index));
+            const Uptr slotIndex = Uptr(index - minIndex);
+            elements[slotIndex] = Element();
+            isSlotOccupied[slotIndex] = false;
+            freeSlotIndices.push_back(slotIndex);
+            --numElements;
         }
 
         // Returns whether the specified index is allocated.
         bool contains(Index index) const {
             wavmAssert(index >= minIndex);
             wavmAssert(index <= maxIndex);
-            return map.contains(index);
+            const Uptr slotIndex = Uptr(index - minIndex);
+            return slotIndex < elements.size() && isSlotOccupied[slotIndex];
         }
 
         // Returns the element bound to the specified index. Behavior is undefined for if the index
         // isn't allocated.
         const Element &operator[](Index index) const {
-            wavmAssert(index >= minIndex);
-            wavmAssert(index <= maxIndex);
-            return map[index];
+            wavmAssert(contains(index));
+            return elements[Uptr(index - minIndex)];
         }
 
         Element &operator[](Index index) {
-            wavmAssert(index >= minIndex);
-            wavmAssert(index <= maxIndex);
-            wavmAssert(map.contains(index));
-            return map.getOrAdd(index);
+            wavmAssert(contains(index));
+            return elements[Uptr(index - minIndex)];
         }
 
         // Returns the number of allocated index/element pairs.
         Uptr size() const {
-            return map.size();
+            return numElements;
         }
 
         Index getMinIndex() const {
@@ -95,48 +111,76 @@ namespace WAVM {
             template<typename, typename> friend struct IndexMap;
 
             bool operator!=(const Iterator &other) {
-                return mapIt != other.mapIt;
+                return slotIndex != other.slotIndex;
             }
 
             bool operator==(const Iterator &other) {
-                return mapIt == other.mapIt;
+                return slotIndex == other.slotIndex;
             }
 
             operator bool() const {
-                return bool(mapIt);
+                return slotIndex < map->elements.size();
             }
 
             void operator++() {
-                ++mapIt;
+                ++slotIndex;
+                skipUnoccupiedSlots();
             }
 
             const Element &operator*() const {
-                return mapIt->value;
+                return map->elements[slotIndex];
             }
 
             const Element *operator->() const {
-                return &mapIt->value;
+                return &map->elements[slotIndex];
+            }
+
+            Index getIndex() const {
+                return Index(map->minIndex + slotIndex);
             }
 
         private:
-            HashMapIterator <Index, Element> mapIt;
+            const IndexMap *map;
+            Uptr slotIndex;
 
-            Iterator(HashMapIterator <Index, Element> &&inMapIt) : mapIt(inMapIt) {
+            Iterator(const IndexMap *inMap, Uptr inSlotIndex) : map(inMap), slotIndex(inSlotIndex) {
+                skipUnoccupiedSlots();
+            }
+
+            void skipUnoccupiedSlots() {
+                while (slotIndex < map->elements.size() && !map->isSlotOccupied[slotIndex]) {
+                    ++slotIndex;
+                }
             }
         };
 
         Iterator begin() const {
-            return Iterator(map.begin());
+            return Iterator(this, 0);
         }
 
         Iterator end() const {
-            return Iterator(map.end());
+            return Iterator(this, elements.size());
+        }
+
+        // Returns an iterator to the first allocated index that is >= the specified index. This
+        // allows iterating over the map in several steps without holding an iterator between them.
+        Iterator lowerBound(Index index) const {
+            const Uptr slotIndex = index <= minIndex ? 0 : Uptr(index - minIndex);
+            return Iterator(this, slotIndex < elements.size() ? slotIndex : elements.size());
         }
 
     private:
-        Index lastIndex;
         Index minIndex;
         Index maxIndex;
-        HashMap <Index, Element> map;
+        Uptr numElements;
+        std::vector<Element> elements;
+        std::vector<bool> isSlotOccupied;
+        std::vector<Uptr> freeSlotIndices;
+
+        template<typename... Args> void occupySlot(Uptr slotIndex, Args &&... args) {
+            elements[slotIndex] = Element(std::forward<Args>(args)...);
+            isSlotOccupied[slotIndex] = true;
+            ++numElements;
+        }
     };
 }
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Runtime/RuntimeData.h"
@@ -13,7 +14,6 @@
 namespace WAVM {
     namespace IR {
         struct Module;
-        struct UntaggedValue;
 
         enum class CallingConvention;
     }
@@ -29,8 +29,24 @@ namespace WAVM {
 
 namespace WAVM {
     namespace LLVMJIT {
-        // Compiles a module to object code.
-        LLVMJIT_API std::vector<U8> compileModule(const IR::Module &irModule);
+        // Values that are fixed when a module is instantiated. compileModule may compile them into
+        // the generated code as constants instead of binding them to symbols when the code is
+        // loaded, so the code may only be loaded for module instances with the same values.
+        struct InstanceSpecialization {
+            std::vector<Uptr> tableIds;
+            std::vector<Uptr> memoryIds;
+
+            // The initial value of each of the module's globals. The values of mutable and
+            // reference-typed globals are ignored.
+            std::vector<IR::UntaggedValue> globalValues;
+
+            Uptr tableReferenceBias;
+            Uptr tableUninitializedElement;
+        };
+
+        // Compiles a module to object code. If a specialization is provided, the object code is
+        // specialized for it.
+        LLVMJIT_API std::vector<U8> compileModule(const IR::Module &irModule, const InstanceSpecialization *specialization = nullptr);
 
         // An opaque type that can be used to reference a loaded JIT module.
         struct Module;
@@ -69,7 +85,7 @@ namespace WAVM {
         };
 
         // Loads a module from object code, and binds its undefined symbols to the provided bindings.
-        LLVMJIT_API std::shared_ptr<Module> loadModule(const std::vector<U8> &objectFileBytes, HashMap<std::string, FunctionBinding> &&wavmIntrinsicsExportMap, std::vector<IR::FunctionType> &&types, std::vector<FunctionBinding> &&functionImports, std::vector<TableBinding> &&tables, std::vector<MemoryBinding> &&memories, std::vector<GlobalBinding> &&globals, std::vector<ExceptionTypeBinding> &&exceptionTypes, ModuleInstanceBinding moduleInstance, Uptr tableReferenceBias, const std::vector<Runtime::FunctionMutableData *> &functionDefMutableDatas);
+        LLVMJIT_API std::shared_ptr<Module> loadModule(const std::vector<U8> &objectFileBytes, const HashMap<std::string, FunctionBinding> &wavmIntrinsicsExportMap, const std::vector<IR::FunctionType> &types, std::vector<FunctionBinding> &&functionImports, std::vector<TableBinding> &&tables, std::vector<MemoryBinding> &&memories, std::vector<GlobalBinding> &&globals, std::vector<ExceptionTypeBinding> &&exceptionTypes, ModuleInstanceBinding moduleInstance, Uptr tableReferenceBias, Uptr tableUninitializedElement, const std::vector<Runtime::FunctionMutableData *> &functionDefMutableDatas);
 
         // Finds the JIT function whose code contains the given address. If no JIT function contains the
         // given address, returns null.
@@ -82,5 +98,24 @@ namespace WAVM {
 
         // Generates a thunk to call a native function from generated code.
         LLVMJIT_API Runtime::Function *getIntrinsicThunk(void *nativeFunction, IR::FunctionType functionType, IR::CallingConvention callingConvention, const char *debugName);
+
+        struct IntrinsicThunkSpec {
+            void *nativeFunction;
+            IR::FunctionType functionType;
+            IR::CallingConvention callingConvention;
+            const char *debugName;
+        };
+
+        // Generates thunks to call several native functions from generated code. Thunks that weren't
+        // already generated are compiled together in a single LLVM module. Returns the thunks in the
+        // same order as the specs.
+        LLVMJIT_API std::vector<Runtime::Function *> getIntrinsicThunks(const std::vector<IntrinsicThunkSpec> &specs);
+
+        // Provides LLVM IR, as bitcode or assembly, that implements an intrinsic function with the
+        // intrinsic calling convention. When compileModule compiles a module that imports a function
+        // with the same module name, export name and type, it links the IR into the module, and
+        // calls to the import check whether it was bound to the intrinsic's thunk: if so, they call
+        // the linked function, which LLVM may inline. Otherwise, they call the import as usual.
+        LLVMJIT_API void addInlinableIntrinsic(const char *moduleName, const char *exportName, void *nativeFunction, IR::FunctionType functionType, const char *llvmIR, Uptr numLLVMIRBytes, const char *llvmFunctionName);
     }
 }
@@ -28,6 +28,11 @@ namespace WAVM {
 
         PLATFORM_API bool catchSignals(const std::function<void()> &thunk, const std::function<bool(Signal signal, const CallStack &)> &filter);
 
+        // Raises a signal from software, as if the caller had faulted. If the filter of the innermost
+        // catchSignals call on this thread accepts it, returns from that catchSignals call.
+        // Otherwise, the process exits with a fatal error.
+        [[noreturn]] PLATFORM_API void raiseSignal(Signal signal);
+
         typedef bool (*SignalHandler)(Signal, const CallStack &);
 
         PLATFORM_API void registerEHFrames(const U8 *imageBase, const U8 *ehFrames, Uptr numBytes);
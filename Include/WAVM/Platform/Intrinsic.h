@@ -29,29 +29,11 @@ namespace WAVM {
             return U64(value + ((I64(maxValue - value) >> 63) & (maxValue - value)));
         }
 
-        inline void bytewiseMemCopy(U8 *dest, const U8 *source, Uptr numBytes) {
-            asm volatile("rep movsb"
-            : "=D"(dest), "=S"(source), "=c"(numBytes)
-            : "0"(dest), "1"(source), "2"(numBytes)
-            : "memory");
-        }
-
-        inline void bytewiseMemSet(U8 *dest, U8 value, Uptr numBytes) {
-            asm volatile("rep stosb"
-            : "=D"(dest), "=a"(value), "=c"(numBytes)
-            : "0"(dest), "1"(value), "2"(numBytes)
-            : "memory");
-        }
-        inline void bytewiseMemMove(U8 *dest, U8 *source, Uptr numBytes) {
-            const Uptr numNonOverlappingBytes = source < dest && source + numBytes > dest ? dest - source : numBytes;
-
-            if (numNonOverlappingBytes != numBytes) {
-                bytewiseMemCopy(
-                        dest + numNonOverlappingBytes,
-                        source + numNonOverlappingBytes, numBytes - numNonOverlappingBytes);
-            }
-
-            bytewiseMemCopy(dest, source, numNonOverlappingBytes);
-        }
+        // Bulk memory operations that only access the bytes in the destination and source ranges, so
+        // they may be used on memory that can fault part way through. They pick a kernel for the
+        // size of the operation and the features of the host CPU.
+        PLATFORM_API void bytewiseMemCopy(U8 *dest, const U8 *source, Uptr numBytes);
+        PLATFORM_API void bytewiseMemSet(U8 *dest, U8 value, Uptr numBytes);
+        PLATFORM_API void bytewiseMemMove(U8 *dest, U8 *source, Uptr numBytes);
     }
 }
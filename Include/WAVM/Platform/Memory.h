@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Platform/Defines.h"
 
@@ -24,5 +26,51 @@ namespace WAVM {
         PLATFORM_API void freeVirtualPages(U8 *baseVirtualAddress, Uptr numPages);
 
         PLATFORM_API void freeAlignedVirtualPages(U8 *unalignedBaseAddress, Uptr numPages, Uptr alignmentLog2);
+
+        // An immutable copy of the contents of some virtual pages, which may be mapped copy-on-write.
+        struct MemoryImage;
+
+        // Creates an image of the contents of some committed pages, and remaps them as a copy-on-write
+        // mapping of the image. Pages that only contain zeroes are left out of the image. Returns
+        // null if the platform doesn't support memory images.
+        PLATFORM_API MemoryImage *createMemoryImage(U8 *baseVirtualAddress, Uptr numPages);
+
+        PLATFORM_API void destroyMemoryImage(MemoryImage *image);
+
+        PLATFORM_API Uptr getMemoryImageNumPages(MemoryImage *image);
+
+        // Maps the image copy-on-write at the given address, replacing the first
+        // getMemoryImageNumPages(image) pages there with read-write pages.
+        PLATFORM_API bool mapMemoryImage(MemoryImage *image, U8 *baseVirtualAddress);
+
+        // Returns whether none of the given pages have been written since they were mapped from a
+        // memory image, or committed if they aren't part of an image mapping. Returns false if that
+        // can't be determined.
+        PLATFORM_API bool isMemoryImageMappingUnmodified(U8 *baseVirtualAddress, Uptr numPages);
+   
+        // Tracks which of a range of committed pages are written: the pages are write-protected, and
+        // the first write to each page marks it dirty and makes it writable again.
+        struct DirtyPageTracker;
+
+        // Starts tracking writes to the first numPages pages at the given address, which must stay
+        // reserved for maxPages pages until the tracker is destroyed. Returns null if too many
+        // trackers exist.
+        PLATFORM_API DirtyPageTracker *createDirtyPageTracker(U8 *baseVirtualAddress, Uptr numPages, Uptr maxPages);
+
+        // Stops tracking writes, and makes the tracked pages writable again.
+        PLATFORM_API void destroyDirtyPageTracker(DirtyPageTracker *tracker);
+
+        // Changes the number of tracked pages. Pages added to the range must be committed read-only
+        // so that writes to them are tracked.
+        PLATFORM_API void setDirtyPageTrackerNumPages(DirtyPageTracker *tracker, Uptr numPages);
+
+        // Marks a range of tracked pages dirty, and makes them writable. Code that can't handle a write
+        // to a write-protected page must call this before writing to tracked pages, e.g. before
+        // passing them to a system call, which fails instead of faulting.
+        PLATFORM_API void markDirtyPages(DirtyPageTracker *tracker, Uptr beginPageIndex, Uptr numPages);
+
+        // Calls visitDirtyPage with the index of each page written since the last reset, then
+        // write-protects those pages again. The pages must not be written concurrently.
+        PLATFORM_API void resetDirtyPages(DirtyPageTracker *tracker, const std::function<void(Uptr pageIndex)> &visitDirtyPage);
     }
 }
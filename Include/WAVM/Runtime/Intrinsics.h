@@ -36,6 +36,14 @@ namespace WAVM {
 
             RUNTIME_API Runtime::Function *instantiate(Runtime::Compartment *compartment);
 
+            const char *getName() const {
+                return name;
+            }
+
+            IR::FunctionType getType() const {
+                return type;
+            }
+
             void *getNativeFunction() const {
                 return nativeFunction;
             }
@@ -51,6 +59,12 @@ namespace WAVM {
             IR::CallingConvention callingConvention;
         };
 
+        // Provides LLVM IR, as bitcode or assembly, that defines llvmFunctionName with the same
+        // semantics as an intrinsic function. Calls from compiled modules to an import of the
+        // function from a module named moduleName may then be inlined, while the import is bound to
+        // the intrinsic. The IR function takes the ContextRuntimeData pointer as its first parameter.
+        RUNTIME_API void addInlinableFunction(const char *moduleName, const Function &function, const char *llvmIR, const char *llvmFunctionName);
+
         // The base class of Intrinsic globals.
         struct Global {
             RUNTIME_API Global(Intrinsics::Module &moduleRef, const char *inName, IR::ValueType inType, IR::Value inValue);
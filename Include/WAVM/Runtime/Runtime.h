@@ -145,9 +145,41 @@ namespace WAVM {
         // Increments the object's counter of root references.
         RUNTIME_API void addGCRoot(Object *object);
 
-        // Decrements the object's counter of root referencers.
+        // Decrements the object's counter of root referencers. If that was the object's last reference,
+        // and it was never stored in a table, a reference-typed global or passed to WebAssembly code,
+        // the object is deleted immediately, along with the objects only it referenced. Objects that
+        // may still be referenced that way, and reference cycles, are deleted by the tracing collector.
         RUNTIME_API void removeGCRoot(Object *object);
 
+        // Runs a complete collection of the compartment's unreferenced objects. If the compartment has
+        // no root references, and no objects remain in it, it is deleted and true is returned.
+        RUNTIME_API bool collectCompartmentGarbage(Compartment *compartment);
+
+        // Runs a bounded slice of a collection of the compartment's unreferenced objects, scanning and
+        // deleting roughly maxWorkUnits objects or table elements. The compartment may be used by other
+        // threads between and during slices. Returns true if the slice completed a collection.
+        // References held only by running WebAssembly code aren't seen by the collector, so objects
+        // referenced that way must be rooted.
+        RUNTIME_API bool collectCompartmentGarbageIncrementally(Compartment *compartment, Uptr maxWorkUnits);
+
+        // Thrown by invokeFunctionUnchecked and invokeFunctionChecked when the invoked code traps by
+        // raising a signal: a hardware integer division trap, a failed explicit bounds check, or a
+        // table.get or table.set with an index past the end of the table.
+        struct Trap {
+            enum class Type {
+                integerDivideByZeroOrIntegerOverflow,
+                outOfBoundsMemoryAccess,
+                outOfBoundsTableAccess
+            };
+
+            Type type;
+        };
+
+        // Invokes a function in the context. If the compartment contains module instances compiled with
+        // FeatureSpec::hardwareDivideTraps, a division trap in the invoked WebAssembly code throws a
+        // Trap; one raised by other code, such as an intrinsic, isn't caught. If it contains module
+        // instances compiled with FeatureSpec::explicitBoundsChecks, so does an out-of-bounds access
+        // to one of their memories. An out-of-bounds table.get or table.set always throws a Trap.
         RUNTIME_API IR::UntaggedValue *invokeFunctionUnchecked(Context *context, Function *function, const IR::UntaggedValue *arguments);
 
         RUNTIME_API IR::ValueTuple invokeFunctionChecked(Context *context, Function *function, const std::vector<IR::Value> &arguments);
@@ -162,7 +194,10 @@ namespace WAVM {
 
         RUNTIME_API Uptr getTableNumElements(Table *table);
 
-        RUNTIME_API Memory *createMemory(Compartment *compartment, IR::MemoryType type, std::string &&debugName);
+        // Creates a memory. If explicitBoundsChecks is true, the memory only reserves address space for
+        // its maximum size, and may only be accessed by modules compiled with
+        // FeatureSpec::explicitBoundsChecks.
+        RUNTIME_API Memory *createMemory(Compartment *compartment, IR::MemoryType type, std::string &&debugName, bool explicitBoundsChecks = false);
 
         RUNTIME_API U8 *getMemoryBaseAddress(Memory *memory);
 
@@ -174,6 +209,8 @@ namespace WAVM {
 
         RUNTIME_API U8 *getReservedMemoryOffsetRange(Memory *memory, Uptr offset, Uptr numBytes);
 
+        // Returns a pointer to a range of a memory's committed pages that may be written by the
+        // caller, including by passing it to a system call.
         RUNTIME_API U8 *getValidatedMemoryOffsetRange(Memory *memory, Uptr offset, Uptr numBytes);
 
         template<typename Value> Value &memoryRef(Memory *memory, Uptr offset) {
@@ -184,6 +221,35 @@ namespace WAVM {
             return (Value *) getValidatedMemoryOffsetRange(memory, offset, numElements * sizeof(Value));
         }
 
+        // The contents of the pages of a memory that were written between two checkpoints.
+        struct MemoryDelta {
+            // The memory's size in WebAssembly pages at the later checkpoint.
+            Uptr numPages = 0;
+
+            // The size of the pages in the delta, which is the platform's virtual page size.
+            Uptr numBytesPerPage = 0;
+
+            // The indices of the written pages in increasing order, and their contents.
+            std::vector<Uptr> pageIndices;
+            std::vector<U8> pageBytes;
+        };
+
+        // Captures the pages of a memory written since the last delta was captured from it. The first
+        // delta captured from a memory contains all its pages, and starts tracking writes to it; the
+        // cost of capturing later deltas is proportional to the number of pages written. If writes to
+        // the memory can't be tracked, e.g. because too many memories are tracked, each delta contains
+        // all its pages. No code may write to the memory while a delta is captured.
+        RUNTIME_API MemoryDelta captureMemoryDelta(Memory *memory);
+
+        // Writes the pages in a delta to a memory, and resizes the memory to the delta's size.
+        RUNTIME_API void applyMemoryDelta(Memory *memory, const MemoryDelta &delta);
+
+        // Rolls a memory back to its state when deltas[checkpointIndex] was captured, given all the
+        // deltas captured from it in order. Only the pages written since the checkpoint are
+        // restored, and the next delta captured from the memory will be relative to the checkpoint,
+        // so the caller should discard the deltas after it.
+        RUNTIME_API void restoreMemoryCheckpoint(Memory *memory, const std::vector<MemoryDelta> &deltas, Uptr checkpointIndex);
+
         RUNTIME_API Global *createGlobal(Compartment *compartment, IR::GlobalType type, IR::Value initialValue);
 
         struct ImportBindings {
@@ -198,18 +264,73 @@ namespace WAVM {
         typedef std::shared_ptr<Module> ModuleRef;
         typedef const std::shared_ptr<const Module> &ModuleConstRefParam;
 
+        // Compiles an IR module. The compiled module only keeps the parts of the IR that are needed to
+        // instantiate it: the function bodies are released, so the IR returned by getModuleIR has
+        // empty FunctionDef::code and FunctionDef::branchTables, unless the module's
+        // FeatureSpec::specializeInstances is set. The rvalue overload takes the IR without copying
+        // it.
         RUNTIME_API ModuleRef compileModule(const IR::Module &irModule);
+        RUNTIME_API ModuleRef compileModule(IR::Module &&irModule);
 
         RUNTIME_API ModuleInstance *instantiateModule(Compartment *compartment, ModuleConstRefParam module, ImportBindings &&imports, std::string &&debugName);
 
         RUNTIME_API Function *getStartFunction(ModuleInstance *moduleInstance);
 
+        RUNTIME_API const IR::Module &getModuleIR(ModuleConstRefParam module);
+
+        // Creates a module whose data segments, elem segments and global initializers reproduce the
+        // current state of a module instance's memories, tables and mutable globals in the given
+        // context, and which has no start function. Instantiating the snapshot skips any
+        // initialization that ran before it was taken. The values of imported mutable globals are
+        // stored in the snapshot, but only restored by restoreSnapshotImportedGlobals. Returns null if
+        // the state can't be expressed as a module, e.g. if a table contains a function from another
+        // module instance.
+        RUNTIME_API ModuleRef snapshotModuleInstance(Context *context, ModuleConstRefParam module, ModuleInstance *moduleInstance);
+
+        // Returns whether the module was created by snapshotModuleInstance.
+        RUNTIME_API bool isPreinitializedModule(ModuleConstRefParam module);
+
+        // Sets the imported mutable globals of an instance of a snapshot module to the values they had
+        // when the snapshot was taken, in every context of the instance's compartment and in the
+        // values used to initialize new contexts. The globals are owned by the embedder, and may be
+        // shared with other module instances, so instantiating a snapshot doesn't do this: the
+        // embedder must call it if the globals aren't otherwise initialized. Does nothing if the
+        // module isn't a snapshot.
+        RUNTIME_API void restoreSnapshotImportedGlobals(ModuleConstRefParam module, ModuleInstance *moduleInstance);
+
+        // Saves a compiled module, including its object code, so it may be loaded by the same build of
+        // WAVM without compiling it again.
+        RUNTIME_API std::vector<U8> saveCompiledModule(ModuleConstRefParam module);
+
+        RUNTIME_API bool isCompiledModuleBytes(const U8 *bytes, Uptr numBytes);
+
+        // Loads a module saved by saveCompiledModule. Returns null if the bytes aren't a saved module.
+        RUNTIME_API ModuleRef loadCompiledModule(const U8 *bytes, Uptr numBytes);
+
         RUNTIME_API Object *getInstanceExport(ModuleInstance *moduleInstance, const std::string &name);
 
         RUNTIME_API Compartment *createCompartment();
 
         RUNTIME_API bool isInCompartment(Object *object, const Compartment *compartment);
 
+        // Creates a copy of a compartment and the objects in it. Each object in the new compartment
+        // has the same ID as the object it was copied from, so they share compiled code. Memories are
+        // cloned copy-on-write: the cost of cloning a memory is proportional to its number of pages,
+        // plus copying the pages written since it was last cloned, instead of copying all its bytes.
+        // No code may be executing in the compartment while it is cloned.
+        RUNTIME_API Compartment *cloneCompartment(Compartment *compartment);
+
+        // Creates a context in a cloned compartment, with the mutable global values of a context in
+        // the original compartment.
+        RUNTIME_API Context *cloneContext(Context *context, Compartment *newCompartment);
+
+        // Returns the object in a cloned compartment that was cloned from the given object.
+        RUNTIME_API Object *remapToClonedCompartment(Object *object, const Compartment *newCompartment);
+
+        template<typename Type> Type *remapToClonedCompartment(Type *object, const Compartment *newCompartment) {
+            return as<Type>(remapToClonedCompartment(asObject(object), newCompartment));
+        }
+
         RUNTIME_API Context *createContext(Compartment *compartment);
     }
 }
@@ -28,44 +28,40 @@ namespace WAVM {
             invalid = 0xff,
         };
 
-#define compartmentReservedBytes (4ull * 1024 * 1024 * 1024)
+        struct CompartmentRuntimeData;
 
+        // The runtime data arrays are sized for these limits, but only address space is reserved for
+        // them: the pages holding the entries for an object are committed when the object is created.
         enum {
             maxThunkArgAndReturnBytes = 256,
-            maxGlobalBytes = 4096 - maxThunkArgAndReturnBytes,
-            maxMutableGlobals = maxGlobalBytes / sizeof(IR::UntaggedValue),
-            maxMemories = 255,
-            maxTables = (4096 - maxMemories * sizeof(void *) - sizeof(Compartment *)) / sizeof(void *),
-            compartmentRuntimeDataAlignmentLog2 = 32
+            maxMutableGlobals = 65536,
+            maxMemories = 65536,
+            maxTables = 65536,
+            maxContexts = 1024 * 1024
         };
 
         static_assert(sizeof(IR::UntaggedValue) * IR::maxReturnValues <=
                       maxThunkArgAndReturnBytes, "maxThunkArgAndReturnBytes must be large enough to hold IR::maxReturnValues * "
                                                  "sizeof(UntaggedValue)");
 
+        // The runtime data for a context is allocated separately from its compartment's runtime data
+        // when the context is created, and points to the compartment's runtime data. This allows
+        // compartments to only reserve the address space they use, instead of reserving an aligned
+        // range of address space that the context runtime data is allocated from.
         struct ContextRuntimeData {
             U8 thunkArgAndReturnData[maxThunkArgAndReturnBytes];
+            CompartmentRuntimeData *compartmentRuntimeData;
             IR::UntaggedValue mutableGlobals[maxMutableGlobals];
         };
 
-        static_assert(sizeof(ContextRuntimeData) == 4096, "");
-
         struct CompartmentRuntimeData {
             Compartment *compartment;
             void *memoryBases[maxMemories];
+            Uptr memoryNumBytes[maxMemories];
             void *tableBases[maxTables];
-            ContextRuntimeData contexts[1];
-        };
-
-        enum {
-            maxContexts = 1024 * 1024 - offsetof(CompartmentRuntimeData, contexts) / sizeof(ContextRuntimeData)
+            Uptr tableNumElements[maxTables];
         };
 
-        static_assert(offsetof(CompartmentRuntimeData, contexts) % 4096 ==
-                      0, "CompartmentRuntimeData::contexts isn't page-aligned");
-        static_assert(U64(offsetof(CompartmentRuntimeData, contexts)) + U64(maxContexts) * sizeof(ContextRuntimeData) ==
-                      compartmentReservedBytes, "CompartmentRuntimeData isn't the expected size");
-
         struct ExceptionData {
             Uptr typeId;
             ExceptionType *type;
@@ -82,6 +78,11 @@ namespace WAVM {
             Runtime::Function *function = nullptr;
             Uptr numCodeBytes = 0;
             std::atomic<Uptr> numRootReferences{0};
+
+            // Whether the function has been stored somewhere references to its module instance
+            // aren't counted, so the instance may only be deleted by the tracing collector.
+            std::atomic<bool> hasUncountedReferences{false};
+
             std::string debugName;
 
             FunctionMutableData(std::string &&inDebugName) : debugName(inDebugName) {}
@@ -102,8 +103,7 @@ namespace WAVM {
         };
 
         inline CompartmentRuntimeData *getCompartmentRuntimeData(ContextRuntimeData *contextRuntimeData) {
-            return reinterpret_cast<CompartmentRuntimeData *>(reinterpret_cast<Uptr>(contextRuntimeData) &
-                                                              0xffffffff00000000);
+            return contextRuntimeData->compartmentRuntimeData;
         }
     }
 }
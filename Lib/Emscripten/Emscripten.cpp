@@ -364,21 +364,89 @@ static F64 makeInf() {
 DEFINE_INTRINSIC_GLOBAL(global, "NaN", F64, NaN, makeNaN())
 DEFINE_INTRINSIC_GLOBAL(global, "Infinity", F64, Infinity, makeInf())
 
+// The asm2wasm integer division and remainder functions have JavaScript's semantics: dividing by
+// zero produces zero, and dividing INT32_MIN by -1 wraps.
 DEFINE_INTRINSIC_FUNCTION(asm2wasm, "i32u-rem", U32, I32_remu, U32 left, U32 right) {
-    return left % right;
+    return right ? left % right : 0;
 }
 
 DEFINE_INTRINSIC_FUNCTION(asm2wasm, "i32s-rem", I32, I32_rems, I32 left, I32 right) {
-    return left % right;
+    return right == 0 || right == -1 ? 0 : left % right;
 }
 
 DEFINE_INTRINSIC_FUNCTION(asm2wasm, "i32u-div", U32, I32_divu, U32 left, U32 right) {
-    return left / right;
+    return right ? left / right : 0;
 }
 
 DEFINE_INTRINSIC_FUNCTION(asm2wasm, "i32s-div", I32, I32_divs, I32 left, I32 right) {
-    return left / right;
-}
+    return right == 0 ? 0 : right == -1 ? I32(0u - U32(left)) : left / right;
+}
+
+// LLVM IR for the asm2wasm integer division and remainder functions, so calls to them can be
+// inlined into the compiled module.
+static const char asm2wasmDivisionLLVMIR[] = R"(
+define i32 @asm2wasm_i32u_rem(i8* %context, i32 %left, i32 %right) {
+entry:
+  %isZero = icmp eq i32 %right, 0
+  br i1 %isZero, label %zero, label %nonZero
+zero:
+  ret i32 0
+nonZero:
+  %result = urem i32 %left, %right
+  ret i32 %result
+}
+
+define i32 @asm2wasm_i32s_rem(i8* %context, i32 %left, i32 %right) {
+entry:
+  %isZero = icmp eq i32 %right, 0
+  %isMinusOne = icmp eq i32 %right, -1
+  %isZeroOrMinusOne = or i1 %isZero, %isMinusOne
+  br i1 %isZeroOrMinusOne, label %zero, label %nonZero
+zero:
+  ret i32 0
+nonZero:
+  %result = srem i32 %left, %right
+  ret i32 %result
+}
+
+define i32 @asm2wasm_i32u_div(i8* %context, i32 %left, i32 %right) {
+entry:
+  %isZero = icmp eq i32 %right, 0
+  br i1 %isZero, label %zero, label %nonZero
+zero:
+  ret i32 0
+nonZero:
+  %result = udiv i32 %left, %right
+  ret i32 %result
+}
+
+define i32 @asm2wasm_i32s_div(i8* %context, i32 %left, i32 %right) {
+entry:
+  %isZero = icmp eq i32 %right, 0
+  br i1 %isZero, label %zero, label %nonZero
+zero:
+  ret i32 0
+nonZero:
+  %isMinusOne = icmp eq i32 %right, -1
+  br i1 %isMinusOne, label %minusOne, label %divide
+minusOne:
+  %negated = sub i32 0, %left
+  ret i32 %negated
+divide:
+  %result = sdiv i32 %left, %right
+  ret i32 %result
+}
+)";
+
+static bool addInlinableAsm2WasmFunctions() {
+    Intrinsics::addInlinableFunction("asm2wasm", I32_remuIntrinsic, asm2wasmDivisionLLVMIR, "asm2wasm_i32u_rem");
+    Intrinsics::addInlinableFunction("asm2wasm", I32_remsIntrinsic, asm2wasmDivisionLLVMIR, "asm2wasm_i32s_rem");
+    Intrinsics::addInlinableFunction("asm2wasm", I32_divuIntrinsic, asm2wasmDivisionLLVMIR, "asm2wasm_i32u_div");
+    Intrinsics::addInlinableFunction("asm2wasm", I32_divsIntrinsic, asm2wasmDivisionLLVMIR, "asm2wasm_i32s_div");
+    return true;
+}
+
+static bool areAsm2WasmFunctionsInlinable = addInlinableAsm2WasmFunctions();
 
 DEFINE_INTRINSIC_FUNCTION(asm2wasm, "f64-rem", F64, F64_rems, F64 left, F64 right) {
     return (F64) fmod(left, right);
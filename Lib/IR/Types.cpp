@@ -25,6 +25,9 @@ struct TypeTupleHashPolicy {
     }
 };
 
+static const ValueType singleElementTypes[] = {ValueType::none, ValueType::any, ValueType::i32, ValueType::i64,
+        ValueType::f32, ValueType::f64, ValueType::v128, ValueType::anyref, ValueType::anyfunc, ValueType::nullref};
+
 struct FunctionTypeHashPolicy {
     static bool areKeysEqual(FunctionType left, FunctionType right) {
         return left.params() == right.params() && left.results() == right.results();
@@ -35,6 +38,60 @@ struct FunctionTypeHashPolicy {
     }
 };
 
+// The set of unique types, split into shards with their own mutexes so that threads interning
+// different types rarely contend.
+template<typename Type, typename HashPolicy> struct ShardedUniqueTypeSet {
+    // Returns the unique type equal to the key. If there isn't one yet, calls createUnique to
+    // allocate it and adds it to the set.
+    template<typename CreateUnique> Type getOrAdd(Type key, Uptr hash, CreateUnique &&createUnique) {
+        Shard &shard = shards[hash % numShards];
+        Lock<Platform::Mutex> shardLock(shard.mutex);
+
+        const Type *uniqueType = shard.set.get(key);
+        if (uniqueType) {
+            return *uniqueType;
+        } else {
+            Type newUniqueType = createUnique();
+            shard.set.addOrFail(newUniqueType);
+            return newUniqueType;
+        }
+    }
+
+private:
+    enum {
+        numShards = 64
+    };
+
+    struct alignas(64) Shard {
+        Platform::Mutex mutex;
+        HashSet<Type, HashPolicy> set;
+    };
+
+    Shard shards[numShards];
+};
+
+// A small direct-mapped cache of unique types that is private to a thread. Unique types are never
+// freed, so a cached type stays valid for the lifetime of the thread.
+template<typename Type, typename HashPolicy> struct UniqueTypeCache {
+    // Returns the cached unique type equal to the key, or null. Empty entries hold the
+    // default-constructed type, which is never looked up in the cache.
+    const Type *get(Type key, Uptr hash) const {
+        const Type &entry = entries[hash % numEntries];
+        return HashPolicy::areKeysEqual(entry, key) ? &entry : nullptr;
+    }
+
+    void add(Type uniqueType, Uptr hash) {
+        entries[hash % numEntries] = uniqueType;
+    }
+
+private:
+    enum {
+        numEntries = 256
+    };
+
+    Type entries[numEntries];
+};
+
 IR::TypeTuple::Impl::Impl(Uptr inNumElems, const ValueType *inElems) : numElems(inNumElems) {
     if (numElems) {
         memcpy(elems, inElems, sizeof(ValueType) * numElems);
@@ -68,23 +125,39 @@ const TypeTuple::Impl *IR::TypeTuple::getUniqueImpl(Uptr numElems, const ValueTy
     if (numElems == 0) {
         static Impl emptyImpl(0, nullptr);
         return &emptyImpl;
+    } else if (numElems == 1) {
+        // Single element tuples are the most common, so they are preallocated for every ValueType
+        // and never go through the global set.
+        struct SingleElementImpls {
+            Impl impls[Uptr(ValueType::num)] = {
+                    {1, &singleElementTypes[0]}, {1, &singleElementTypes[1]}, {1, &singleElementTypes[2]},
+                    {1, &singleElementTypes[3]}, {1, &singleElementTypes[4]}, {1, &singleElementTypes[5]},
+                    {1, &singleElementTypes[6]}, {1, &singleElementTypes[7]}, {1, &singleElementTypes[8]},
+                    {1, &singleElementTypes[9]},
+            };
+        };
+        static_assert(sizeof(singleElementTypes) / sizeof(ValueType) == Uptr(ValueType::num),
+                "singleElementTypes must contain every ValueType");
+        static SingleElementImpls singleElementImpls;
+        wavmAssert(Uptr(inElems[0]) < Uptr(ValueType::num));
+        return &singleElementImpls.impls[Uptr(inElems[0])];
     } else {
         const Uptr numImplBytes = Impl::calcNumBytes(numElems);
         Impl *localImpl = new(alloca(numImplBytes)) Impl(numElems, inElems);
 
-        static Platform::Mutex uniqueTypeTupleSetMutex;
-        static HashSet<TypeTuple, TypeTupleHashPolicy> uniqueTypeTupleSet;
-
-        Lock<Platform::Mutex> uniqueTypeTupleSetLock(uniqueTypeTupleSetMutex);
-
-        const TypeTuple *typeTuple = uniqueTypeTupleSet.get(TypeTuple(localImpl));
-        if (typeTuple) {
-            return typeTuple->impl;
-        } else {
-            Impl *globalImpl = new(malloc(numImplBytes)) Impl(*localImpl);
-            uniqueTypeTupleSet.addOrFail(TypeTuple(globalImpl));
-            return globalImpl;
+        // Look for the tuple in this thread's cache before locking the global set.
+        static thread_local UniqueTypeCache<TypeTuple, TypeTupleHashPolicy> uniqueTypeTupleCache;
+        if (const TypeTuple *cachedTypeTuple = uniqueTypeTupleCache.get(TypeTuple(localImpl), localImpl->hash)) {
+            return cachedTypeTuple->impl;
         }
+
+        static ShardedUniqueTypeSet<TypeTuple, TypeTupleHashPolicy> uniqueTypeTupleSet;
+        TypeTuple uniqueTypeTuple = uniqueTypeTupleSet.getOrAdd(TypeTuple(localImpl), localImpl->hash, [&] {
+            return TypeTuple(new(malloc(numImplBytes)) Impl(*localImpl));
+        });
+        const Impl *globalImpl = uniqueTypeTuple.impl;
+        uniqueTypeTupleCache.add(TypeTuple(globalImpl), globalImpl->hash);
+        return globalImpl;
     }
 }
 
@@ -99,18 +172,18 @@ const FunctionType::Impl *IR::FunctionType::getUniqueImpl(TypeTuple results, Typ
     } else {
         Impl localImpl(results, params);
 
-        static Platform::Mutex uniqueFunctionTypeSetMutex;
-        static HashSet<FunctionType, FunctionTypeHashPolicy> uniqueFunctionTypeSet;
-
-        Lock<Platform::Mutex> uniqueFunctionTypeSetLock(uniqueFunctionTypeSetMutex);
-
-        const FunctionType *functionType = uniqueFunctionTypeSet.get(FunctionType(&localImpl));
-        if (functionType) {
-            return functionType->impl;
-        } else {
-            Impl *globalImpl = new Impl(localImpl);
-            uniqueFunctionTypeSet.addOrFail(FunctionType(globalImpl));
-            return globalImpl;
+        // Look for the function type in this thread's cache before locking the global set.
+        static thread_local UniqueTypeCache<FunctionType, FunctionTypeHashPolicy> uniqueFunctionTypeCache;
+        if (const FunctionType *cachedFunctionType
+            = uniqueFunctionTypeCache.get(FunctionType(&localImpl), localImpl.hash)) {
+            return cachedFunctionType->impl;
         }
+
+        static ShardedUniqueTypeSet<FunctionType, FunctionTypeHashPolicy> uniqueFunctionTypeSet;
+        FunctionType uniqueFunctionType = uniqueFunctionTypeSet.getOrAdd(
+                FunctionType(&localImpl), localImpl.hash, [&] { return FunctionType(new Impl(localImpl)); });
+        const Impl *globalImpl = uniqueFunctionType.impl;
+        uniqueFunctionTypeCache.add(FunctionType(globalImpl), globalImpl->hash);
+        return globalImpl;
     }
 }
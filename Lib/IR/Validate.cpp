@@ -540,6 +540,28 @@ struct FunctionValidationContext {
         pushOperandTuple(calleeType.results());
     }
 
+    void return_call(FunctionImm imm) {
+        VALIDATE_FEATURE("return_call", tailCalls);
+        FunctionType calleeType = validateFunctionIndex(module, imm.functionIndex);
+        VALIDATE_UNLESS("return_call callee results must match the caller's results: ",
+                        !isSubtype(calleeType.results(), functionType.results()));
+        popAndValidateTypeTuple("return_call arguments", calleeType.params());
+        enterUnreachable();
+    }
+
+    void return_call_indirect(CallIndirectImm imm) {
+        VALIDATE_FEATURE("return_call_indirect", tailCalls);
+        VALIDATE_INDEX(imm.tableIndex, module.tables.size());
+        VALIDATE_UNLESS("return_call_indirect requires a table element type of anyfunc: ",
+                        module.tables.getType(imm.tableIndex).elementType != ReferenceType::anyfunc);
+        FunctionType calleeType = validateFunctionType(module, imm.type);
+        VALIDATE_UNLESS("return_call_indirect callee results must match the caller's results: ",
+                        !isSubtype(calleeType.results(), functionType.results()));
+        popAndValidateOperand("return_call_indirect function index", ValueType::i32);
+        popAndValidateTypeTuple("return_call_indirect arguments", calleeType.params());
+        enterUnreachable();
+    }
+
     void validateImm(NoImm) {
     }
 
@@ -22,10 +22,12 @@ namespace WAVM {
 
             llvm::Value *contextPointerVariable;
             llvm::Value *memoryBasePointerVariable;
+            llvm::Value *memoryNumBytesVariable;
 
             EmitContext(LLVMContext &inLLVMContext, llvm::Constant *inDefaultMemoryOffset)
                     : llvmContext(inLLVMContext), irBuilder(inLLVMContext), contextPointerVariable(nullptr),
-                      memoryBasePointerVariable(nullptr), defaultMemoryOffset(inDefaultMemoryOffset) {
+                      memoryBasePointerVariable(nullptr), memoryNumBytesVariable(nullptr),
+                      defaultMemoryOffset(inDefaultMemoryOffset) {
             }
 
             llvm::Value *loadFromUntypedPointer(llvm::Value *pointer, llvm::Type *valueType, U32 alignment = 1) {
@@ -40,28 +42,58 @@ namespace WAVM {
             }
 
             llvm::Value *getCompartmentAddress() {
-                // Derive the compartment runtime data from the context address by masking off the lower
-                // 32 bits.
-                return irBuilder.CreateIntToPtr(irBuilder.CreateAnd(irBuilder.CreatePtrToInt(irBuilder.CreateLoad(contextPointerVariable), llvmContext.i64Type), emitLiteral(llvmContext, ~(
-                        (U64(1) << 32) - 1))), llvmContext.i8PtrType);
+                // Load the compartment runtime data pointer from the context's runtime data. The load is
+                // marked invariant, since it never changes for a context, so LLVM can reuse it.
+                llvm::Value *contextPointer = irBuilder.CreateLoad(contextPointerVariable);
+                auto load = irBuilder.CreateLoad(irBuilder.CreatePointerCast(irBuilder.CreateInBoundsGEP(contextPointer, {emitLiteral(llvmContext, Uptr(offsetof(Runtime::ContextRuntimeData, compartmentRuntimeData)))}), llvmContext.i8PtrType->getPointerTo()));
+                load->setAlignment(sizeof(Uptr));
+                load->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(llvmContext, {}));
+                return load;
             }
 
-            void reloadMemoryBase() {
-                llvm::Value *compartmentAddress = getCompartmentAddress();
+            // Loads the default memory's base address. A memory reserves the address space for its
+            // maximum size when it is created, and never moves, so the base address only needs to be
+            // loaded once per function: LLVM can then keep it in a register across calls.
+            void loadMemoryBase() {
+                if (defaultMemoryOffset) {
+                    llvm::Value *compartmentAddress = getCompartmentAddress();
+                    auto load = llvm::cast<llvm::LoadInst>(loadFromUntypedPointer(irBuilder.CreateInBoundsGEP(compartmentAddress, {defaultMemoryOffset}), llvmContext.i8PtrType, sizeof(U8 *)));
+                    load->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(llvmContext, {}));
+                    irBuilder.CreateStore(load, memoryBasePointerVariable);
+                }
+            }
 
-                // Load the defaultMemoryBase and defaultTableBase values from the runtime data for this
-                // module instance.
+            // Loads the current size of the default memory from the compartment's runtime data. If
+            // isAtomic is true, the load is atomic, for memories that other threads may grow.
+            llvm::Value *loadMemoryNumBytes(bool isAtomic = false) {
+                wavmAssert(defaultMemoryOffset);
+                llvm::Value *compartmentAddress = getCompartmentAddress();
+                llvm::Constant *memoryNumBytesOffset = llvm::ConstantExpr::getAdd(defaultMemoryOffset, emitLiteral(llvmContext, Uptr(offsetof(Runtime::CompartmentRuntimeData, memoryNumBytes) - offsetof(Runtime::CompartmentRuntimeData, memoryBases))));
+                auto load = llvm::cast<llvm::LoadInst>(loadFromUntypedPointer(irBuilder.CreateInBoundsGEP(compartmentAddress, {memoryNumBytesOffset}), llvmContext.i64Type, sizeof(Uptr)));
+                if (isAtomic) {
+                    load->setAtomic(llvm::AtomicOrdering::Monotonic);
+                }
+                return load;
+            }
 
+            // Reloads the cached size of the default memory used by explicit bounds checks. This must
+            // be done after anything that may grow the memory: memory.grow, and calls to other
+            // functions. If explicit bounds checks aren't used, the load will be eliminated as dead
+            // code. Checks of accesses to a shared memory don't use the cached size, since another
+            // thread may grow the memory at any time.
+            void reloadMemoryNumBytes() {
                 if (defaultMemoryOffset) {
-                    irBuilder.CreateStore(loadFromUntypedPointer(irBuilder.CreateInBoundsGEP(compartmentAddress, {defaultMemoryOffset}), llvmContext.i8PtrType, sizeof(U8 *)), memoryBasePointerVariable);
+                    irBuilder.CreateStore(loadMemoryNumBytes(), memoryNumBytesVariable);
                 }
             }
 
             void initContextVariables(llvm::Value *initialContextPointer) {
                 memoryBasePointerVariable = irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "memoryBase");
+                memoryNumBytesVariable = irBuilder.CreateAlloca(llvmContext.i64Type, nullptr, "memoryNumBytes");
                 contextPointerVariable = irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "context");
                 irBuilder.CreateStore(initialContextPointer, contextPointerVariable);
-                reloadMemoryBase();
+                loadMemoryBase();
+                reloadMemoryNumBytes();
             }
 
             // Creates either a call or an invoke if the call occurs inside a try.
@@ -99,8 +131,9 @@ namespace WAVM {
                         auto newContextPointer = irBuilder.CreateExtractValue(returnValue, {0});
                         irBuilder.CreateStore(newContextPointer, contextPointerVariable);
 
-                        // Reload the memory/table base pointers.
-                        reloadMemoryBase();
+                        // The callee may have grown the memory, so reload its size. The memory base
+                        // doesn't need to be reloaded, since memories never move.
+                        reloadMemoryNumBytes();
 
                         if (areResultsReturnedDirectly(calleeType.results())) {
                             // If the results are returned directly, extract them from the returned struct.
@@ -130,8 +163,9 @@ namespace WAVM {
                         // Update the context variable.
                         irBuilder.CreateStore(newContextPointer, contextPointerVariable);
 
-                        // Reload the memory/table base pointers.
-                        reloadMemoryBase();
+                        // The callee may have grown the memory, so reload its size. The memory base
+                        // doesn't need to be reloaded, since memories never move.
+                        reloadMemoryNumBytes();
 
                         // Load the call result from the returned context.
                         wavmAssert(calleeType.results().size() <= 1);
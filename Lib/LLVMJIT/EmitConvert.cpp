@@ -73,28 +73,78 @@ llvm::Value *EmitFunctionContext::emitF64Promote(llvm::Value *operand) {
     return callLLVMIntrinsic({llvmContext.f64Type}, llvm::Intrinsic::experimental_constrained_fmul, {f64Operand, emitLiteral(llvmContext, F64(1.0)), moduleContext.fpRoundingModeMetadata, moduleContext.fpExceptionMetadata});
 }
 
-template<typename Float> llvm::Value *EmitFunctionContext::emitTruncFloatToInt(ValueType destType, bool isSigned, Float minBounds, Float maxBounds, llvm::Value *operand) {
-    auto nanBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_nan", function);
-    auto notNaNBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_notNaN", function);
-    auto overflowBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_overflow", function);
-    auto noOverflowBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_noOverflow", function);
+#if defined(__x86_64__) || defined(_M_X64)
+// Truncates a float to a signed integer with cvttss2si/cvttsd2si. Unlike LLVM's fptosi, these
+// have defined behavior for NaN and out-of-range operands: they return the minimum signed integer
+// (the "integer indefinite" value).
+static llvm::Value *emitX86TruncFloatToInt(EmitFunctionContext &functionContext, llvm::Value *operand, bool is64BitResult) {
+    LLVMContext &llvmContext = functionContext.llvmContext;
+    const bool isF64 = operand->getType() == llvmContext.f64Type;
+    llvm::Value *vectorOperand = functionContext.irBuilder.CreateInsertElement(llvm::UndefValue::get(isF64 ? llvmContext.f64x2Type : llvmContext.f32x4Type), operand, emitLiteral(llvmContext, U32(0)));
+    const llvm::Intrinsic::ID intrinsicId = isF64 ? (is64BitResult ? llvm::Intrinsic::x86_sse2_cvttsd2si64 : llvm::Intrinsic::x86_sse2_cvttsd2si) : (is64BitResult ? llvm::Intrinsic::x86_sse_cvttss2si64 : llvm::Intrinsic::x86_sse_cvttss2si);
+    return functionContext.callLLVMIntrinsic({}, intrinsicId, {vectorOperand});
+}
+#endif
+
+template<typename Float> static void emitTruncFloatToIntChecks(EmitFunctionContext &functionContext, Float minBounds, Float maxBounds, llvm::Value *operand) {
+    LLVMContext &llvmContext = functionContext.llvmContext;
+    llvm::IRBuilder<> &irBuilder = functionContext.irBuilder;
+
+    auto nanBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_nan", functionContext.function);
+    auto notNaNBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_notNaN", functionContext.function);
+    auto overflowBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_overflow", functionContext.function);
+    auto noOverflowBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_noOverflow", functionContext.function);
 
     auto isNaN = createFCmpWithWorkaround(irBuilder, llvm::CmpInst::FCMP_UNO, operand, operand);
-    irBuilder.CreateCondBr(isNaN, nanBlock, notNaNBlock, moduleContext.likelyFalseBranchWeights);
+    irBuilder.CreateCondBr(isNaN, nanBlock, notNaNBlock, functionContext.moduleContext.likelyFalseBranchWeights);
 
     irBuilder.SetInsertPoint(nanBlock);
-    emitRuntimeIntrinsic("invalidFloatOperationTrap", FunctionType(), {});
+    functionContext.emitRuntimeIntrinsic("invalidFloatOperationTrap", FunctionType(), {});
     irBuilder.CreateUnreachable();
 
     irBuilder.SetInsertPoint(notNaNBlock);
     auto isOverflow = irBuilder.CreateOr(irBuilder.CreateFCmpOGE(operand, emitLiteral(llvmContext, maxBounds)), irBuilder.CreateFCmpOLE(operand, emitLiteral(llvmContext, minBounds)));
-    irBuilder.CreateCondBr(isOverflow, overflowBlock, noOverflowBlock, moduleContext.likelyFalseBranchWeights);
+    irBuilder.CreateCondBr(isOverflow, overflowBlock, noOverflowBlock, functionContext.moduleContext.likelyFalseBranchWeights);
 
     irBuilder.SetInsertPoint(overflowBlock);
-    emitRuntimeIntrinsic("divideByZeroOrIntegerOverflowTrap", FunctionType(), {});
+    functionContext.emitRuntimeIntrinsic("divideByZeroOrIntegerOverflowTrap", FunctionType(), {});
     irBuilder.CreateUnreachable();
 
     irBuilder.SetInsertPoint(noOverflowBlock);
+}
+
+template<typename Float> llvm::Value *EmitFunctionContext::emitTruncFloatToInt(ValueType destType, bool isSigned, Float minBounds, Float maxBounds, llvm::Value *operand) {
+#if defined(__x86_64__) || defined(_M_X64)
+    // Truncate the operand without checking it first, and only check for NaN and overflow on a cold
+    // path if the result is the sentinel returned for invalid operands. Signed truncation returns
+    // the minimum integer, which is also a valid result. Unsigned 32-bit truncation uses the 64-bit
+    // signed conversion, so any result outside the 32-bit unsigned range means the operand was
+    // invalid. Unsigned 64-bit truncation has no such conversion, so it uses the generic lowering.
+    if (isSigned || destType == ValueType::i32) {
+        const bool is64BitConversion = destType == ValueType::i64 || !isSigned;
+        llvm::Value *result = emitX86TruncFloatToInt(*this, operand, is64BitConversion);
+
+        llvm::Value *isSentinel;
+        if (isSigned) {
+            isSentinel = irBuilder.CreateICmpEQ(result, destType == ValueType::i32 ? emitLiteral(llvmContext, I32(INT32_MIN)) : emitLiteral(llvmContext, I64(INT64_MIN)));
+        } else {
+            isSentinel = irBuilder.CreateICmpUGT(result, emitLiteral(llvmContext, U64(UINT32_MAX)));
+        }
+
+        auto sentinelBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_sentinel", function);
+        auto endBlock = llvm::BasicBlock::Create(llvmContext, "FPToInt_end", function);
+        irBuilder.CreateCondBr(isSentinel, sentinelBlock, endBlock, moduleContext.likelyFalseBranchWeights);
+
+        irBuilder.SetInsertPoint(sentinelBlock);
+        emitTruncFloatToIntChecks(*this, minBounds, maxBounds, operand);
+        irBuilder.CreateBr(endBlock);
+
+        irBuilder.SetInsertPoint(endBlock);
+        return isSigned ? result : trunc(result, llvmContext.i32Type);
+    }
+#endif
+
+    emitTruncFloatToIntChecks(*this, minBounds, maxBounds, operand);
     return isSigned ? irBuilder.CreateFPToSI(operand, asLLVMType(llvmContext, destType)) : irBuilder.CreateFPToUI(operand, asLLVMType(llvmContext, destType));
 }
 
@@ -119,6 +169,18 @@ EMIT_UNARY_OP(i64_trunc_u_f32, emitTruncFloatToInt<F32>(ValueType::i64, false, -
 EMIT_UNARY_OP(i64_trunc_u_f64, emitTruncFloatToInt<F64>(ValueType::i64, false, -1.0, 18446744073709551616.0, operand))
 
 template<typename Int, typename Float> llvm::Value *EmitFunctionContext::emitTruncFloatToIntSat(llvm::Type *destType, bool isSigned, Float minFloatBounds, Float maxFloatBounds, Int minIntBounds, Int maxIntBounds, llvm::Value *operand) {
+#if defined(__x86_64__) || defined(_M_X64)
+    // cvttss2si/cvttsd2si already return the minimum integer for operands below the range, so
+    // only NaN and operands above the range need to be selected. This lowers to the conversion and
+    // two conditional moves.
+    if (isSigned) {
+        llvm::Value *result = emitX86TruncFloatToInt(*this, operand, destType == llvmContext.i64Type);
+        result = irBuilder.CreateSelect(irBuilder.CreateFCmpOGE(operand, emitLiteral(llvmContext, maxFloatBounds)), emitLiteral(llvmContext, maxIntBounds), result);
+        result = irBuilder.CreateSelect(createFCmpWithWorkaround(irBuilder, llvm::CmpInst::FCMP_UNO, operand, operand), emitLiteral(llvmContext, Int(0)), result);
+        return result;
+    }
+#endif
+
     llvm::Value *result = isSigned ? irBuilder.CreateFPToSI(operand, destType) : irBuilder.CreateFPToUI(operand, destType);
 
     result = irBuilder.CreateSelect(irBuilder.CreateFCmpOGE(operand, emitLiteral(llvmContext, maxFloatBounds)), emitLiteral(llvmContext, maxIntBounds), result);
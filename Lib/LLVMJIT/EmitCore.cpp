@@ -284,11 +284,55 @@ void EmitFunctionContext::unreachable(NoImm) {
 // Call operators
 //
 
-void EmitFunctionContext::call(FunctionImm imm) {
-    wavmAssert(imm.functionIndex < moduleContext.functions.size());
-    wavmAssert(imm.functionIndex < irModule.functions.size());
+void EmitFunctionContext::emitReturnCall(llvm::Value *callee, llvm::ArrayRef<llvm::Value *> args, FunctionType calleeType) {
+    // A return call replaces this function's frame, so an exception thrown by the callee isn't
+    // caught by a try block around the return call. The call therefore never unwinds to a catch in
+    // this function, and is emitted as a tail call even inside a try block.
+    llvm::FunctionType *llvmCalleeType = asLLVMType(llvmContext, calleeType, CallingConvention::wasm);
+    if (llvmCalleeType->getReturnType() != function->getReturnType()) {
+        // A call whose results have different LLVM types than the caller's can't be a tail call, so
+        // call the callee, and branch to the return block with its results. Validation requires the
+        // callee's results to be subtypes of the caller's, and all reference types map to the same
+        // LLVM type, so this may be unreachable.
+        ValueVector results = emitCallOrInvoke(callee, args, calleeType, CallingConvention::wasm, nullptr);
+        wavmAssert(results.size() == controlStack[0].endPHIs.size());
+        for (Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex) {
+            controlStack[0].endPHIs[resultIndex]->addIncoming(coerceToCanonicalType(results[resultIndex]), irBuilder.GetInsertBlock());
+        }
+        irBuilder.CreateBr(controlStack[0].endBlock);
+        return;
+    }
+
+    // Pass the context to the callee, and return the callee's return struct, which contains the
+    // context and results the callee returns, as this function's return struct.
+    auto augmentedArgs = (llvm::Value **) alloca(sizeof(llvm::Value *) * (args.size() + 1));
+    augmentedArgs[0] = irBuilder.CreateLoad(contextPointerVariable);
+    for (Uptr argIndex = 0; argIndex < args.size(); ++argIndex) {
+        augmentedArgs[1 + argIndex] = args[argIndex];
+    }
+    auto call = irBuilder.CreateCall(callee, llvm::ArrayRef<llvm::Value *>(augmentedArgs, args.size() + 1));
+    call->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
+
+    // LLVM only allows musttail calls to functions with the same prototype as the caller. Calls to
+    // other functions are marked as tail calls, which LLVM guarantees to lower as tail calls for the
+    // wasm calling convention, since the target machine is created with GuaranteedTailCallOpt.
+    call->setTailCallKind(llvmCalleeType == function->getFunctionType() ? llvm::CallInst::TCK_MustTail : llvm::CallInst::TCK_Tail);
+    irBuilder.CreateRet(call);
+}
 
-    llvm::Value *callee = moduleContext.functions[imm.functionIndex];
+llvm::Value *EmitFunctionContext::getCallee(Uptr functionIndex) {
+    wavmAssert(functionIndex < moduleContext.functions.size());
+    wavmAssert(functionIndex < irModule.functions.size());
+
+    if (functionIndex < moduleContext.inlinableImportFunctions.size() &&
+        moduleContext.inlinableImportFunctions[functionIndex]) {
+        return moduleContext.inlinableImportFunctions[functionIndex];
+    }
+    return moduleContext.functions[functionIndex];
+}
+
+void EmitFunctionContext::call(FunctionImm imm) {
+    llvm::Value *callee = getCallee(imm.functionIndex);
     FunctionType calleeType = irModule.types[irModule.functions.getType(imm.functionIndex).index];
 
     // Pop the call arguments from the operand stack.
@@ -310,7 +354,27 @@ void EmitFunctionContext::call(FunctionImm imm) {
     }
 }
 
-void EmitFunctionContext::call_indirect(CallIndirectImm imm) {
+void EmitFunctionContext::return_call(FunctionImm imm) {
+    llvm::Value *callee = getCallee(imm.functionIndex);
+    FunctionType calleeType = irModule.types[irModule.functions.getType(imm.functionIndex).index];
+
+    // Pop the call arguments from the operand stack.
+    const Uptr numArguments = calleeType.params().size();
+    auto llvmArgs = (llvm::Value **) alloca(sizeof(llvm::Value *) * numArguments);
+    popMultiple(llvmArgs, numArguments);
+
+    // Coerce the arguments to their canonical type.
+    for (Uptr argIndex = 0; argIndex < numArguments; ++argIndex) {
+        llvmArgs[argIndex] = coerceToCanonicalType(llvmArgs[argIndex]);
+    }
+
+    // Tail call the function.
+    emitReturnCall(callee, llvm::ArrayRef<llvm::Value *>(llvmArgs, numArguments), calleeType);
+
+    enterUnreachable();
+}
+
+void EmitFunctionContext::emitCallIndirect(CallIndirectImm imm, bool isReturnCall) {
     wavmAssert(imm.type.index < irModule.types.size());
 
     const FunctionType calleeType = irModule.types[imm.type.index];
@@ -338,7 +402,45 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm) {
     llvm::LoadInst *biasedValueLoad = irBuilder.CreateLoad(elementPointer);
     biasedValueLoad->setAtomic(llvm::AtomicOrdering::Acquire);
     biasedValueLoad->setAlignment(sizeof(Uptr));
-    auto runtimeFunction = irBuilder.CreateIntToPtr(irBuilder.CreateAdd(biasedValueLoad, moduleContext.tableReferenceBias), llvmContext.i8PtrType);
+    auto runtimeFunctionAddress = irBuilder.CreateAdd(biasedValueLoad, moduleContext.tableReferenceBias);
+
+    // If the module's element segments only write one function of the callee type to the table,
+    // predict that it is the callee: guard on its address, and call it directly if the guard
+    // passes. The direct call doesn't need the type check, and is well predicted. The table may
+    // still contain other functions, so fall back to the indirect call if the guard fails.
+    const Uptr *predictedFunctionIndex = moduleContext.callIndirectTargets[imm.tableIndex].get(calleeType);
+    llvm::BasicBlock *endBlock = nullptr;
+    PHIVector resultPHIs;
+    if (predictedFunctionIndex && *predictedFunctionIndex != UINTPTR_MAX && *predictedFunctionIndex >= irModule.functions.imports.size()) {
+        llvm::Function *predictedFunction = moduleContext.functions[*predictedFunctionIndex];
+        llvm::Constant *predictedFunctionAddress = llvm::ConstantExpr::getSub(llvm::ConstantExpr::getPtrToInt(predictedFunction, llvmContext.iptrType), emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code))));
+
+        auto directCallBlock = llvm::BasicBlock::Create(llvmContext, "callIndirectDirect", function);
+        auto indirectCallBlock = llvm::BasicBlock::Create(llvmContext, "callIndirectIndirect", function);
+        irBuilder.CreateCondBr(irBuilder.CreateICmpEQ(runtimeFunctionAddress, predictedFunctionAddress), directCallBlock, indirectCallBlock, moduleContext.likelyTrueBranchWeights);
+
+        // A return call doesn't return to this function, so there are no results to merge.
+        irBuilder.SetInsertPoint(directCallBlock);
+        if (isReturnCall) {
+            emitReturnCall(predictedFunction, llvm::ArrayRef<llvm::Value *>(llvmArgs, numArguments), calleeType);
+        } else {
+            endBlock = llvm::BasicBlock::Create(llvmContext, "callIndirectEnd", function);
+            ValueVector directResults = emitCallOrInvoke(predictedFunction, llvm::ArrayRef<llvm::Value *>(llvmArgs, numArguments), calleeType, CallingConvention::wasm, getInnermostUnwindToBlock());
+            llvm::BasicBlock *directCallEndBlock = irBuilder.GetInsertBlock();
+            irBuilder.CreateBr(endBlock);
+
+            irBuilder.SetInsertPoint(endBlock);
+            for (llvm::Value *directResult : directResults) {
+                llvm::PHINode *resultPHI = irBuilder.CreatePHI(directResult->getType(), 2);
+                resultPHI->addIncoming(directResult, directCallEndBlock);
+                resultPHIs.push_back(resultPHI);
+            }
+        }
+
+        irBuilder.SetInsertPoint(indirectCallBlock);
+    }
+
+    auto runtimeFunction = irBuilder.CreateIntToPtr(runtimeFunctionAddress, llvmContext.i8PtrType);
     auto elementTypeId = loadFromUntypedPointer(irBuilder.CreateInBoundsGEP(runtimeFunction, emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, encodedType)))), llvmContext.iptrType, sizeof(Uptr));
     auto calleeTypeId = moduleContext.typeIds[imm.type.index];
 
@@ -347,14 +449,41 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm) {
 
     // Call the function loaded from the table.
     auto functionPointer = irBuilder.CreatePointerCast(irBuilder.CreateInBoundsGEP(runtimeFunction, emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code)))), asLLVMType(llvmContext, calleeType, CallingConvention::wasm)->getPointerTo());
+    if (isReturnCall) {
+        emitReturnCall(functionPointer, llvm::ArrayRef<llvm::Value *>(llvmArgs, numArguments), calleeType);
+        enterUnreachable();
+        return;
+    }
     ValueVector results = emitCallOrInvoke(functionPointer, llvm::ArrayRef<llvm::Value *>(llvmArgs, numArguments), calleeType, CallingConvention::wasm, getInnermostUnwindToBlock());
 
+    // If the callee was predicted, merge the results of the direct and indirect calls.
+    if (endBlock) {
+        wavmAssert(results.size() == resultPHIs.size());
+        for (Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex) {
+            resultPHIs[resultIndex]->addIncoming(results[resultIndex], irBuilder.GetInsertBlock());
+        }
+        irBuilder.CreateBr(endBlock);
+        irBuilder.SetInsertPoint(endBlock);
+        results.clear();
+        for (llvm::PHINode *resultPHI : resultPHIs) {
+            results.push_back(resultPHI);
+        }
+    }
+
     // Push the results on the operand stack.
     for (llvm::Value *result : results) {
         push(result);
     }
 }
 
+void EmitFunctionContext::call_indirect(CallIndirectImm imm) {
+    emitCallIndirect(imm, false);
+}
+
+void EmitFunctionContext::return_call_indirect(CallIndirectImm imm) {
+    emitCallIndirect(imm, true);
+}
+
 void EmitFunctionContext::nop(IR::NoImm) {
 }
 
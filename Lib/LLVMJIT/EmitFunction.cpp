@@ -149,6 +149,7 @@ void EmitFunctionContext::emitConditionalTrapIntrinsic(llvm::Value *booleanCondi
 
     irBuilder.SetInsertPoint(trueBlock);
     emitRuntimeIntrinsic(intrinsicName, intrinsicType, args);
+    moduleContext.llvmModule->getFunction(intrinsicName)->setDoesNotReturn();
     irBuilder.CreateUnreachable();
 
     irBuilder.SetInsertPoint(endBlock);
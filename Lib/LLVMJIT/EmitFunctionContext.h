@@ -132,6 +132,16 @@ namespace WAVM {
             // A helper function to emit a conditional call to a non-returning intrinsic function.
             void emitConditionalTrapIntrinsic(llvm::Value *booleanCondition, const char *intrinsicName, IR::FunctionType intrinsicType, const std::initializer_list<llvm::Value *> &args);
 
+            // Returns the function to call for a call to a function index.
+            llvm::Value *getCallee(Uptr functionIndex);
+
+            // Calls a function with the wasm calling convention, and returns its results from this
+            // function. The call is a tail call, and never unwinds to a catch in this function.
+            void emitReturnCall(llvm::Value *callee, llvm::ArrayRef<llvm::Value *> args, IR::FunctionType calleeType);
+
+            // Emits call_indirect, or return_call_indirect if isReturnCall is true.
+            void emitCallIndirect(IR::CallIndirectImm imm, bool isReturnCall);
+
             void pushControlStack(ControlContext::Type type, IR::TypeTuple resultTypes, llvm::BasicBlock *endBlock, const PHIVector &endPHIs, llvm::BasicBlock *elseBlock = nullptr, const ValueVector &elseArgs = {});
 
             void pushBranchTarget(IR::TypeTuple branchArgumentType, llvm::BasicBlock *branchTargetBlock, const PHIVector &branchTargetPHIs);
@@ -165,6 +175,13 @@ namespace WAVM {
 
             llvm::Value *emitSRem(IR::ValueType type, llvm::Value *left, llvm::Value *right);
 
+            // Returns whether an integer division by the given divisor should rely on the hardware to
+            // trap on a zero divisor or signed overflow, instead of explicitly checking for them.
+            bool shouldUseHardwareDivideTraps(llvm::Value *divisor);
+
+            // Emits a division whose divisor may be zero, relying on the hardware to trap if it is.
+            llvm::Value *emitHardwareTrappingDivide(llvm::Value *left, llvm::Value *right, bool isSigned, bool isRemainder);
+
             llvm::Value *emitF64Promote(llvm::Value *operand);
 
             template<typename Float> llvm::Value *emitTruncFloatToInt(IR::ValueType destType, bool isSigned, Float minBounds, Float maxBounds, llvm::Value *operand);
@@ -8,10 +8,10 @@ POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
 
-// Bounds checks a sandboxed memory address + offset, and returns an offset relative to the memory
-// base address that is guaranteed to be within the virtual address space allocated for the linear
-// memory object.
-static llvm::Value *getOffsetAndBoundedAddress(EmitContext &emitContext, llvm::Value *address, U32 offset) {
+// Bounds checks a sandboxed memory address + offset for an access of numBytes, and returns an offset
+// relative to the memory base address that is guaranteed to be within the virtual address space
+// allocated for the linear memory object.
+static llvm::Value *getOffsetAndBoundedAddress(EmitFunctionContext &emitContext, llvm::Value *address, U32 offset, U64 numBytes) {
     // zext the 32-bit address to 64-bits.
     // This is crucial for security, as LLVM will otherwise implicitly sign extend it to 64-bits in
     // the GEP below, interpreting it as a signed offset and allowing access to memory outside the
@@ -26,6 +26,26 @@ static llvm::Value *getOffsetAndBoundedAddress(EmitContext &emitContext, llvm::V
     // If HAS_64BIT_ADDRESS_SPACE, the memory has enough virtual address space allocated to ensure
     // that any 32-bit byte index + 32-bit offset will fall within the virtual address sandbox, so
     // no explicit bounds check is necessary.
+    // If the module was compiled with explicit bounds checks, its memories only reserve address
+    // space for their maximum size, so check that the last byte of the access is within the
+    // memory. The 64-bit sum of the 32-bit address, offset and access size can't overflow. The
+    // memory size is cached in a local variable that is only reloaded after calls, so LLVM can
+    // hoist and eliminate redundant checks. Another thread may grow a shared memory at any time,
+    // which would leave the cached size stale, so accesses to a shared memory load its current size.
+    if (emitContext.moduleContext.irModule.featureSpec.explicitBoundsChecks) {
+        wavmAssert(numBytes > 0);
+        llvm::Value *lastByteAddress = address;
+        if (numBytes > 1) {
+            lastByteAddress = emitContext.irBuilder.CreateAdd(address, emitLiteral(emitContext.llvmContext, U64(numBytes - 1)));
+        }
+        llvm::Value *memoryNumBytes;
+        if (emitContext.moduleContext.irModule.memories.getType(0).isShared) {
+            memoryNumBytes = emitContext.loadMemoryNumBytes(true);
+        } else {
+            memoryNumBytes = emitContext.irBuilder.CreateLoad(emitContext.memoryNumBytesVariable);
+        }
+        emitContext.emitConditionalTrapIntrinsic(emitContext.irBuilder.CreateICmpUGE(lastByteAddress, memoryNumBytes), "outOfBoundsMemoryTrap", FunctionType(TypeTuple{}, TypeTuple{ValueType::i64}), {address});
+    }
 
     return address;
 }
@@ -49,6 +69,9 @@ void EmitFunctionContext::memory_grow(MemoryImm imm) {
     llvm::Value *deltaNumPages = pop();
     ValueVector previousNumPages = emitRuntimeIntrinsic("memory.grow", FunctionType(TypeTuple(ValueType::i32), TypeTuple({ValueType::i32, inferValueType<Uptr>()})), {deltaNumPages, getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
     wavmAssert(previousNumPages.size() == 1);
+
+    // Reload the cached memory size used by explicit bounds checks.
+    reloadMemoryNumBytes();
     push(previousNumPages[0]);
 }
 
@@ -74,11 +97,44 @@ void EmitFunctionContext::memory_drop(DataSegmentImm imm) {
     emitRuntimeIntrinsic("memory.drop", FunctionType({}, TypeTuple({inferValueType<Uptr>(), inferValueType<Uptr>()})), {moduleContext.moduleInstanceId, emitLiteral(llvmContext, imm.dataSegmentIndex)});
 }
 
+// memory.copy and memory.fill with a constant size up to this many bytes are expanded inline. LLVM
+// lowers a memmove or memset of up to this size to a few loads and stores on all supported
+// targets, instead of calling the C library.
+static constexpr U64 maxInlineBulkMemoryBytes = 64;
+
+// Returns whether a bulk memory operation on the default memory should be expanded inline, and if
+// so, the constant number of bytes it accesses.
+static bool getInlineBulkMemoryNumBytes(MemoryImm imm, llvm::Value *numBytes, U64 &outNumBytes) {
+    auto constantNumBytes = llvm::dyn_cast<llvm::ConstantInt>(numBytes);
+    if (imm.memoryIndex != 0 || !constantNumBytes) {
+        return false;
+    }
+
+    // Zero-byte operations don't access the memory, so an address at the end of the memory
+    // mustn't fail the bounds check. Leave them to the intrinsic.
+    outNumBytes = constantNumBytes->getZExtValue();
+    return outNumBytes > 0 && outNumBytes <= maxInlineBulkMemoryBytes;
+}
+
 void EmitFunctionContext::memory_copy(MemoryImm imm) {
     auto numBytes = pop();
     auto sourceAddress = pop();
     auto destAddress = pop();
 
+    // Expand small constant-size copies inline. The source and destination are bounds checked the
+    // same way as loads and stores.
+    U64 inlineNumBytes;
+    if (getInlineBulkMemoryNumBytes(imm, numBytes, inlineNumBytes)) {
+        auto destPointer = coerceAddressToPointer(getOffsetAndBoundedAddress(*this, destAddress, 0, inlineNumBytes), llvmContext.i8Type);
+        auto sourcePointer = coerceAddressToPointer(getOffsetAndBoundedAddress(*this, sourceAddress, 0, inlineNumBytes), llvmContext.i8Type);
+#if LLVM_VERSION_MAJOR >= 7
+        irBuilder.CreateMemMove(destPointer, 1, sourcePointer, 1, inlineNumBytes, true);
+#else
+        irBuilder.CreateMemMove(destPointer, sourcePointer, inlineNumBytes, 1, true);
+#endif
+        return;
+    }
+
     emitRuntimeIntrinsic("memory.copy", FunctionType({}, TypeTuple({ValueType::i32, ValueType::i32, ValueType::i32, inferValueType<Uptr>()})), {destAddress, sourceAddress, numBytes, getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
 }
 
@@ -87,6 +143,14 @@ void EmitFunctionContext::memory_fill(MemoryImm imm) {
     auto value = pop();
     auto destAddress = pop();
 
+    // Expand small constant-size fills inline.
+    U64 inlineNumBytes;
+    if (getInlineBulkMemoryNumBytes(imm, numBytes, inlineNumBytes)) {
+        auto destPointer = coerceAddressToPointer(getOffsetAndBoundedAddress(*this, destAddress, 0, inlineNumBytes), llvmContext.i8Type);
+        irBuilder.CreateMemSet(destPointer, trunc(value, llvmContext.i8Type), inlineNumBytes, 1, true);
+        return;
+    }
+
     emitRuntimeIntrinsic("memory.fill", FunctionType({}, TypeTuple({ValueType::i32, ValueType::i32, ValueType::i32, inferValueType<Uptr>()})), {destAddress, value, numBytes, getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
 }
 
@@ -98,7 +162,8 @@ void EmitFunctionContext::memory_fill(MemoryImm imm) {
     void EmitFunctionContext::valueTypeId##_##name(LoadOrStoreImm<naturalAlignmentLog2> imm)       \
     {                                                                                              \
         auto address = pop();                                                                      \
-        auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
+        auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+            *this, address, imm.offset, U64(1) << naturalAlignmentLog2);                           \
         auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
         auto load = irBuilder.CreateLoad(pointer);                                                 \
         /* Don't trust the alignment hint provided by the WebAssembly code, since the load can't   \
@@ -112,7 +177,8 @@ void EmitFunctionContext::memory_fill(MemoryImm imm) {
     {                                                                                              \
         auto value = pop();                                                                        \
         auto address = pop();                                                                      \
-        auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
+        auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+            *this, address, imm.offset, U64(1) << naturalAlignmentLog2);                           \
         auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
         auto memoryValue = conversionOp(value, llvmMemoryType);                                    \
         auto store = irBuilder.CreateStore(memoryValue, pointer);                                  \
@@ -184,7 +250,7 @@ void EmitFunctionContext::trapIfMisalignedAtomic(llvm::Value *address, U32 align
 void EmitFunctionContext::atomic_wake(AtomicLoadOrStoreImm<2> imm) {
     llvm::Value *numWaiters = pop();
     llvm::Value *address = pop();
-    llvm::Value *boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);
+    llvm::Value *boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset, 4);
     trapIfMisalignedAtomic(boundedAddress, imm.alignmentLog2);
     push(emitRuntimeIntrinsic("atomic_wake", FunctionType(TypeTuple{ValueType::i32}, TypeTuple{ValueType::i32, ValueType::i32, ValueType::i64}), {address, numWaiters, getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
 }
@@ -193,7 +259,7 @@ void EmitFunctionContext::i32_atomic_wait(AtomicLoadOrStoreImm<2> imm) {
     llvm::Value *timeout = pop();
     llvm::Value *expectedValue = pop();
     llvm::Value *address = pop();
-    llvm::Value *boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);
+    llvm::Value *boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset, 4);
     trapIfMisalignedAtomic(boundedAddress, imm.alignmentLog2);
     push(emitRuntimeIntrinsic("atomic_wait_i32", FunctionType(TypeTuple{ValueType::i32}, TypeTuple{ValueType::i32, ValueType::i32, ValueType::f64, inferValueType<Uptr>()}), {address, expectedValue, timeout, getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
 }
@@ -202,7 +268,7 @@ void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm) {
     llvm::Value *timeout = pop();
     llvm::Value *expectedValue = pop();
     llvm::Value *address = pop();
-    llvm::Value *boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);
+    llvm::Value *boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset, 8);
     trapIfMisalignedAtomic(boundedAddress, imm.alignmentLog2);
     push(emitRuntimeIntrinsic("atomic_wait_i64", FunctionType(TypeTuple{ValueType::i32}, TypeTuple{ValueType::i32, ValueType::i64, ValueType::f64, inferValueType<Uptr>()}), {address, expectedValue, timeout, getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
 }
@@ -211,7 +277,8 @@ void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm) {
     void EmitFunctionContext::valueTypeId##_##name(AtomicLoadOrStoreImm<naturalAlignmentLog2> imm) \
     {                                                                                              \
         auto address = pop();                                                                      \
-        auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
+        auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+            *this, address, imm.offset, U64(1) << naturalAlignmentLog2);                           \
         trapIfMisalignedAtomic(boundedAddress, naturalAlignmentLog2);                              \
         auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
         auto load = irBuilder.CreateLoad(pointer);                                                 \
@@ -225,7 +292,8 @@ void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm) {
     {                                                                                              \
         auto value = pop();                                                                        \
         auto address = pop();                                                                      \
-        auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
+        auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+            *this, address, imm.offset, U64(1) << naturalAlignmentLog2);                           \
         trapIfMisalignedAtomic(boundedAddress, naturalAlignmentLog2);                              \
         auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
         auto memoryValue = valueToMem(value, llvmMemoryType);                                      \
@@ -270,7 +338,8 @@ EMIT_ATOMIC_STORE_OP(i64, atomic_store32, llvmContext.i32Type, 2, trunc)
         auto replacementValue = valueToMem(pop(), llvmMemoryType);                                 \
         auto expectedValue = valueToMem(pop(), llvmMemoryType);                                    \
         auto address = pop();                                                                      \
-        auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
+        auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+            *this, address, imm.offset, U64(1) << alignmentLog2);                                  \
         trapIfMisalignedAtomic(boundedAddress, alignmentLog2);                                     \
         auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
         auto atomicCmpXchg                                                                         \
@@ -304,7 +373,8 @@ EMIT_ATOMIC_CMPXCHG(i64, atomic_rmw_cmpxchg, llvmContext.i64Type, 3, identity, i
     {                                                                                              \
         auto value = valueToMem(pop(), llvmMemoryType);                                            \
         auto address = pop();                                                                      \
-        auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
+        auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+            *this, address, imm.offset, U64(1) << alignmentLog2);                                  \
         trapIfMisalignedAtomic(boundedAddress, alignmentLog2);                                     \
         auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
         auto atomicRMW = irBuilder.CreateAtomicRMW(llvm::AtomicRMWInst::BinOp::rmwOpId,            \
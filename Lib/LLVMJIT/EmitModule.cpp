@@ -4,6 +4,10 @@
 #include "EmitFunctionContext.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
 
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
@@ -50,7 +54,91 @@ static llvm::Constant *createImportedConstant(llvm::Module &llvmModule, llvm::Tw
     return new llvm::GlobalVariable(llvmModule, llvm::Type::getInt8Ty(llvmModule.getContext()), false, llvm::GlobalVariable::ExternalLinkage, nullptr, externalName);
 }
 
-void LLVMJIT::emitModule(const IR::Module &irModule, LLVMContext &llvmContext, llvm::Module &outLLVMModule) {
+// Links an inlinable intrinsic's LLVM IR into the module, and emits a function for calls to the
+// import that calls the linked function if the import is bound to the intrinsic's thunk.
+static llvm::Function *emitInlinableImport(EmitModuleContext &moduleContext, const Import<IndexedFunctionType> &import, llvm::Function *importFunction, const InlinableIntrinsic &intrinsic) {
+    LLVMContext &llvmContext = moduleContext.llvmContext;
+    llvm::Module &llvmModule = *moduleContext.llvmModule;
+
+    FunctionType functionType = moduleContext.irModule.types[import.type.index];
+
+    // Link the intrinsic's IR into the module, unless another import of the same intrinsic already
+    // did. Declare the function first, so only it and the definitions it uses are linked.
+    llvm::Function *intrinsicFunction = llvmModule.getFunction(intrinsic.llvmFunctionName);
+    if (!intrinsicFunction) {
+        llvmModule.getOrInsertFunction(intrinsic.llvmFunctionName, asLLVMType(llvmContext, functionType, CallingConvention::intrinsic));
+
+        llvm::SMDiagnostic diagnostic;
+        std::unique_ptr<llvm::Module> intrinsicModule = llvm::parseIR(llvm::MemoryBufferRef(intrinsic.llvmIR, intrinsic.llvmFunctionName), diagnostic, llvmContext);
+        if (!intrinsicModule) {
+            Errors::fatalf("Failed to parse LLVM IR for %s.%s: %s", import.moduleName.c_str(), import.exportName.c_str(), diagnostic.getMessage().str().c_str());
+        }
+        if (llvm::Linker::linkModules(llvmModule, std::move(intrinsicModule), llvm::Linker::Flags::LinkOnlyNeeded)) {
+            Errors::fatalf("Failed to link LLVM IR for %s.%s", import.moduleName.c_str(), import.exportName.c_str());
+        }
+        intrinsicFunction = llvmModule.getFunction(intrinsic.llvmFunctionName);
+        errorUnless(intrinsicFunction && !intrinsicFunction->isDeclaration());
+
+        // Every function in the compiled object code must be a Runtime::Function, so the linked
+        // function must be inlined into its callers and then removed.
+        intrinsicFunction->setLinkage(llvm::GlobalValue::InternalLinkage);
+        intrinsicFunction->addFnAttr(llvm::Attribute::AlwaysInline);
+    }
+
+    llvm::Function *function = llvm::Function::Create(asLLVMType(llvmContext, functionType, CallingConvention::wasm), llvm::Function::InternalLinkage, importFunction->getName() + "!inlinable", &llvmModule);
+    function->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
+    function->addFnAttr(llvm::Attribute::AlwaysInline);
+
+    EmitContext emitContext(llvmContext, nullptr);
+    emitContext.irBuilder.SetInsertPoint(llvm::BasicBlock::Create(llvmContext, "entry", function));
+    emitContext.initContextVariables(&*function->args().begin());
+
+    llvm::SmallVector<llvm::Value *, 8> args;
+    for (auto argIt = function->args().begin() + 1; argIt != function->args().end(); ++argIt) {
+        args.push_back(&*argIt);
+    }
+
+    // Compare the code address the import is bound to with the code address of the intrinsic's
+    // thunk. Both are resolved when the module is loaded.
+    llvm::Constant *thunkCode = createImportedConstant(llvmModule, getInlinableIntrinsicThunkName(import.moduleName, import.exportName));
+    llvm::Value *isBoundToIntrinsic = emitContext.irBuilder.CreateICmpEQ(llvm::ConstantExpr::getPtrToInt(importFunction, llvmContext.iptrType), llvm::ConstantExpr::getPtrToInt(thunkCode, llvmContext.iptrType));
+
+    llvm::BasicBlock *intrinsicBlock = llvm::BasicBlock::Create(llvmContext, "callIntrinsic", function);
+    llvm::BasicBlock *importBlock = llvm::BasicBlock::Create(llvmContext, "callImport", function);
+    emitContext.irBuilder.CreateCondBr(isBoundToIntrinsic, intrinsicBlock, importBlock, moduleContext.likelyTrueBranchWeights);
+
+    emitContext.irBuilder.SetInsertPoint(intrinsicBlock);
+    emitContext.emitReturn(functionType.results(), emitContext.emitCallOrInvoke(intrinsicFunction, args, functionType, CallingConvention::intrinsic));
+
+    emitContext.irBuilder.SetInsertPoint(importBlock);
+    emitContext.emitReturn(functionType.results(), emitContext.emitCallOrInvoke(importFunction, args, functionType, CallingConvention::wasm));
+
+    return function;
+}
+
+// Returns the value of an immutable global in a specialization as a constant, or null if the global
+// isn't specialized.
+static llvm::Constant *emitSpecializedGlobalValue(LLVMContext &llvmContext, GlobalType globalType, const UntaggedValue &value) {
+    if (globalType.isMutable) {
+        return nullptr;
+    }
+    switch (globalType.valueType) {
+        case ValueType::i32:
+            return emitLiteral(llvmContext, value.i32);
+        case ValueType::i64:
+            return emitLiteral(llvmContext, value.i64);
+        case ValueType::f32:
+            return emitLiteral(llvmContext, value.f32);
+        case ValueType::f64:
+            return emitLiteral(llvmContext, value.f64);
+        case ValueType::v128:
+            return emitLiteral(llvmContext, value.v128);
+        default:
+            return nullptr;
+    };
+}
+
+void LLVMJIT::emitModule(const IR::Module &irModule, const InstanceSpecialization *specialization, LLVMContext &llvmContext, llvm::Module &outLLVMModule) {
     EmitModuleContext moduleContext(irModule, llvmContext, &outLLVMModule);
 
     // Create an external reference to the appropriate exception personality function.
@@ -64,8 +152,13 @@ void LLVMJIT::emitModule(const IR::Module &irModule, LLVMContext &llvmContext, l
 
     // Create LLVM external globals corresponding to offsets to table base pointers in
     // CompartmentRuntimeData for the module's declared table objects.
+    // If the module is specialized for an instance, emit the offsets as literals instead.
     for (Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex) {
-        moduleContext.tableOffsets.push_back(llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, getExternalName("tableOffset", tableIndex)), llvmContext.iptrType));
+        if (specialization) {
+            moduleContext.tableOffsets.push_back(emitLiteral(llvmContext, getTableBaseOffset(specialization->tableIds[tableIndex])));
+        } else {
+            moduleContext.tableOffsets.push_back(llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, getExternalName("tableOffset", tableIndex)), llvmContext.iptrType));
+        }
     }
     if (moduleContext.tableOffsets.size()) {
         moduleContext.defaultTableOffset = moduleContext.tableOffsets[0];
@@ -74,15 +167,22 @@ void LLVMJIT::emitModule(const IR::Module &irModule, LLVMContext &llvmContext, l
     // Create LLVM external globals corresponding to offsets to memory base pointers in
     // CompartmentRuntimeData for the module's declared memory objects.
     for (Uptr memoryIndex = 0; memoryIndex < irModule.memories.size(); ++memoryIndex) {
-        moduleContext.memoryOffsets.push_back(llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, getExternalName("memoryOffset", memoryIndex)), llvmContext.iptrType));
+        if (specialization) {
+            moduleContext.memoryOffsets.push_back(emitLiteral(llvmContext, getMemoryBaseOffset(specialization->memoryIds[memoryIndex])));
+        } else {
+            moduleContext.memoryOffsets.push_back(llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, getExternalName("memoryOffset", memoryIndex)), llvmContext.iptrType));
+        }
     }
     if (moduleContext.memoryOffsets.size()) {
         moduleContext.defaultMemoryOffset = moduleContext.memoryOffsets[0];
     }
 
     // Create LLVM external globals for the module's globals.
+    // If the module is specialized for an instance, also emit the values of its immutable globals
+    // as constants, so LLVM can propagate them.
     for (Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex) {
         moduleContext.globals.push_back(createImportedConstant(outLLVMModule, getExternalName("global", globalIndex)));
+        moduleContext.specializedGlobalValues.push_back(specialization ? emitSpecializedGlobalValue(llvmContext, irModule.globals.getType(globalIndex), specialization->globalValues[globalIndex]) : nullptr);
     }
 
     // Create LLVM external globals corresponding to pointers to ExceptionTypes for the
@@ -100,7 +200,10 @@ void LLVMJIT::emitModule(const IR::Module &irModule, LLVMContext &llvmContext, l
     moduleContext.moduleInstanceId = llvm::ConstantExpr::getSub(biasedModuleInstanceId, emitLiteral(llvmContext, Uptr(1)));
 
     // Create a LLVM external global that will be a bias applied to all references in a table.
-    moduleContext.tableReferenceBias = llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, "tableReferenceBias"), llvmContext.iptrType);
+    moduleContext.tableReferenceBias = specialization ? emitLiteral(llvmContext, specialization->tableReferenceBias) : llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, "tableReferenceBias"), llvmContext.iptrType);
+
+    // Create a LLVM external global that will point to the sentinel stored in null table elements.
+    moduleContext.tableUninitializedElement = specialization ? emitLiteral(llvmContext, specialization->tableUninitializedElement) : llvm::ConstantExpr::getPtrToInt(createImportedConstant(outLLVMModule, "tableUninitializedElement"), llvmContext.iptrType);
 
     moduleContext.userExceptionTypeInfo = llvm::ConstantExpr::getPointerCast(createImportedConstant(outLLVMModule, "userExceptionTypeInfo"), llvmContext.i8PtrType);
 
@@ -118,6 +221,37 @@ void LLVMJIT::emitModule(const IR::Module &irModule, LLVMContext &llvmContext, l
         moduleContext.functions[functionIndex] = function;
     }
 
+    // Find the functions that the module's element segments may write to each table, by type.
+    // Passive segments may be written to any table by table.init.
+    moduleContext.callIndirectTargets.resize(irModule.tables.size());
+    for (const ElemSegment &elemSegment : irModule.elemSegments) {
+        for (Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex) {
+            if (elemSegment.isActive && elemSegment.tableIndex != tableIndex) {
+                continue;
+            }
+
+            HashMap<FunctionType, Uptr> &targets = moduleContext.callIndirectTargets[tableIndex];
+            for (Uptr functionIndex : elemSegment.indices) {
+                const FunctionType functionType = irModule.types[irModule.functions.getType(functionIndex).index];
+                Uptr &target = targets.getOrAdd(functionType, functionIndex);
+                if (target != functionIndex) {
+                    target = UINTPTR_MAX;
+                }
+            }
+        }
+    }
+
+    // Use the LLVM IR of any imported inlinable intrinsics that have the import's type.
+    moduleContext.inlinableImportFunctions.resize(irModule.functions.imports.size(), nullptr);
+    for (Uptr importIndex = 0; importIndex < irModule.functions.imports.size(); ++importIndex) {
+        const Import<IndexedFunctionType> &import = irModule.functions.imports[importIndex];
+        InlinableIntrinsic intrinsic;
+        if (getInlinableIntrinsic(import.moduleName, import.exportName, intrinsic) &&
+            intrinsic.functionType == irModule.types[import.type.index]) {
+            moduleContext.inlinableImportFunctions[importIndex] = emitInlinableImport(moduleContext, import, moduleContext.functions[importIndex], intrinsic);
+        }
+    }
+
     // Compile each function in the module.
     for (Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size(); ++functionDefIndex) {
         const FunctionDef &functionDef = irModule.functions.defs[functionDefIndex];
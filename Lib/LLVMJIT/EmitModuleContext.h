@@ -2,6 +2,7 @@
 
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Module.h"
+#include "WAVM/Inline/HashMap.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/DIBuilder.h"
@@ -17,9 +18,22 @@ namespace WAVM {
             llvm::Module *llvmModule;
             std::vector<llvm::Constant *> typeIds;
             std::vector<llvm::Function *> functions;
+
+            // For each function import, a function that calls an inlinable intrinsic's linked LLVM
+            // IR if the import is bound to the intrinsic, or null if the import isn't inlinable.
+            std::vector<llvm::Function *> inlinableImportFunctions;
             std::vector<llvm::Constant *> tableOffsets;
+
+            // For each table, maps function types to the index of the only function of that type in
+            // the module's element segments that may be written to the table, or UINTPTR_MAX if
+            // there is more than one. call_indirect uses it to predict the callee.
+            std::vector<HashMap<IR::FunctionType, Uptr>> callIndirectTargets;
             std::vector<llvm::Constant *> memoryOffsets;
             std::vector<llvm::Constant *> globals;
+
+            // For each global, its value if the module is specialized for an instance and the
+            // global is immutable and not reference-typed. Otherwise, null.
+            std::vector<llvm::Constant *> specializedGlobalValues;
             std::vector<llvm::Constant *> exceptionTypeIds;
 
             llvm::Constant *defaultMemoryOffset;
@@ -27,6 +41,7 @@ namespace WAVM {
 
             llvm::Constant *moduleInstanceId;
             llvm::Constant *tableReferenceBias;
+            llvm::Constant *tableUninitializedElement;
 
             llvm::Constant *userExceptionTypeInfo;
 
@@ -5,7 +5,7 @@
 #include "EmitWorkarounds.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
-
+#include "llvm/IR/InlineAsm.h"
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
 using namespace WAVM;
@@ -114,13 +114,53 @@ EMIT_CONST(v128, V128)
 // Int operators
 //
 
+bool EmitFunctionContext::shouldUseHardwareDivideTraps(llvm::Value *divisor) {
+#if defined(__x86_64__) || defined(_M_X64)
+    // Constant divisors are left to LLVM: the explicit checks fold away for divisors that can't
+    // trap, and LLVM can strength reduce the division. LLVM also folds a division by a constant
+    // zero or -1 without trapping, so those keep the explicit checks.
+    return moduleContext.irModule.featureSpec.hardwareDivideTraps && !llvm::isa<llvm::Constant>(divisor);
+#else
+    (void) divisor;
+    return false;
+#endif
+}
+
+llvm::Value *EmitFunctionContext::emitHardwareTrappingDivide(llvm::Value *left, llvm::Value *right, bool isSigned, bool isRemainder) {
+    // LLVM's division instructions have undefined behavior for the cases that should trap, so it
+    // may fold or delete them. Use inline assembly for the x86 div/idiv instruction, which raises
+    // a #DE fault for a zero divisor or a signed overflow. The fault is delivered as a
+    // Platform::Signal::Type::intDivideByZeroOrOverflow signal. The assembly is marked as having
+    // side effects so it isn't removed if its result is unused.
+    llvm::Type *type = left->getType();
+    const bool is64Bit = type->getIntegerBitWidth() == 64;
+
+    // The dividend is passed in rdx:rax, so rdx must hold the sign extension of a signed dividend,
+    // or zero for an unsigned dividend.
+    llvm::Value *dividendHigh = isSigned ? irBuilder.CreateAShr(left, llvm::ConstantInt::get(type, is64Bit ? 63 : 31)) : llvm::Constant::getNullValue(type);
+
+    const char *asmString = isSigned ? (is64Bit ? "idivq $4" : "idivl $4") : (is64Bit ? "divq $4" : "divl $4");
+    llvm::StructType *resultType = llvm::StructType::get(llvmContext, {type, type});
+    llvm::FunctionType *asmType = llvm::FunctionType::get(resultType, {type, type, type}, false);
+    llvm::InlineAsm *divideAsm = llvm::InlineAsm::get(asmType, asmString, "={ax},={dx},{ax},{dx},r,~{dirflag},~{fpsr},~{flags}", true);
+
+    // The quotient is returned in rax, and the remainder in rdx.
+    llvm::Value *result = irBuilder.CreateCall(divideAsm, {left, dividendHigh, right});
+    return irBuilder.CreateExtractValue(result, {isRemainder ? U32(1) : U32(0)});
+}
+
 llvm::Value *EmitFunctionContext::emitSRem(ValueType type, llvm::Value *left, llvm::Value *right) {
-    // Trap if the dividend is zero.
-    trapDivideByZero(right);
+    // Trap if the dividend is zero. If the hardware traps on a zero divisor, the check may be
+    // omitted.
+    const bool useHardwareDivideTraps = shouldUseHardwareDivideTraps(right);
+    if (!useHardwareDivideTraps) {
+        trapDivideByZero(right);
+    }
 
     // LLVM's srem has undefined behavior where WebAssembly's rem_s defines that it should not trap
     // if the corresponding division would overflow a signed integer. To avoid this case, we just
-    // branch around the srem if the INT_MAX%-1 case that overflows is detected.
+    // branch around the srem if the INT_MAX%-1 case that overflows is detected. The hardware
+    // remainder instruction traps for this case, so the branch is needed for it too.
     auto preOverflowBlock = irBuilder.GetInsertBlock();
     auto noOverflowBlock = llvm::BasicBlock::Create(llvmContext, "sremNoOverflow", function);
     auto endBlock = llvm::BasicBlock::Create(llvmContext, "sremEnd", function);
@@ -131,7 +171,7 @@ llvm::Value *EmitFunctionContext::emitSRem(ValueType type, llvm::Value *left, ll
     irBuilder.CreateCondBr(noOverflow, noOverflowBlock, endBlock, moduleContext.likelyTrueBranchWeights);
 
     irBuilder.SetInsertPoint(noOverflowBlock);
-    auto noOverflowValue = irBuilder.CreateSRem(left, right);
+    auto noOverflowValue = useHardwareDivideTraps ? emitHardwareTrappingDivide(left, right, true, true) : irBuilder.CreateSRem(left, right);
     irBuilder.CreateBr(endBlock);
 
     irBuilder.SetInsertPoint(endBlock);
@@ -181,14 +221,15 @@ EMIT_INT_BINARY_OP(rotr, emitRotr(*this, left, right))
 
 EMIT_INT_BINARY_OP(rotl, emitRotl(*this, left, right))
 
-// Divides use trapDivideByZero to avoid the undefined behavior in LLVM's division instructions.
-EMIT_INT_BINARY_OP(div_s, (trapDivideByZeroOrIntegerOverflow(type, left, right), irBuilder.CreateSDiv(left, right)))
+// Divides use trapDivideByZero to avoid the undefined behavior in LLVM's division instructions,
+// unless the hardware division instruction can be used to trap.
+EMIT_INT_BINARY_OP(div_s, shouldUseHardwareDivideTraps(right) ? emitHardwareTrappingDivide(left, right, true, false) : (trapDivideByZeroOrIntegerOverflow(type, left, right), irBuilder.CreateSDiv(left, right)))
 
 EMIT_INT_BINARY_OP(rem_s, emitSRem(type, left, right))
 
-EMIT_INT_BINARY_OP(div_u, (trapDivideByZero(right), irBuilder.CreateUDiv(left, right)))
+EMIT_INT_BINARY_OP(div_u, shouldUseHardwareDivideTraps(right) ? emitHardwareTrappingDivide(left, right, false, false) : (trapDivideByZero(right), irBuilder.CreateUDiv(left, right)))
 
-EMIT_INT_BINARY_OP(rem_u, (trapDivideByZero(right), irBuilder.CreateURem(left, right)))
+EMIT_INT_BINARY_OP(rem_u, shouldUseHardwareDivideTraps(right) ? emitHardwareTrappingDivide(left, right, false, true) : (trapDivideByZero(right), irBuilder.CreateURem(left, right)))
 
 // Explicitly mask the shift amount operand to the word size to avoid LLVM's undefined behavior.
 EMIT_INT_BINARY_OP(shl, irBuilder.CreateShl(left, emitShiftCountMask(*this, right)))
@@ -251,24 +292,43 @@ EMIT_FP_COMPARE(gt, llvm::CmpInst::FCMP_OGT)
 
 EMIT_FP_COMPARE(ge, llvm::CmpInst::FCMP_OGE)
 
-// These operations don't match LLVM's semantics exactly, so just call out to C++ implementations.
-EMIT_FP_BINARY_OP(min, emitRuntimeIntrinsic(type ==
-                                            ValueType::f32 ? "f32.min" : "f64.min", FunctionType(TypeTuple(type), TypeTuple{type, type}), {left, right})[0])
+// WebAssembly's min and max return a NaN if either operand is a NaN, and order -0.0 before +0.0,
+// which doesn't match LLVM's minnum/maxnum or x86's minss/maxss. Emit a branchless sequence that
+// selects the lesser or greater operand when they are ordered and unequal, and otherwise combines
+// the bits of the operands: this returns the operand if they are equal, -0.0 for min(-0.0, +0.0),
+// and +0.0 for max(-0.0, +0.0). If either operand is a NaN, adding them produces a quiet NaN.
+static llvm::Value *emitFloatMinOrMax(EmitContext &emitContext, llvm::Value *left, llvm::Value *right, bool isMin) {
+    llvm::IRBuilder<> &irBuilder = emitContext.irBuilder;
+    llvm::Type *floatType = left->getType();
+    llvm::Type *intType = irBuilder.getIntNTy(floatType->getPrimitiveSizeInBits());
+
+    llvm::Value *leftBits = irBuilder.CreateBitCast(left, intType);
+    llvm::Value *rightBits = irBuilder.CreateBitCast(right, intType);
+    llvm::Value *equalResult = irBuilder.CreateBitCast(
+            isMin ? irBuilder.CreateOr(leftBits, rightBits) : irBuilder.CreateAnd(leftBits, rightBits), floatType);
+
+    llvm::Value *leftIsSelected = isMin ? irBuilder.CreateFCmpOLT(left, right) : irBuilder.CreateFCmpOGT(left, right);
+    llvm::Value *rightIsSelected = isMin ? irBuilder.CreateFCmpOLT(right, left) : irBuilder.CreateFCmpOGT(right, left);
+    llvm::Value *orderedResult = irBuilder.CreateSelect(leftIsSelected, left, irBuilder.CreateSelect(rightIsSelected, right, equalResult));
+
+    return irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(left, right), irBuilder.CreateFAdd(left, right), orderedResult);
+}
+
+EMIT_FP_BINARY_OP(min, emitFloatMinOrMax(*this, left, right, true))
 
-EMIT_FP_BINARY_OP(max, emitRuntimeIntrinsic(type ==
-                                            ValueType::f32 ? "f32.max" : "f64.max", FunctionType(TypeTuple(type), TypeTuple{type, type}), {left, right})[0])
+EMIT_FP_BINARY_OP(max, emitFloatMinOrMax(*this, left, right, false))
 
-EMIT_FP_UNARY_OP(ceil, emitRuntimeIntrinsic(
-        type == ValueType::f32 ? "f32.ceil" : "f64.ceil", FunctionType(TypeTuple(type), TypeTuple{type}), {operand})[0])
+// LLVM's rounding intrinsics match WebAssembly's semantics, including returning a quiet NaN for a
+// NaN operand, and are lowered to roundss/roundsd when SSE4.1 is available. nearbyint rounds to
+// the nearest integer with ties to even, since WebAssembly code always runs in the default rounding
+// mode.
+EMIT_FP_UNARY_OP(ceil, callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::ceil, {operand}))
 
-EMIT_FP_UNARY_OP(floor, emitRuntimeIntrinsic(type ==
-                                             ValueType::f32 ? "f32.floor" : "f64.floor", FunctionType(TypeTuple(type), TypeTuple{type}), {operand})[0])
+EMIT_FP_UNARY_OP(floor, callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::floor, {operand}))
 
-EMIT_FP_UNARY_OP(trunc, emitRuntimeIntrinsic(type ==
-                                             ValueType::f32 ? "f32.trunc" : "f64.trunc", FunctionType(TypeTuple(type), TypeTuple{type}), {operand})[0])
+EMIT_FP_UNARY_OP(trunc, callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::trunc, {operand}))
 
-EMIT_FP_UNARY_OP(nearest, emitRuntimeIntrinsic(type ==
-                                               ValueType::f32 ? "f32.nearest" : "f64.nearest", FunctionType(TypeTuple(type), TypeTuple{type}), {operand})[0])
+EMIT_FP_UNARY_OP(nearest, callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::nearbyint, {operand}))
 
 EMIT_SIMD_INT_BINARY_OP(add, irBuilder.CreateAdd(left, right))
 
@@ -292,7 +352,24 @@ EMIT_SIMD_INT_BINARY_OP(shr_s, irBuilder.CreateAShr(left, emitVectorShiftCountMa
 
 EMIT_SIMD_INT_BINARY_OP(shr_u, irBuilder.CreateLShr(left, emitVectorShiftCountMask(irBuilder, vectorType->getScalarType(), vectorType->getVectorNumElements(), right)))
 
-EMIT_SIMD_BINARY_OP(i8x16_mul, llvmContext.i8x16Type, irBuilder.CreateMul(left, right))
+// x86 has no 8-bit vector multiply, and LLVM lowers a v16i8 mul by widening both operands to 16-bit
+// lanes. Since the low byte of a 16-bit product only depends on the low bytes of its operands,
+// multiply the even and odd bytes in place with two pmullw instead: the even bytes are the low
+// bytes of the 16-bit products, and the odd bytes are the high bytes of the products of the odd
+// bytes shifted down with the odd bytes of the right operand.
+static llvm::Value *emitI8x16Mul(EmitContext &emitContext, llvm::Value *left, llvm::Value *right) {
+    llvm::IRBuilder<> &irBuilder = emitContext.irBuilder;
+    LLVMContext &llvmContext = emitContext.llvmContext;
+    auto emitI16x8Splat = [&](U16 value) { return llvm::ConstantVector::getSplat(8, llvm::ConstantInt::get(llvmContext.i16Type, value)); };
+    left = irBuilder.CreateBitCast(left, llvmContext.i16x8Type);
+    right = irBuilder.CreateBitCast(right, llvmContext.i16x8Type);
+
+    llvm::Value *evenProducts = irBuilder.CreateAnd(irBuilder.CreateMul(left, right), emitI16x8Splat(0x00ff));
+    llvm::Value *oddProducts = irBuilder.CreateMul(irBuilder.CreateLShr(left, emitI16x8Splat(8)), irBuilder.CreateAnd(right, emitI16x8Splat(0xff00)));
+    return irBuilder.CreateBitCast(irBuilder.CreateOr(evenProducts, oddProducts), llvmContext.i8x16Type);
+}
+
+EMIT_SIMD_BINARY_OP(i8x16_mul, llvmContext.i8x16Type, emitI8x16Mul(*this, left, right))
 
 EMIT_SIMD_BINARY_OP(i16x8_mul, llvmContext.i16x8Type, irBuilder.CreateMul(left, right))
 
@@ -335,34 +412,31 @@ EMIT_INT_COMPARE(ge_u, llvm::CmpInst::ICMP_UGE)
 
 EMIT_SIMD_INT_UNARY_OP(neg, irBuilder.CreateNeg(operand))
 
-static llvm::Value *emitAddUnsignedSaturated(llvm::IRBuilder<> &irBuilder, llvm::Value *left, llvm::Value *right, llvm::Type *type) {
-    left = irBuilder.CreateBitCast(left, type);
-    right = irBuilder.CreateBitCast(right, type);
-    llvm::Value *add = irBuilder.CreateAdd(left, right);
-    return irBuilder.CreateSelect(irBuilder.CreateICmpUGT(left, add), llvm::Constant::getAllOnesValue(left->getType()), add);
-}
-
-static llvm::Value *emitSubUnsignedSaturated(llvm::IRBuilder<> &irBuilder, llvm::Value *left, llvm::Value *right, llvm::Type *type) {
-    left = irBuilder.CreateBitCast(left, type);
-    right = irBuilder.CreateBitCast(right, type);
-    return irBuilder.CreateSub(irBuilder.CreateSelect(createICmpWithWorkaround(irBuilder, llvm::CmpInst::ICMP_UGT, left, right), left, right), right);
-}
+// The unsigned saturating operations are lowered to paddus/psubus. LLVM 8 replaced the x86
+// intrinsics for them with target-independent saturating intrinsics.
+#if LLVM_VERSION_MAJOR >= 8
+#define UNSIGNED_SATURATED_OP(name, llvmType, genericIntrinsic, x86Intrinsic)                      \
+    EMIT_SIMD_BINARY_OP(name, llvmType, callLLVMIntrinsic({llvmType}, llvm::Intrinsic::genericIntrinsic, {left, right}))
+#else
+#define UNSIGNED_SATURATED_OP(name, llvmType, genericIntrinsic, x86Intrinsic)                      \
+    EMIT_SIMD_BINARY_OP(name, llvmType, callLLVMIntrinsic({}, llvm::Intrinsic::x86Intrinsic, {left, right}))
+#endif
 
 EMIT_SIMD_BINARY_OP(i8x16_add_saturate_s, llvmContext.i8x16Type, callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_padds_b, {left, right}))
 
-EMIT_SIMD_BINARY_OP(i8x16_add_saturate_u, llvmContext.i8x16Type, emitAddUnsignedSaturated(irBuilder, left, right, llvmContext.i8x16Type))
+UNSIGNED_SATURATED_OP(i8x16_add_saturate_u, llvmContext.i8x16Type, uadd_sat, x86_sse2_paddus_b)
 
 EMIT_SIMD_BINARY_OP(i8x16_sub_saturate_s, llvmContext.i8x16Type, callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_psubs_b, {left, right}))
 
-EMIT_SIMD_BINARY_OP(i8x16_sub_saturate_u, llvmContext.i8x16Type, emitSubUnsignedSaturated(irBuilder, left, right, llvmContext.i8x16Type))
+UNSIGNED_SATURATED_OP(i8x16_sub_saturate_u, llvmContext.i8x16Type, usub_sat, x86_sse2_psubus_b)
 
 EMIT_SIMD_BINARY_OP(i16x8_add_saturate_s, llvmContext.i16x8Type, callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_padds_w, {left, right}))
 
-EMIT_SIMD_BINARY_OP(i16x8_add_saturate_u, llvmContext.i16x8Type, emitAddUnsignedSaturated(irBuilder, left, right, llvmContext.i16x8Type))
+UNSIGNED_SATURATED_OP(i16x8_add_saturate_u, llvmContext.i16x8Type, uadd_sat, x86_sse2_paddus_w)
 
 EMIT_SIMD_BINARY_OP(i16x8_sub_saturate_s, llvmContext.i16x8Type, callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_psubs_w, {left, right}))
 
-EMIT_SIMD_BINARY_OP(i16x8_sub_saturate_u, llvmContext.i16x8Type, emitSubUnsignedSaturated(irBuilder, left, right, llvmContext.i16x8Type))
+UNSIGNED_SATURATED_OP(i16x8_sub_saturate_u, llvmContext.i16x8Type, usub_sat, x86_sse2_psubus_w)
 
 llvm::Value *EmitFunctionContext::emitBitSelect(llvm::Value *mask, llvm::Value *trueValue, llvm::Value *falseValue) {
     return irBuilder.CreateOr(irBuilder.CreateAnd(trueValue, mask), irBuilder.CreateAnd(falseValue, irBuilder.CreateNot(mask)));
@@ -27,16 +27,85 @@ void EmitFunctionContext::ref_func(FunctionImm imm) {
     push(anyref);
 }
 
+// Returns a pointer to the biased value of a table element. The caller must check that the index is
+// less than the table's number of elements: only the pages holding the table's elements are
+// committed, and the elements past its end in the last page hold the out-of-bounds sentinel.
+static llvm::Value *emitTableElementPointer(EmitFunctionContext &functionContext, Uptr tableIndex, llvm::Value *index) {
+    LLVMContext &llvmContext = functionContext.llvmContext;
+    llvm::Value *tableBasePointer = functionContext.loadFromUntypedPointer(functionContext.irBuilder.CreateInBoundsGEP(functionContext.getCompartmentAddress(), {functionContext.moduleContext.tableOffsets[tableIndex]}), llvmContext.iptrType->getPointerTo(), sizeof(Uptr));
+    return functionContext.irBuilder.CreateInBoundsGEP(tableBasePointer, {functionContext.zext(index, llvmContext.iptrType)});
+}
+
+// Returns whether an index is within a table's bounds, using the table's number of elements that is
+// stored in the CompartmentRuntimeData next to its base pointer.
+static llvm::Value *emitIsTableIndexInBounds(EmitFunctionContext &functionContext, Uptr tableIndex, llvm::Value *index) {
+    LLVMContext &llvmContext = functionContext.llvmContext;
+    llvm::Constant *tableNumElementsOffset = llvm::ConstantExpr::getAdd(functionContext.moduleContext.tableOffsets[tableIndex], emitLiteral(llvmContext, Uptr(offsetof(WAVM::Runtime::CompartmentRuntimeData, tableNumElements) - offsetof(WAVM::Runtime::CompartmentRuntimeData, tableBases))));
+    llvm::Value *tableNumElements = functionContext.loadFromUntypedPointer(functionContext.irBuilder.CreateInBoundsGEP(functionContext.getCompartmentAddress(), {tableNumElementsOffset}), llvmContext.iptrType, sizeof(Uptr));
+    return functionContext.irBuilder.CreateICmpULT(functionContext.zext(index, llvmContext.iptrType), tableNumElements);
+}
+
 void EmitFunctionContext::table_get(TableImm imm) {
     llvm::Value *index = pop();
-    llvm::Value *result = emitRuntimeIntrinsic("table.get", FunctionType({ValueType::anyref}, TypeTuple({ValueType::i32, inferValueType<Uptr>()})), {index, getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])})[0];
+
+    // Load in-bounds table elements inline, instead of calling the table.get intrinsic. Out-of-bounds
+    // indices are left to the intrinsic.
+    auto inBoundsBlock = llvm::BasicBlock::Create(llvmContext, "tableGetInBounds", function);
+    auto outOfBoundsBlock = llvm::BasicBlock::Create(llvmContext, "tableGetOutOfBounds", function);
+    auto endBlock = llvm::BasicBlock::Create(llvmContext, "tableGetEnd", function);
+    irBuilder.CreateCondBr(emitIsTableIndexInBounds(*this, imm.tableIndex, index), inBoundsBlock, outOfBoundsBlock, moduleContext.likelyTrueBranchWeights);
+
+    irBuilder.SetInsertPoint(inBoundsBlock);
+    llvm::LoadInst *biasedValueLoad = irBuilder.CreateLoad(emitTableElementPointer(*this, imm.tableIndex, index));
+    biasedValueLoad->setAtomic(llvm::AtomicOrdering::Acquire);
+    biasedValueLoad->setAlignment(sizeof(Uptr));
+    llvm::Value *object = irBuilder.CreateAdd(biasedValueLoad, moduleContext.tableReferenceBias);
+
+    // Null elements hold the uninitialized sentinel, so translate it to null.
+    llvm::Value *isNull = irBuilder.CreateICmpEQ(object, moduleContext.tableUninitializedElement);
+    object = irBuilder.CreateSelect(isNull, llvm::Constant::getNullValue(llvmContext.iptrType), object);
+    llvm::Value *inBoundsResult = irBuilder.CreateIntToPtr(object, llvmContext.anyrefType);
+    llvm::BasicBlock *inBoundsEndBlock = irBuilder.GetInsertBlock();
+    irBuilder.CreateBr(endBlock);
+
+    irBuilder.SetInsertPoint(outOfBoundsBlock);
+    llvm::Value *outOfBoundsResult = emitRuntimeIntrinsic("table.get", FunctionType({ValueType::anyref}, TypeTuple({ValueType::i32, inferValueType<Uptr>()})), {index, getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])})[0];
+    llvm::BasicBlock *outOfBoundsEndBlock = irBuilder.GetInsertBlock();
+    irBuilder.CreateBr(endBlock);
+
+    irBuilder.SetInsertPoint(endBlock);
+    llvm::PHINode *result = irBuilder.CreatePHI(llvmContext.anyrefType, 2);
+    result->addIncoming(inBoundsResult, inBoundsEndBlock);
+    result->addIncoming(outOfBoundsResult, outOfBoundsEndBlock);
     push(result);
 }
 
 void EmitFunctionContext::table_set(TableImm imm) {
     llvm::Value *value = pop();
     llvm::Value *index = pop();
+
+    // Storing a non-null reference must go through the table.set intrinsic for the GC write
+    // barrier, but a null reference doesn't need the barrier, so store it inline if the index is
+    // in bounds. Out-of-bounds indices are left to the intrinsic.
+    auto storeNullBlock = llvm::BasicBlock::Create(llvmContext, "tableSetNull", function);
+    auto storeIntrinsicBlock = llvm::BasicBlock::Create(llvmContext, "tableSetIntrinsic", function);
+    auto endBlock = llvm::BasicBlock::Create(llvmContext, "tableSetEnd", function);
+    llvm::Value *isNull = irBuilder.CreateICmpEQ(value, llvm::Constant::getNullValue(llvmContext.anyrefType));
+    llvm::Value *isInBounds = emitIsTableIndexInBounds(*this, imm.tableIndex, index);
+    irBuilder.CreateCondBr(irBuilder.CreateAnd(isNull, isInBounds), storeNullBlock, storeIntrinsicBlock);
+
+    irBuilder.SetInsertPoint(storeNullBlock);
+    llvm::Value *biasedUninitializedElement = irBuilder.CreateSub(moduleContext.tableUninitializedElement, moduleContext.tableReferenceBias);
+    llvm::StoreInst *biasedValueStore = irBuilder.CreateStore(biasedUninitializedElement, emitTableElementPointer(*this, imm.tableIndex, index));
+    biasedValueStore->setAtomic(llvm::AtomicOrdering::Release);
+    biasedValueStore->setAlignment(sizeof(Uptr));
+    irBuilder.CreateBr(endBlock);
+
+    irBuilder.SetInsertPoint(storeIntrinsicBlock);
     emitRuntimeIntrinsic("table.set", FunctionType({}, TypeTuple({ValueType::i32, ValueType::anyref, inferValueType<Uptr>()})), {index, value, getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])});
+    irBuilder.CreateBr(endBlock);
+
+    irBuilder.SetInsertPoint(endBlock);
 }
 
 void EmitFunctionContext::table_init(ElemSegmentAndTableImm imm) {
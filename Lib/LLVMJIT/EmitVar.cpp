@@ -75,6 +75,11 @@ void EmitFunctionContext::get_global(GetOrSetVariableImm<true> imm) {
             };
         }
 
+        // If the module is specialized for an instance, emit the global's value in the instance.
+        if (!value) {
+            value = moduleContext.specializedGlobalValues[imm.variableIndex];
+        }
+
         if (!value) {
             // Otherwise, the symbol's value will point to the global's immutable value.
             value = loadFromUntypedPointer(moduleContext.globals[imm.variableIndex], llvmValueType, getTypeByteWidth(globalType.valueType));
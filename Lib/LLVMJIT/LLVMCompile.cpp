@@ -10,6 +10,8 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/Scalar.h"
 
 #if LLVM_VERSION_MAJOR >= 7
@@ -83,6 +85,15 @@ private:
 };
 
 static void optimizeLLVMModule(llvm::Module &llvmModule, bool shouldLogMetrics) {
+    // Inline the functions that must be inlined (e.g. the LLVM IR of inlinable intrinsics), and
+    // remove them once they are no longer used.
+    {
+        llvm::legacy::PassManager modulePassManager;
+        modulePassManager.add(llvm::createAlwaysInlinerLegacyPass());
+        modulePassManager.add(llvm::createGlobalDCEPass());
+        modulePassManager.run(llvmModule);
+    }
+
     llvm::legacy::FunctionPassManager fpm(&llvmModule);
     fpm.add(llvm::createPromoteMemoryToRegisterPass());
     fpm.add(llvm::createInstructionNamerPass());
@@ -102,7 +113,18 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext &llvmContext, llvm::Modul
     // Without it, our symbols can't be found in the JITed object file.
     targetTriple += "-elf";
 #endif
-    std::unique_ptr<llvm::TargetMachine> targetMachine(llvm::EngineBuilder().selectTarget(llvm::Triple(targetTriple), "", llvm::sys::getHostCPUName(), llvm::SmallVector<std::string, 0>{LLVM_TARGET_ATTRIBUTES}));
+    // Guarantee that tail calls with the wasm calling convention are lowered as tail calls, so
+    // return_call and return_call_indirect don't grow the stack. This changes the calling convention
+    // to have callees pop their stack arguments, so all code that uses it must be compiled with it.
+    // It can't be enabled only for modules that use return calls: a module may call functions of
+    // any other module, and the two must agree on who pops the stack arguments. Every function that
+    // uses the wasm calling convention is compiled here, including the invoke and intrinsic thunks,
+    // native code only calls into wasm code through the invoke thunks, and intrinsics use the C
+    // calling convention. TailCallBenchmark checks calls with stack arguments across these paths.
+    llvm::TargetOptions targetOptions;
+    targetOptions.GuaranteedTailCallOpt = true;
+
+    std::unique_ptr<llvm::TargetMachine> targetMachine(llvm::EngineBuilder().setTargetOptions(targetOptions).selectTarget(llvm::Triple(targetTriple), "", llvm::sys::getHostCPUName(), llvm::SmallVector<std::string, 0>{LLVM_TARGET_ATTRIBUTES}));
 
     // Get a target machine object for this host, and set the module to use its data layout.
     llvmModule.setDataLayout(targetMachine->createDataLayout());
@@ -123,12 +145,12 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext &llvmContext, llvm::Modul
     return objectBytes;
 }
 
-std::vector<U8> LLVMJIT::compileModule(const IR::Module &irModule) {
+std::vector<U8> LLVMJIT::compileModule(const IR::Module &irModule, const InstanceSpecialization *specialization) {
     LLVMContext llvmContext;
 
     // Emit LLVM IR for the module.
     llvm::Module llvmModule("", llvmContext);
-    emitModule(irModule, llvmContext, llvmModule);
+    emitModule(irModule, specialization, llvmContext, llvmModule);
 
     // Compile the LLVM IR to object code.
     return compileLLVMModule(llvmContext, std::move(llvmModule), true);
@@ -42,6 +42,12 @@ static HashMap<std::string, const char *> runtimeSymbolMap = {
 };
 
 llvm::JITEvaluatedSymbol LLVMJIT::resolveJITImport(llvm::StringRef name) {
+    // Bind references to the thunks of inlinable intrinsics.
+    Uptr inlinableIntrinsicThunkAddress = 0;
+    if (resolveInlinableIntrinsicThunk(name, inlinableIntrinsicThunkAddress)) {
+        return llvm::JITEvaluatedSymbol(inlinableIntrinsicThunkAddress, llvm::JITSymbolFlags::None);
+    }
+
     // Allow some intrinsics used by LLVM
     const char *const *runtimeSymbolName = runtimeSymbolMap.get(name.str());
     if (!runtimeSymbolName) {
@@ -261,12 +261,43 @@ namespace WAVM {
             return std::string(baseName) + std::to_string(index);
         }
 
-        // Emits LLVM IR for a module.
-        void emitModule(const IR::Module &irModule, LLVMContext &llvmContext, llvm::Module &outLLVMModule);
+        // Emits LLVM IR for a module. If a specialization is provided, the values it specifies are
+        // emitted as constants instead of imported symbols.
+        void emitModule(const IR::Module &irModule, const InstanceSpecialization *specialization, LLVMContext &llvmContext, llvm::Module &outLLVMModule);
+
+        // The offsets into CompartmentRuntimeData of the base pointers of a table and a memory.
+        inline Uptr getTableBaseOffset(Uptr tableId) {
+            return offsetof(Runtime::CompartmentRuntimeData, tableBases) + sizeof(void *) * tableId;
+        }
+
+        inline Uptr getMemoryBaseOffset(Uptr memoryId) {
+            return offsetof(Runtime::CompartmentRuntimeData, memoryBases) + sizeof(void *) * memoryId;
+        }
 
         // Used to override LLVM's default behavior of looking up unresolved symbols in DLL exports.
         llvm::JITEvaluatedSymbol resolveJITImport(llvm::StringRef name);
 
+        // An intrinsic function provided as LLVM IR by addInlinableIntrinsic.
+        struct InlinableIntrinsic {
+            void *nativeFunction;
+            IR::FunctionType functionType;
+            std::string llvmIR;
+            std::string llvmFunctionName;
+        };
+
+        // Returns the symbol that is bound to the code address of an inlinable intrinsic's thunk.
+        inline std::string getInlinableIntrinsicThunkName(const std::string &moduleName, const std::string &exportName) {
+            return "inlinableIntrinsicThunk!" + moduleName + '!' + exportName;
+        }
+
+        // Looks up the inlinable intrinsic for an import. Returns false if there isn't one.
+        bool getInlinableIntrinsic(const std::string &moduleName, const std::string &exportName, InlinableIntrinsic &outIntrinsic);
+
+        // If a symbol is the thunk symbol of an inlinable intrinsic, sets outAddress to the code
+        // address of the intrinsic's thunk and returns true. If the thunk hasn't been generated, no
+        // import can be bound to it, so outAddress is set to an address that no function has.
+        bool resolveInlinableIntrinsicThunk(llvm::StringRef name, Uptr &outAddress);
+
         struct ModuleMemoryManager;
 
         // Encapsulates a loaded module.
@@ -274,15 +305,15 @@ namespace WAVM {
             std::map<Uptr, Runtime::Function *> addressToFunctionMap;
             HashMap<std::string, Runtime::Function *> nameToFunctionMap;
 
-            Module(const std::vector<U8> &inObjectBytes, const HashMap<std::string, Uptr> &importedSymbolMap, bool shouldLogMetrics);
+            Module(std::vector<U8> &&inObjectBytes, const HashMap<std::string, Uptr> &importedSymbolMap, bool shouldLogMetrics);
 
             ~Module();
 
         private:
             ModuleMemoryManager *memoryManager;
 
-            // Have to keep copies of these around because GDB registration listener uses their pointers
-            // as keys for deregistration.
+            // Have to keep these around because GDB registration listener uses their pointers as keys
+            // for deregistration, so each loaded module needs its own copy of the object bytes.
             std::vector<U8> objectBytes;
             std::unique_ptr<llvm::object::ObjectFile> object;
         };
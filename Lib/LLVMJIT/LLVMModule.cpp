@@ -212,8 +212,8 @@ static void disassembleFunction(U8 *bytes, Uptr numBytes) {
     LLVMDisasmDispose(disasmRef);
 }
 
-Module::Module(const std::vector<U8> &inObjectBytes, const HashMap<std::string, Uptr> &importedSymbolMap, bool shouldLogMetrics)
-        : memoryManager(new ModuleMemoryManager()), objectBytes(inObjectBytes) {
+Module::Module(std::vector<U8> &&inObjectBytes, const HashMap<std::string, Uptr> &importedSymbolMap, bool shouldLogMetrics)
+        : memoryManager(new ModuleMemoryManager()), objectBytes(std::move(inObjectBytes)) {
 
     object = cantFail(llvm::object::ObjectFile::createObjectFile(llvm::MemoryBufferRef(llvm::StringRef((const char *) objectBytes.data(), objectBytes.size()), "memory")));
 
@@ -425,7 +425,7 @@ Module::~Module() {
     delete memoryManager;
 }
 
-std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(const std::vector<U8> &objectFileBytes, HashMap<std::string, FunctionBinding> &&wavmIntrinsicsExportMap, std::vector<IR::FunctionType> &&types, std::vector<FunctionBinding> &&functionImports, std::vector<TableBinding> &&tables, std::vector<MemoryBinding> &&memories, std::vector<GlobalBinding> &&globals, std::vector<ExceptionTypeBinding> &&exceptionTypes, ModuleInstanceBinding moduleInstance, Uptr tableReferenceBias, const std::vector<Runtime::FunctionMutableData *> &functionDefMutableDatas) {
+std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(const std::vector<U8> &objectFileBytes, const HashMap<std::string, FunctionBinding> &wavmIntrinsicsExportMap, const std::vector<IR::FunctionType> &types, std::vector<FunctionBinding> &&functionImports, std::vector<TableBinding> &&tables, std::vector<MemoryBinding> &&memories, std::vector<GlobalBinding> &&globals, std::vector<ExceptionTypeBinding> &&exceptionTypes, ModuleInstanceBinding moduleInstance, Uptr tableReferenceBias, Uptr tableUninitializedElement, const std::vector<Runtime::FunctionMutableData *> &functionDefMutableDatas) {
     // Bind undefined symbols in the compiled object to values.
     HashMap<std::string, Uptr> importedSymbolMap;
 
@@ -449,17 +449,13 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(const std::vector<U8> &obje
     // Bind the table symbols. The compiled module uses the symbol's value as an offset into
     // CompartmentRuntimeData to the table's entry in CompartmentRuntimeData::tableBases.
     for (Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex) {
-        importedSymbolMap.addOrFail(getExternalName("tableOffset", tableIndex),
-                                    offsetof(Runtime::CompartmentRuntimeData, tableBases) +
-                                    sizeof(void *) * tables[tableIndex].id);
+        importedSymbolMap.addOrFail(getExternalName("tableOffset", tableIndex), getTableBaseOffset(tables[tableIndex].id));
     }
 
     // Bind the memory symbols. The compiled module uses the symbol's value as an offset into
     // CompartmentRuntimeData to the memory's entry in CompartmentRuntimeData::memoryBases.
     for (Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex) {
-        importedSymbolMap.addOrFail(getExternalName("memoryOffset", memoryIndex),
-                                    offsetof(Runtime::CompartmentRuntimeData, memoryBases) +
-                                    sizeof(void *) * memories[memoryIndex].id);
+        importedSymbolMap.addOrFail(getExternalName("memoryOffset", memoryIndex), getMemoryBaseOffset(memories[memoryIndex].id));
     }
 
     // Bind the globals symbols.
@@ -498,8 +494,13 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(const std::vector<U8> &obje
     // Bind the tableReferenceBias symbol to the tableReferenceBias.
     importedSymbolMap.addOrFail("tableReferenceBias", tableReferenceBias);
 
+    // Bind the tableUninitializedElement symbol to the sentinel stored in null table elements.
+    importedSymbolMap.addOrFail("tableUninitializedElement", tableUninitializedElement);
+
     // Load the module.
-    return std::make_shared<Module>(objectFileBytes, importedSymbolMap, true);
+    // The object bytes are shared by every instance of the runtime module, so the loaded module
+    // takes its own copy.
+    return std::make_shared<Module>(std::vector<U8>(objectFileBytes), importedSymbolMap, true);
 }
 
 Runtime::Function *LLVMJIT::getFunctionByAddress(Uptr address) {
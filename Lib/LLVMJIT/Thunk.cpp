@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "EmitContext.h"
+#include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Platform/Mutex.h"
 
@@ -28,6 +29,18 @@ static HashMap<FunctionType, Runtime::Function *> invokeThunkTypeToFunctionMap;
 static Platform::Mutex intrinsicThunkMutex;
 static HashMap<void *, Runtime::Function *> intrinsicFunctionToThunkFunctionMap;
 
+// A map from the thunk symbols of inlinable intrinsics to their LLVM IR. It is allocated on first
+// use, so intrinsics may be added by static initializers in other libraries.
+static Platform::Mutex &getInlinableIntrinsicsMutex() {
+    static Platform::Mutex mutex;
+    return mutex;
+}
+
+static HashMap<std::string, InlinableIntrinsic> &getInlinableIntrinsicMap() {
+    static HashMap<std::string, InlinableIntrinsic> map;
+    return map;
+}
+
 InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType) {
     Lock<Platform::Mutex> invokeThunkLock(invokeThunkMutex);
 
@@ -98,7 +111,7 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType) {
     std::vector<U8> objectBytes = compileLLVMModule(llvmContext, std::move(llvmModule), false);
 
     // Load the object code.
-    auto jitModule = new LLVMJIT::Module(objectBytes, {}, false);
+    auto jitModule = new LLVMJIT::Module(std::move(objectBytes), {}, false);
 
 #if(defined(_WIN32) && !defined(_WIN64))
     const char* thunkFunctionName = "_thunk";
@@ -110,30 +123,20 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType) {
 }
 
 Runtime::Function *LLVMJIT::getIntrinsicThunk(void *nativeFunction, FunctionType functionType, CallingConvention callingConvention, const char *debugName) {
-    Lock<Platform::Mutex> intrinsicThunkLock(intrinsicThunkMutex);
-
-    wavmAssert(callingConvention == CallingConvention::intrinsic ||
-               callingConvention == CallingConvention::intrinsicWithContextSwitch);
-
-    LLVMContext llvmContext;
-
-    // Reuse cached intrinsic thunks for the same function type.
-    Runtime::Function *&intrinsicThunkFunction = intrinsicFunctionToThunkFunctionMap.getOrAdd(nativeFunction, nullptr);
-    if (intrinsicThunkFunction) {
-        return intrinsicThunkFunction;
-    }
+    return getIntrinsicThunks({{nativeFunction, functionType, callingConvention, debugName}})[0];
+}
 
+// Emits a function with the same signature as the native function, but with the WASM calling
+// convention, that calls the native function.
+static void emitIntrinsicThunk(LLVMContext &llvmContext, llvm::Module &llvmModule, const IntrinsicThunkSpec &spec, const std::string &thunkName) {
     // Create a FunctionMutableData object for the thunk.
     FunctionMutableData *functionMutableData = new FunctionMutableData(
-            std::string("thnk!WASM to C thunk!(") + debugName + ')');
+            std::string("thnk!WASM to C thunk!(") + spec.debugName + ')');
 
-    // Create a LLVM module containing a single function with the same signature as the native
-    // function, but with the WASM calling convention.
-    llvm::Module llvmModule("", llvmContext);
-    auto llvmFunctionType = asLLVMType(llvmContext, functionType, CallingConvention::wasm);
-    auto function = llvm::Function::Create(llvmFunctionType, llvm::Function::ExternalLinkage, "thunk", &llvmModule);
-    function->setCallingConv(asLLVMCallingConv(callingConvention));
-    setRuntimeFunctionPrefix(llvmContext, function, emitLiteralPointer(functionMutableData, llvmContext.iptrType), emitLiteral(llvmContext, Uptr(UINTPTR_MAX)), emitLiteral(llvmContext, functionType.getEncoding().impl));
+    auto llvmFunctionType = asLLVMType(llvmContext, spec.functionType, CallingConvention::wasm);
+    auto function = llvm::Function::Create(llvmFunctionType, llvm::Function::ExternalLinkage, thunkName, &llvmModule);
+    function->setCallingConv(asLLVMCallingConv(spec.callingConvention));
+    setRuntimeFunctionPrefix(llvmContext, function, emitLiteralPointer(functionMutableData, llvmContext.iptrType), emitLiteral(llvmContext, Uptr(UINTPTR_MAX)), emitLiteral(llvmContext, spec.functionType.getEncoding().impl));
 
     EmitContext emitContext(llvmContext, nullptr);
     emitContext.irBuilder.SetInsertPoint(llvm::BasicBlock::Create(llvmContext, "entry", function));
@@ -145,24 +148,111 @@ Runtime::Function *LLVMJIT::getIntrinsicThunk(void *nativeFunction, FunctionType
         args.push_back(&*argIt);
     }
 
-    llvm::Type *llvmNativeFunctionType = asLLVMType(llvmContext, functionType, callingConvention)->getPointerTo();
-    llvm::Value *llvmNativeFunction = emitLiteralPointer(nativeFunction, llvmNativeFunctionType);
-    ValueVector results = emitContext.emitCallOrInvoke(llvmNativeFunction, args, functionType, callingConvention);
+    llvm::Type *llvmNativeFunctionType = asLLVMType(llvmContext, spec.functionType, spec.callingConvention)->getPointerTo();
+    llvm::Value *llvmNativeFunction = emitLiteralPointer(spec.nativeFunction, llvmNativeFunctionType);
+    ValueVector results = emitContext.emitCallOrInvoke(llvmNativeFunction, args, spec.functionType, spec.callingConvention);
 
     // Emit the function return.
-    emitContext.emitReturn(functionType.results(), results);
+    emitContext.emitReturn(spec.functionType.results(), results);
+}
 
-    // Compile the LLVM IR to object code.
-    std::vector<U8> objectBytes = compileLLVMModule(llvmContext, std::move(llvmModule), false);
+std::vector<Runtime::Function *> LLVMJIT::getIntrinsicThunks(const std::vector<IntrinsicThunkSpec> &specs) {
+    Lock<Platform::Mutex> intrinsicThunkLock(intrinsicThunkMutex);
 
-    // Load the object code.
-    auto jitModule = new LLVMJIT::Module(objectBytes, {}, false);
+    // Reuse cached intrinsic thunks for the same native function, and find the native functions
+    // that don't have a thunk yet.
+    std::vector<Runtime::Function *> thunkFunctions(specs.size(), nullptr);
+    std::vector<Uptr> uncachedSpecIndices;
+    HashSet<void *> uncachedNativeFunctions;
+    for (Uptr specIndex = 0; specIndex < specs.size(); ++specIndex) {
+        const IntrinsicThunkSpec &spec = specs[specIndex];
+        wavmAssert(spec.callingConvention == CallingConvention::intrinsic ||
+                   spec.callingConvention == CallingConvention::intrinsicWithContextSwitch);
+
+        Runtime::Function *const *cachedThunkFunction = intrinsicFunctionToThunkFunctionMap.get(spec.nativeFunction);
+        if (cachedThunkFunction) {
+            thunkFunctions[specIndex] = *cachedThunkFunction;
+        } else if (uncachedNativeFunctions.add(spec.nativeFunction)) {
+            uncachedSpecIndices.push_back(specIndex);
+        }
+    }
+
+    if (uncachedSpecIndices.size()) {
+        // Create a LLVM module containing a thunk for each native function that doesn't have one,
+        // so they are all compiled and loaded together.
+        LLVMContext llvmContext;
+        llvm::Module llvmModule("", llvmContext);
+        for (Uptr thunkIndex = 0; thunkIndex < uncachedSpecIndices.size(); ++thunkIndex) {
+            emitIntrinsicThunk(llvmContext, llvmModule, specs[uncachedSpecIndices[thunkIndex]], "thunk" + std::to_string(thunkIndex));
+        }
 
+        // Compile the LLVM IR to object code.
+        std::vector<U8> objectBytes = compileLLVMModule(llvmContext, std::move(llvmModule), false);
+
+        // Load the object code.
+        auto jitModule = new LLVMJIT::Module(std::move(objectBytes), {}, false);
+
+        for (Uptr thunkIndex = 0; thunkIndex < uncachedSpecIndices.size(); ++thunkIndex) {
 #if(defined(_WIN32) && !defined(_WIN64))
-    const char* thunkFunctionName = "_thunk";
+            const std::string thunkFunctionName = "_thunk" + std::to_string(thunkIndex);
 #else
-    const char *thunkFunctionName = "thunk";
+            const std::string thunkFunctionName = "thunk" + std::to_string(thunkIndex);
 #endif
-    intrinsicThunkFunction = jitModule->nameToFunctionMap[thunkFunctionName];
-    return intrinsicThunkFunction;
+            Runtime::Function *thunkFunction = jitModule->nameToFunctionMap[thunkFunctionName];
+            intrinsicFunctionToThunkFunctionMap.addOrFail(specs[uncachedSpecIndices[thunkIndex]].nativeFunction, thunkFunction);
+        }
+    }
+
+    // Fill in the thunks for the specs that weren't found in the cache above.
+    for (Uptr specIndex = 0; specIndex < specs.size(); ++specIndex) {
+        if (!thunkFunctions[specIndex]) {
+            thunkFunctions[specIndex] = intrinsicFunctionToThunkFunctionMap[specs[specIndex].nativeFunction];
+        }
+    }
+
+    return thunkFunctions;
+}
+
+void LLVMJIT::addInlinableIntrinsic(const char *moduleName, const char *exportName, void *nativeFunction, FunctionType functionType, const char *llvmIR, Uptr numLLVMIRBytes, const char *llvmFunctionName) {
+    Lock<Platform::Mutex> inlinableIntrinsicsLock(getInlinableIntrinsicsMutex());
+    getInlinableIntrinsicMap().set(getInlinableIntrinsicThunkName(moduleName, exportName),
+                                   InlinableIntrinsic{nativeFunction, functionType, std::string(llvmIR, numLLVMIRBytes), llvmFunctionName});
+}
+
+bool LLVMJIT::getInlinableIntrinsic(const std::string &moduleName, const std::string &exportName, InlinableIntrinsic &outIntrinsic) {
+    Lock<Platform::Mutex> inlinableIntrinsicsLock(getInlinableIntrinsicsMutex());
+    const InlinableIntrinsic *intrinsic = getInlinableIntrinsicMap().get(getInlinableIntrinsicThunkName(moduleName, exportName));
+    if (!intrinsic) {
+        return false;
+    }
+    outIntrinsic = *intrinsic;
+    return true;
+}
+
+bool LLVMJIT::resolveInlinableIntrinsicThunk(llvm::StringRef name, Uptr &outAddress) {
+    if (!name.startswith("inlinableIntrinsicThunk!")) {
+        return false;
+    }
+
+    void *nativeFunction = nullptr;
+    {
+        Lock<Platform::Mutex> inlinableIntrinsicsLock(getInlinableIntrinsicsMutex());
+        const InlinableIntrinsic *intrinsic = getInlinableIntrinsicMap().get(name.str());
+        if (intrinsic) {
+            nativeFunction = intrinsic->nativeFunction;
+        }
+    }
+
+    // If the intrinsic isn't known to this process, or its thunk hasn't been generated, bind the
+    // symbol to an address that is never a function's code address, so the compiled module always
+    // calls the import. LLVM treats zero as an unresolved symbol, so use 1.
+    outAddress = 1;
+    if (nativeFunction) {
+        Lock<Platform::Mutex> intrinsicThunkLock(intrinsicThunkMutex);
+        Runtime::Function *const *thunkFunction = intrinsicFunctionToThunkFunctionMap.get(nativeFunction);
+        if (thunkFunction) {
+            outAddress = reinterpret_cast<Uptr>((*thunkFunction)->code);
+        }
+    }
+    return true;
 }
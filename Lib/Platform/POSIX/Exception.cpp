@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "POSIXPrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Platform/Exception.h"
+
+using namespace WAVM;
+using namespace WAVM::Platform;
+
+typedef std::function<bool(Signal, const CallStack &)> SignalFilter;
+
+// The innermost catchSignals call on this thread: the filter to call for a signal, and the
+// environment to jump back to if it catches the signal.
+static thread_local sigjmp_buf signalReturnEnv;
+static thread_local const SignalFilter *signalCatcherFilter = nullptr;
+
+static struct sigaction previousSIGFPEAction;
+
+static void signalHandler(int signalNumber, siginfo_t *signalInfo, void *context) {
+    Signal signal;
+    if (signalNumber == SIGFPE && (signalInfo->si_code == FPE_INTDIV || signalInfo->si_code == FPE_INTOVF)) {
+        signal.type = Signal::Type::intDivideByZeroOrOverflow;
+    }
+
+    if (signal.type != Signal::Type::invalid && signalCatcherFilter) {
+        CallStack callStack;
+        // Record the faulting instruction, so the filter can tell where the signal was raised.
+#if defined(__linux__) && defined(__x86_64__)
+        callStack.stackFrames.push_back({Uptr(static_cast<ucontext_t *>(context)->uc_mcontext.gregs[REG_RIP])});
+#elif defined(__linux__) && defined(__aarch64__)
+        callStack.stackFrames.push_back({Uptr(static_cast<ucontext_t *>(context)->uc_mcontext.pc)});
+#elif defined(__APPLE__) && defined(__x86_64__)
+        callStack.stackFrames.push_back({Uptr(static_cast<ucontext_t *>(context)->uc_mcontext->__ss.__rip)});
+#endif
+        if ((*signalCatcherFilter)(signal, callStack)) {
+            siglongjmp(signalReturnEnv, 1);
+        }
+    }
+
+    // The signal wasn't caught, so pass it on to the previous handler. If there wasn't one, restore
+    // the default action, and let the faulting instruction fault again.
+    if (previousSIGFPEAction.sa_flags & SA_SIGINFO) {
+        previousSIGFPEAction.sa_sigaction(signalNumber, signalInfo, context);
+    } else if (previousSIGFPEAction.sa_handler == SIG_DFL || previousSIGFPEAction.sa_handler == SIG_IGN) {
+        sigaction(signalNumber, &previousSIGFPEAction, nullptr);
+    } else {
+        previousSIGFPEAction.sa_handler(signalNumber);
+    }
+}
+
+static bool installSignalHandlers() {
+    struct sigaction signalAction;
+    memset(&signalAction, 0, sizeof(signalAction));
+    signalAction.sa_sigaction = signalHandler;
+    signalAction.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+    sigemptyset(&signalAction.sa_mask);
+    if (sigaction(SIGFPE, &signalAction, &previousSIGFPEAction)) {
+        Errors::fatalf("sigaction failed! errno=%s", strerror(errno));
+    }
+    return true;
+}
+
+bool Platform::catchSignals(const std::function<void()> &thunk, const SignalFilter &filter) {
+    static bool installedSignalHandlers = installSignalHandlers();
+    wavmAssert(installedSignalHandlers);
+
+    // Save the outer catcher, so catchSignals may be nested.
+    sigjmp_buf outerSignalReturnEnv;
+    memcpy(&outerSignalReturnEnv, &signalReturnEnv, sizeof(sigjmp_buf));
+    const SignalFilter *outerSignalCatcherFilter = signalCatcherFilter;
+    auto restoreOuterCatcher = [&]() {
+        memcpy(&signalReturnEnv, &outerSignalReturnEnv, sizeof(sigjmp_buf));
+        signalCatcherFilter = outerSignalCatcherFilter;
+    };
+
+    signalCatcherFilter = &filter;
+    const bool isReturningFromSignalHandler = sigsetjmp(signalReturnEnv, 1) != 0;
+    if (!isReturningFromSignalHandler) {
+        try {
+            thunk();
+        } catch (...) {
+            restoreOuterCatcher();
+            throw;
+        }
+    }
+
+    restoreOuterCatcher();
+    return isReturningFromSignalHandler;
+}
+
+void Platform::raiseSignal(Signal signal) {
+    if (signalCatcherFilter) {
+        CallStack callStack;
+        callStack.stackFrames.push_back({Uptr(__builtin_return_address(0))});
+        if ((*signalCatcherFilter)(signal, callStack)) {
+            siglongjmp(signalReturnEnv, 1);
+        }
+    }
+    Errors::fatalf("Unhandled signal raised: type=%u", U32(signal.type));
+}
@@ -0,0 +1,204 @@
+#include <cpuid.h>
+#include <immintrin.h>
+#include <string.h>
+
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Platform/Intrinsic.h"
+
+using namespace WAVM;
+using namespace WAVM::Platform;
+
+// Copies and sets of at least this many bytes use non-temporal stores that bypass the caches: the
+// destination would evict most of the caches' contents anyway.
+static constexpr Uptr minNonTemporalBytes = Uptr(4) * 1024 * 1024;
+
+// With enhanced rep movsb/stosb, the string instructions are faster than a vector loop for copies
+// and sets of at least this many bytes. With fast short rep movsb, they are also faster for copies
+// and sets of less than maxShortStringInstructionBytes.
+static constexpr Uptr minStringInstructionBytes = 2048;
+static constexpr Uptr maxShortStringInstructionBytes = 256;
+
+// The string instructions copy a byte at a time if the destination is less than this many bytes
+// below the source.
+static constexpr Uptr minStringInstructionMoveDistance = 64;
+
+struct CPUFeatures {
+    bool enhancedRepMovsb = false;
+    bool fastShortRepMovsb = false;
+    bool avx2 = false;
+    bool avx512 = false;
+};
+
+static CPUFeatures detectCPUFeatures() {
+    CPUFeatures features;
+
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        features.enhancedRepMovsb = (ebx >> 9) & 1;
+        features.fastShortRepMovsb = (edx >> 4) & 1;
+    }
+
+    // __builtin_cpu_supports also checks that the OS saves the vector registers.
+    __builtin_cpu_init();
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512 = __builtin_cpu_supports("avx512f");
+    return features;
+}
+
+static const CPUFeatures &getCPUFeatures() {
+    static const CPUFeatures features = detectCPUFeatures();
+    return features;
+}
+
+//
+// Scalar kernels
+//
+
+static void repMovsb(U8 *dest, const U8 *source, Uptr numBytes) {
+    asm volatile("rep movsb"
+    : "=D"(dest), "=S"(source), "=c"(numBytes)
+    : "0"(dest), "1"(source), "2"(numBytes)
+    : "memory");
+}
+
+static void repStosb(U8 *dest, U8 value, Uptr numBytes) {
+    asm volatile("rep stosb"
+    : "=D"(dest), "=a"(value), "=c"(numBytes)
+    : "0"(dest), "1"(value), "2"(numBytes)
+    : "memory");
+}
+
+//
+// AVX2 kernels
+// Each loop handles whole vectors, and the remaining bytes are handled with the string
+// instructions: a final overlapping vector could read source bytes that were already overwritten
+// by an overlapping memmove.
+//
+
+__attribute__((target("avx2"))) static void copyForwardAVX2(U8 *dest, const U8 *source, Uptr numBytes) {
+    Uptr offset = 0;
+    for (; offset + 32 <= numBytes; offset += 32) {
+        __m256i vector = _mm256_loadu_si256((const __m256i *) (source + offset));
+        _mm256_storeu_si256((__m256i *) (dest + offset), vector);
+    }
+    repMovsb(dest + offset, source + offset, numBytes - offset);
+}
+
+__attribute__((target("avx2"))) static void copyForwardNonTemporalAVX2(U8 *dest, const U8 *source, Uptr numBytes) {
+    // Copy up to a 32-byte boundary in the destination, so the stream stores are aligned.
+    const Uptr numHeadBytes = (32 - (reinterpret_cast<Uptr>(dest) & 31)) & 31;
+    repMovsb(dest, source, numHeadBytes);
+
+    Uptr offset = numHeadBytes;
+    for (; offset + 32 <= numBytes; offset += 32) {
+        __m256i vector = _mm256_loadu_si256((const __m256i *) (source + offset));
+        _mm256_stream_si256((__m256i *) (dest + offset), vector);
+    }
+
+    // Order the weakly ordered stream stores before any stores that follow the copy.
+    _mm_sfence();
+    repMovsb(dest + offset, source + offset, numBytes - offset);
+}
+
+__attribute__((target("avx2"))) static void setAVX2(U8 *dest, U8 value, Uptr numBytes) {
+    const __m256i vector = _mm256_set1_epi8(char(value));
+    Uptr offset = 0;
+    for (; offset + 32 <= numBytes; offset += 32) {
+        _mm256_storeu_si256((__m256i *) (dest + offset), vector);
+    }
+    repStosb(dest + offset, value, numBytes - offset);
+}
+
+__attribute__((target("avx2"))) static void setNonTemporalAVX2(U8 *dest, U8 value, Uptr numBytes) {
+    const Uptr numHeadBytes = (32 - (reinterpret_cast<Uptr>(dest) & 31)) & 31;
+    repStosb(dest, value, numHeadBytes);
+
+    const __m256i vector = _mm256_set1_epi8(char(value));
+    Uptr offset = numHeadBytes;
+    for (; offset + 32 <= numBytes; offset += 32) {
+        _mm256_stream_si256((__m256i *) (dest + offset), vector);
+    }
+
+    _mm_sfence();
+    repStosb(dest + offset, value, numBytes - offset);
+}
+
+//
+// AVX-512 kernels
+//
+
+__attribute__((target("avx512f"))) static void copyForwardAVX512(U8 *dest, const U8 *source, Uptr numBytes) {
+    Uptr offset = 0;
+    for (; offset + 64 <= numBytes; offset += 64) {
+        __m512i vector = _mm512_loadu_si512((const void *) (source + offset));
+        _mm512_storeu_si512((void *) (dest + offset), vector);
+    }
+    repMovsb(dest + offset, source + offset, numBytes - offset);
+}
+
+__attribute__((target("avx512f"))) static void setAVX512(U8 *dest, U8 value, Uptr numBytes) {
+    const __m512i vector = _mm512_set1_epi32(I32(U32(value) * 0x01010101u));
+    Uptr offset = 0;
+    for (; offset + 64 <= numBytes; offset += 64) {
+        _mm512_storeu_si512((void *) (dest + offset), vector);
+    }
+    repStosb(dest + offset, value, numBytes - offset);
+}
+
+//
+// Kernel selection
+//
+
+// Copies in ascending address order, so it may also be used for a memmove whose destination is
+// below its source.
+static void copyForward(U8 *dest, const U8 *source, Uptr numBytes) {
+    const CPUFeatures &features = getCPUFeatures();
+    if (numBytes >= minNonTemporalBytes && features.avx2) {
+        copyForwardNonTemporalAVX2(dest, source, numBytes);
+    } else if ((numBytes >= minStringInstructionBytes && features.enhancedRepMovsb) ||
+               (numBytes < maxShortStringInstructionBytes && features.fastShortRepMovsb)) {
+        repMovsb(dest, source, numBytes);
+    } else if (numBytes >= 64 && features.avx512) {
+        copyForwardAVX512(dest, source, numBytes);
+    } else if (numBytes >= 32 && features.avx2) {
+        copyForwardAVX2(dest, source, numBytes);
+    } else {
+        repMovsb(dest, source, numBytes);
+    }
+}
+
+void Platform::bytewiseMemCopy(U8 *dest, const U8 *source, Uptr numBytes) {
+    copyForward(dest, source, numBytes);
+}
+
+void Platform::bytewiseMemSet(U8 *dest, U8 value, Uptr numBytes) {
+    const CPUFeatures &features = getCPUFeatures();
+    if (numBytes >= minNonTemporalBytes && features.avx2) {
+        setNonTemporalAVX2(dest, value, numBytes);
+    } else if ((numBytes >= minStringInstructionBytes && features.enhancedRepMovsb) ||
+               (numBytes < maxShortStringInstructionBytes && features.fastShortRepMovsb)) {
+        repStosb(dest, value, numBytes);
+    } else if (numBytes >= 64 && features.avx512) {
+        setAVX512(dest, value, numBytes);
+    } else if (numBytes >= 32 && features.avx2) {
+        setAVX2(dest, value, numBytes);
+    } else {
+        repStosb(dest, value, numBytes);
+    }
+}
+
+void Platform::bytewiseMemMove(U8 *dest, U8 *source, Uptr numBytes) {
+    // If the destination starts inside the source, the copy must be in descending address order,
+    // so each source byte is read before it is overwritten. The string instructions are slow in
+    // that direction, and the C library's memmove is faster than a backward vector loop, so use it.
+    if (source < dest && source + numBytes > dest) {
+        memmove(dest, source, numBytes);
+    } else if (dest < source && Uptr(source - dest) < minStringInstructionMoveDistance && numBytes >= 32 && getCPUFeatures().avx2) {
+        // A vector loop reads each vector before storing it, so it may also copy ranges that
+        // overlap with the destination below the source, without the string instructions' slow
+        // path for them.
+        copyForwardAVX2(dest, source, numBytes);
+    } else {
+        copyForward(dest, source, numBytes);
+    }
+}
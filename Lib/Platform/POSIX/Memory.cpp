@@ -1,10 +1,16 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 #include "POSIXPrivate.h"
 #include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
@@ -142,3 +148,357 @@ void Platform::freeAlignedVirtualPages(U8 *unalignedBaseAddress, Uptr numPages,
                        numPages << getPageSizeLog2(), strerror(errno));
     }
 }
+
+struct Platform::MemoryImage {
+    int fd;
+    Uptr numPages;
+};
+
+#ifdef __linux__
+
+MemoryImage *Platform::createMemoryImage(U8 *baseVirtualAddress, Uptr numPages) {
+    errorUnless(isPageAligned(baseVirtualAddress));
+    const Uptr pageSizeLog2 = getPageSizeLog2();
+    const Uptr numBytes = numPages << pageSizeLog2;
+
+    int fd = memfd_create("WAVM memory image", MFD_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (ftruncate(fd, numBytes)) {
+        close(fd);
+        return nullptr;
+    }
+
+    // Zero pages can be left as holes in the file. Whether a page is resident doesn't say whether it
+    // is zero: a page that was swapped out, or an unmodified page of an image the memory was
+    // previously mapped from, isn't resident, but has contents. Check the contents of every page
+    // instead: reading a page that was never written maps the shared zero page without committing
+    // memory for it.
+    auto isPageZero = [pageSizeLog2](const U8 *page) {
+        const U64 *words = reinterpret_cast<const U64 *>(page);
+        const Uptr numWords = (Uptr(1) << pageSizeLog2) / sizeof(U64);
+        for (Uptr wordIndex = 0; wordIndex < numWords; ++wordIndex) {
+            if (words[wordIndex]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    Uptr pageIndex = 0;
+    while (pageIndex < numPages) {
+        if (isPageZero(baseVirtualAddress + (pageIndex << pageSizeLog2))) {
+            ++pageIndex;
+            continue;
+        }
+
+        // Write each run of non-zero pages to the file.
+        const Uptr beginPageIndex = pageIndex;
+        while (pageIndex < numPages && !isPageZero(baseVirtualAddress + (pageIndex << pageSizeLog2))) {
+            ++pageIndex;
+        }
+
+        const U8 *source = baseVirtualAddress + (beginPageIndex << pageSizeLog2);
+        Uptr numRunBytes = (pageIndex - beginPageIndex) << pageSizeLog2;
+        Uptr fileOffset = beginPageIndex << pageSizeLog2;
+        while (numRunBytes) {
+            const ssize_t numWrittenBytes = pwrite(fd, source, numRunBytes, fileOffset);
+            if (numWrittenBytes <= 0) {
+                close(fd);
+                return nullptr;
+            }
+            source += numWrittenBytes;
+            fileOffset += numWrittenBytes;
+            numRunBytes -= numWrittenBytes;
+        }
+    }
+
+    // Replace the pages with a copy-on-write mapping of the image, so their contents stay the same,
+    // but writes to them no longer change the image.
+    MemoryImage *image = new MemoryImage{fd, numPages};
+    if (!mapMemoryImage(image, baseVirtualAddress)) {
+        Errors::fatalf("Failed to remap pages as a copy-on-write mapping of their image");
+    }
+    return image;
+}
+
+void Platform::destroyMemoryImage(MemoryImage *image) {
+    close(image->fd);
+    delete image;
+}
+
+Uptr Platform::getMemoryImageNumPages(MemoryImage *image) {
+    return image->numPages;
+}
+
+bool Platform::mapMemoryImage(MemoryImage *image, U8 *baseVirtualAddress) {
+    errorUnless(isPageAligned(baseVirtualAddress));
+    if (!image->numPages) {
+        return true;
+    }
+
+    const Uptr numBytes = image->numPages << getPageSizeLog2();
+    if (mmap(baseVirtualAddress, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, image->fd, 0) == MAP_FAILED) {
+        fprintf(stderr, "mmap(0x%" PRIxPTR ", %" PRIuPTR ", PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, %d, 0) failed! errno=%s\n", reinterpret_cast<Uptr>(baseVirtualAddress), numBytes, image->fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool Platform::isMemoryImageMappingUnmodified(U8 *baseVirtualAddress, Uptr numPages) {
+    errorUnless(isPageAligned(baseVirtualAddress));
+
+    // Each page has a 64-bit entry in /proc/self/pagemap. A page that is present (bit 63) or swapped
+    // (bit 62), but isn't a file page (bit 61), is a private copy created by writing to the page.
+    int pagemapFD = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (pagemapFD < 0) {
+        return false;
+    }
+
+    const Uptr firstPageIndex = reinterpret_cast<Uptr>(baseVirtualAddress) >> getPageSizeLog2();
+    bool isUnmodified = true;
+    U64 entries[512];
+    for (Uptr pageIndex = 0; pageIndex < numPages && isUnmodified;) {
+        const Uptr numEntries = std::min(numPages - pageIndex, Uptr(512));
+        const ssize_t numEntryBytes = numEntries * sizeof(U64);
+        if (pread(pagemapFD, entries, numEntryBytes, (firstPageIndex + pageIndex) * sizeof(U64)) != numEntryBytes) {
+            isUnmodified = false;
+            break;
+        }
+
+        for (Uptr entryIndex = 0; entryIndex < numEntries; ++entryIndex) {
+            const U64 entry = entries[entryIndex];
+            if ((entry & ((U64(1) << 63) | (U64(1) << 62))) && !(entry & (U64(1) << 61))) {
+                isUnmodified = false;
+                break;
+            }
+        }
+        pageIndex += numEntries;
+    }
+
+    close(pagemapFD);
+    return isUnmodified;
+}
+
+#else
+
+MemoryImage *Platform::createMemoryImage(U8 *baseVirtualAddress, Uptr numPages) {
+    return nullptr;
+}
+
+void Platform::destroyMemoryImage(MemoryImage *image) {
+    Errors::unreachable();
+}
+
+Uptr Platform::getMemoryImageNumPages(MemoryImage *image) {
+    Errors::unreachable();
+}
+
+bool Platform::mapMemoryImage(MemoryImage *image, U8 *baseVirtualAddress) {
+    Errors::unreachable();
+}
+
+bool Platform::isMemoryImageMappingUnmodified(U8 *baseVirtualAddress, Uptr numPages) {
+    return false;
+}
+
+#endif
+
+struct Platform::DirtyPageTracker {
+    U8 *baseAddress;
+    Uptr maxPages;
+    std::atomic<Uptr> numPages;
+    std::atomic<U64> *dirtyPageBits;
+};
+
+// The trackers are kept in a fixed-size array so the signal handler can find them without locking
+// or allocating.
+static constexpr Uptr maxDirtyPageTrackers = 256;
+static std::atomic<DirtyPageTracker *> dirtyPageTrackers[maxDirtyPageTrackers];
+// One more than the index of the highest tracker slot that has been used, so the signal handler only
+// scans the slots that may contain a tracker.
+static std::atomic<Uptr> numUsedDirtyPageTrackerSlots{0};
+static struct sigaction previousSIGSEGVAction;
+static struct sigaction previousSIGBUSAction;
+
+static Mutex &getDirtyPageTrackersMutex() {
+    static Platform::Mutex mutex;
+    return mutex;
+}
+
+static bool handleDirtyPageFault(U8 *address) {
+    const Uptr pageSizeLog2 = getPageSizeLog2();
+    const Uptr numUsedSlots = numUsedDirtyPageTrackerSlots.load(std::memory_order_acquire);
+    for (Uptr trackerIndex = 0; trackerIndex < numUsedSlots; ++trackerIndex) {
+        DirtyPageTracker *tracker = dirtyPageTrackers[trackerIndex].load(std::memory_order_acquire);
+        if (!tracker || address < tracker->baseAddress) {
+            continue;
+        }
+
+        const Uptr pageIndex = Uptr(address - tracker->baseAddress) >> pageSizeLog2;
+        if (pageIndex >= tracker->numPages.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        tracker->dirtyPageBits[pageIndex / 64].fetch_or(U64(1) << (pageIndex % 64), std::memory_order_relaxed);
+        return mprotect(tracker->baseAddress + (pageIndex << pageSizeLog2), Uptr(1) << pageSizeLog2, PROT_READ | PROT_WRITE) == 0;
+    }
+    return false;
+}
+
+static void dirtyPageSignalHandler(int signalNumber, siginfo_t *signalInfo, void *context) {
+    if (handleDirtyPageFault(reinterpret_cast<U8 *>(signalInfo->si_addr))) {
+        return;
+    }
+
+    // The fault wasn't a write to a tracked page, so pass it on to the previous handler. If there
+    // wasn't one, restore the default action, and let the faulting instruction fault again.
+    const struct sigaction &previousAction = signalNumber == SIGSEGV ? previousSIGSEGVAction : previousSIGBUSAction;
+    if (previousAction.sa_flags & SA_SIGINFO) {
+        previousAction.sa_sigaction(signalNumber, signalInfo, context);
+    } else if (previousAction.sa_handler == SIG_DFL || previousAction.sa_handler == SIG_IGN) {
+        sigaction(signalNumber, &previousAction, nullptr);
+    } else {
+        previousAction.sa_handler(signalNumber);
+    }
+}
+
+DirtyPageTracker *Platform::createDirtyPageTracker(U8 *baseVirtualAddress, Uptr numPages, Uptr maxPages) {
+    errorUnless(isPageAligned(baseVirtualAddress));
+    errorUnless(numPages <= maxPages);
+
+    const Uptr numDirtyPageWords = (maxPages + 63) / 64;
+    DirtyPageTracker *tracker = new DirtyPageTracker;
+    tracker->baseAddress = baseVirtualAddress;
+    tracker->maxPages = maxPages;
+    tracker->numPages.store(numPages, std::memory_order_relaxed);
+    tracker->dirtyPageBits = new std::atomic<U64>[numDirtyPageWords];
+    for (Uptr wordIndex = 0; wordIndex < numDirtyPageWords; ++wordIndex) {
+        tracker->dirtyPageBits[wordIndex].store(0, std::memory_order_relaxed);
+    }
+
+    {
+        Lock<Platform::Mutex> lock(getDirtyPageTrackersMutex());
+
+        static bool installedSignalHandler = false;
+        if (!installedSignalHandler) {
+            struct sigaction signalAction;
+            memset(&signalAction, 0, sizeof(signalAction));
+            signalAction.sa_sigaction = dirtyPageSignalHandler;
+            signalAction.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+            sigemptyset(&signalAction.sa_mask);
+            if (sigaction(SIGSEGV, &signalAction, &previousSIGSEGVAction) || sigaction(SIGBUS, &signalAction, &previousSIGBUSAction)) {
+                Errors::fatalf("sigaction failed! errno=%s", strerror(errno));
+            }
+            installedSignalHandler = true;
+        }
+
+        Uptr trackerIndex = 0;
+        while (trackerIndex < maxDirtyPageTrackers && dirtyPageTrackers[trackerIndex].load(std::memory_order_relaxed)) {
+            ++trackerIndex;
+        }
+        if (trackerIndex == maxDirtyPageTrackers) {
+            delete[] tracker->dirtyPageBits;
+            delete tracker;
+            return nullptr;
+        }
+
+        // Write-protect the pages before the tracker is visible to the signal handler, so no write
+        // can be missed.
+        if (numPages && !setVirtualPageAccess(baseVirtualAddress, numPages, MemoryAccess::readOnly)) {
+            Errors::fatal("Failed to write-protect tracked pages");
+        }
+        dirtyPageTrackers[trackerIndex].store(tracker, std::memory_order_release);
+        if (trackerIndex >= numUsedDirtyPageTrackerSlots.load(std::memory_order_relaxed)) {
+            numUsedDirtyPageTrackerSlots.store(trackerIndex + 1, std::memory_order_release);
+        }
+    }
+
+    return tracker;
+}
+
+void Platform::destroyDirtyPageTracker(DirtyPageTracker *tracker) {
+    {
+        Lock<Platform::Mutex> lock(getDirtyPageTrackersMutex());
+        const Uptr numUsedSlots = numUsedDirtyPageTrackerSlots.load(std::memory_order_relaxed);
+        for (Uptr trackerIndex = 0; trackerIndex < numUsedSlots; ++trackerIndex) {
+            if (dirtyPageTrackers[trackerIndex].load(std::memory_order_relaxed) == tracker) {
+                const Uptr numPages = tracker->numPages.load(std::memory_order_relaxed);
+                if (numPages && !setVirtualPageAccess(tracker->baseAddress, numPages, MemoryAccess::readWrite)) {
+                    Errors::fatal("Failed to remove write-protection from tracked pages");
+                }
+                dirtyPageTrackers[trackerIndex].store(nullptr, std::memory_order_release);
+                break;
+            }
+        }
+    }
+
+    delete[] tracker->dirtyPageBits;
+    delete tracker;
+}
+
+void Platform::setDirtyPageTrackerNumPages(DirtyPageTracker *tracker, Uptr numPages) {
+    errorUnless(numPages <= tracker->maxPages);
+
+    // Forget about pages that are no longer tracked, so they aren't reported if they are tracked
+    // again later.
+    const Uptr previousNumPages = tracker->numPages.load(std::memory_order_relaxed);
+    for (Uptr pageIndex = numPages; pageIndex < previousNumPages; ++pageIndex) {
+        tracker->dirtyPageBits[pageIndex / 64].fetch_and(~(U64(1) << (pageIndex % 64)), std::memory_order_relaxed);
+    }
+    tracker->numPages.store(numPages, std::memory_order_release);
+}
+
+void Platform::markDirtyPages(DirtyPageTracker *tracker, Uptr beginPageIndex, Uptr numPages) {
+    const Uptr pageSizeLog2 = getPageSizeLog2();
+    const Uptr numTrackedPages = tracker->numPages.load(std::memory_order_acquire);
+    const Uptr endPageIndex = std::min(beginPageIndex + numPages, numTrackedPages);
+
+    // Only make the pages that aren't already dirty writable, so marking pages that were already
+    // written is cheap.
+    for (Uptr pageIndex = beginPageIndex; pageIndex < endPageIndex; ++pageIndex) {
+        const U64 pageBit = U64(1) << (pageIndex % 64);
+        if (!(tracker->dirtyPageBits[pageIndex / 64].load(std::memory_order_acquire) & pageBit)) {
+            tracker->dirtyPageBits[pageIndex / 64].fetch_or(pageBit, std::memory_order_relaxed);
+            if (!setVirtualPageAccess(tracker->baseAddress + (pageIndex << pageSizeLog2), 1, MemoryAccess::readWrite)) {
+                Errors::fatal("Failed to remove write-protection from dirty page");
+            }
+        }
+    }
+}
+
+void Platform::resetDirtyPages(DirtyPageTracker *tracker, const std::function<void(Uptr pageIndex)> &visitDirtyPage) {
+    const Uptr pageSizeLog2 = getPageSizeLog2();
+    const Uptr numPages = tracker->numPages.load(std::memory_order_acquire);
+    const Uptr numDirtyPageWords = (numPages + 63) / 64;
+
+    // Visit each run of dirty pages, then write-protect the whole run with a single mprotect.
+    Uptr runBeginPageIndex = 0;
+    Uptr runNumPages = 0;
+    auto flushRun = [&]() {
+        if (runNumPages && !setVirtualPageAccess(tracker->baseAddress + (runBeginPageIndex << pageSizeLog2), runNumPages, MemoryAccess::readOnly)) {
+            Errors::fatal("Failed to write-protect dirty pages");
+        }
+        runNumPages = 0;
+    };
+
+    for (Uptr wordIndex = 0; wordIndex < numDirtyPageWords; ++wordIndex) {
+        U64 dirtyPageWord = tracker->dirtyPageBits[wordIndex].exchange(0, std::memory_order_acquire);
+        while (dirtyPageWord) {
+            const Uptr pageIndex = wordIndex * 64 + countTrailingZeroes(dirtyPageWord);
+            dirtyPageWord &= dirtyPageWord - 1;
+
+            visitDirtyPage(pageIndex);
+
+            if (runNumPages && runBeginPageIndex + runNumPages == pageIndex) {
+                ++runNumPages;
+            } else {
+                flushRun();
+                runBeginPageIndex = pageIndex;
+                runNumPages = 1;
+            }
+        }
+    }
+    flushRun();
+}
@@ -10,22 +10,19 @@ using namespace WAVM;
 using namespace WAVM::Runtime;
 
 Runtime::Compartment::Compartment()
-        : GCObject(ObjectKind::compartment, this), unalignedRuntimeData(nullptr), tables(0, maxTables - 1),
+        : GCObject(ObjectKind::compartment, this), tables(0, maxTables - 1),
           memories(0, maxMemories - 1)
 // Use UINTPTR_MAX as an invalid ID for globals, exception types, and module instances.
         , globals(0, UINTPTR_MAX - 1), exceptionTypes(0, UINTPTR_MAX - 1), moduleInstances(0, UINTPTR_MAX - 1),
           contexts(0, maxContexts - 1) {
-    runtimeData = (CompartmentRuntimeData *) Platform::allocateAlignedVirtualPages(compartmentReservedBytes
-                                                                                           >> Platform::getPageSizeLog2(), compartmentRuntimeDataAlignmentLog2, unalignedRuntimeData);
-
-    errorUnless(Platform::commitVirtualPages((U8 *) runtimeData, offsetof(CompartmentRuntimeData, contexts)
-            >> Platform::getPageSizeLog2()));
+    runtimeData = (CompartmentRuntimeData *) reserveRuntimeData(sizeof(CompartmentRuntimeData));
+    commitRuntimeData(&runtimeData->compartment, sizeof(runtimeData->compartment));
 
     runtimeData->compartment = this;
 }
 
 Runtime::Compartment::~Compartment() {
-    Lock<Platform::Mutex> compartmentLock(mutex);
+    Lock<const Compartment> compartmentLock(*this);
 
     wavmAssert(!memories.size());
     wavmAssert(!tables.size());
@@ -34,16 +31,142 @@ Runtime::Compartment::~Compartment() {
     wavmAssert(!moduleInstances.size());
     wavmAssert(!contexts.size());
 
-    Platform::freeAlignedVirtualPages(unalignedRuntimeData, compartmentReservedBytes
-            >> Platform::getPageSizeLog2(), compartmentRuntimeDataAlignmentLog2);
+    freeRuntimeData((U8 *) runtimeData, sizeof(CompartmentRuntimeData));
     runtimeData = nullptr;
-    unalignedRuntimeData = nullptr;
+}
+
+void Runtime::Compartment::lock() const {
+    gcState.mutex.lock();
+    moduleInstancesMutex.lock();
+    tablesMutex.lock();
+    memoriesMutex.lock();
+    globalsMutex.lock();
+    exceptionTypesMutex.lock();
+    contextsMutex.lock();
+}
+
+void Runtime::Compartment::unlock() const {
+    contextsMutex.unlock();
+    exceptionTypesMutex.unlock();
+    globalsMutex.unlock();
+    memoriesMutex.unlock();
+    tablesMutex.unlock();
+    moduleInstancesMutex.unlock();
+    gcState.mutex.unlock();
+}
+
+static Uptr getNumRuntimeDataPages(Uptr numBytes) {
+    const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
+    return (numBytes + (Uptr(1) << pageBytesLog2) - 1) >> pageBytesLog2;
+}
+
+U8 *Runtime::reserveRuntimeData(Uptr numBytes) {
+    U8 *runtimeData = Platform::allocateVirtualPages(getNumRuntimeDataPages(numBytes));
+    errorUnless(runtimeData);
+    return runtimeData;
+}
+
+void Runtime::freeRuntimeData(U8 *runtimeData, Uptr numBytes) {
+    Platform::freeVirtualPages(runtimeData, getNumRuntimeDataPages(numBytes));
+}
+
+void Runtime::commitRuntimeData(void *address, Uptr numBytes) {
+    const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
+    const Uptr beginPageIndex = reinterpret_cast<Uptr>(address) >> pageBytesLog2;
+    const Uptr endPageIndex = (reinterpret_cast<Uptr>(address) + numBytes + (Uptr(1) << pageBytesLog2) - 1) >> pageBytesLog2;
+    errorUnless(Platform::commitVirtualPages(reinterpret_cast<U8 *>(beginPageIndex << pageBytesLog2), endPageIndex - beginPageIndex));
 }
 
 Compartment *Runtime::createCompartment() {
     return new Compartment;
 }
 
+Compartment *Runtime::cloneCompartment(Compartment *compartment) {
+    Compartment *newCompartment = new Compartment;
+    Lock<const Compartment> compartmentLock(*compartment);
+    newCompartment->hasSignalTraps.store(compartment->hasSignalTraps.load());
+
+    // Clone the objects in an order that ensures the objects referenced by a module instance are
+    // cloned before it. Table elements and global values may refer to any kind of object, including
+    // module instances and each other, so they are remapped once all the objects exist.
+    for (Memory *memory : compartment->memories) {
+        Memory *newMemory = cloneMemory(memory, newCompartment);
+        errorUnless(newMemory);
+        wavmAssert(newMemory->id == memory->id);
+    }
+    for (ExceptionType *exceptionType : compartment->exceptionTypes) {
+        ExceptionType *newExceptionType = cloneExceptionType(exceptionType, newCompartment);
+        errorUnless(newExceptionType);
+        wavmAssert(newExceptionType->id == exceptionType->id);
+    }
+    for (Table *table : compartment->tables) {
+        Table *newTable = cloneTable(table, newCompartment);
+        errorUnless(newTable);
+        wavmAssert(newTable->id == table->id);
+    }
+    for (Global *global : compartment->globals) {
+        Global *newGlobal = cloneGlobal(global, newCompartment);
+        errorUnless(newGlobal);
+        wavmAssert(newGlobal->id == global->id);
+    }
+    for (ModuleInstance *moduleInstance : compartment->moduleInstances) {
+        ModuleInstance *newModuleInstance = cloneModuleInstance(moduleInstance, newCompartment);
+        errorUnless(newModuleInstance);
+        wavmAssert(newModuleInstance->id == moduleInstance->id);
+    }
+
+    for (Table *newTable : newCompartment->tables) {
+        remapClonedTableElements(newTable);
+    }
+    for (Global *newGlobal : newCompartment->globals) {
+        remapClonedGlobalValue(newGlobal);
+    }
+
+    // Add the cloned module instances' counted references once all of them exist, since an
+    // instance may import functions from an instance with a higher ID.
+    for (ModuleInstance *newModuleInstance : newCompartment->moduleInstances) {
+        addModuleInstanceReferences(newModuleInstance);
+    }
+
+    return newCompartment;
+}
+
+Object *Runtime::remapToClonedCompartment(Object *object, const Compartment *newCompartment) {
+    if (!object) {
+        return nullptr;
+    }
+
+    // Functions are shared between the original and the cloned compartment.
+    if (object->kind == ObjectKind::function) {
+        return object;
+    }
+
+    switch (object->kind) {
+        case ObjectKind::table: {
+            Lock<Platform::Mutex> tablesLock(newCompartment->tablesMutex);
+            return newCompartment->tables[asTable(object)->id];
+        }
+        case ObjectKind::memory: {
+            Lock<Platform::Mutex> memoriesLock(newCompartment->memoriesMutex);
+            return newCompartment->memories[asMemory(object)->id];
+        }
+        case ObjectKind::global: {
+            Lock<Platform::Mutex> globalsLock(newCompartment->globalsMutex);
+            return newCompartment->globals[asGlobal(object)->id];
+        }
+        case ObjectKind::exceptionType: {
+            Lock<Platform::Mutex> exceptionTypesLock(newCompartment->exceptionTypesMutex);
+            return newCompartment->exceptionTypes[asExceptionType(object)->id];
+        }
+        case ObjectKind::moduleInstance: {
+            Lock<Platform::Mutex> moduleInstancesLock(newCompartment->moduleInstancesMutex);
+            return newCompartment->moduleInstances[asModuleInstance(object)->id];
+        }
+        default:
+            Errors::unreachable();
+    };
+}
+
 bool Runtime::isInCompartment(Object *object, const Compartment *compartment) {
     if (object->kind == ObjectKind::function) {
         // The function may be in multiple compartments, but if this compartment maps the function's
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <string>
 #include <utility>
 #include <vector>
@@ -45,6 +46,11 @@ Function *Intrinsics::Function::instantiate(Compartment *compartment) {
     return LLVMJIT::getIntrinsicThunk(nativeFunction, type, callingConvention, name);
 }
 
+void Intrinsics::addInlinableFunction(const char *moduleName, const Intrinsics::Function &function, const char *llvmIR, const char *llvmFunctionName) {
+    wavmAssert(function.getCallingConvention() == IR::CallingConvention::intrinsic);
+    LLVMJIT::addInlinableIntrinsic(moduleName, function.getName(), function.getNativeFunction(), function.getType(), llvmIR, strlen(llvmIR), llvmFunctionName);
+}
+
 Intrinsics::Global::Global(Intrinsics::Module &moduleRef, const char *inName, IR::ValueType inType, IR::Value inValue)
         : name(inName), type(inType), value(inValue) {
     initializeModule(moduleRef);
@@ -95,10 +101,19 @@ ModuleInstance *Intrinsics::instantiateModule(Compartment *compartment, const In
     std::vector<Runtime::Global *> globals;
     std::vector<Runtime::ExceptionType *> exceptionTypes;
     if (moduleRef.impl) {
+        // Get the thunks for all the module's functions at once, so any that haven't been generated
+        // yet are compiled together.
+        std::vector<LLVMJIT::IntrinsicThunkSpec> thunkSpecs;
+        thunkSpecs.reserve(moduleRef.impl->functionMap.size());
+        for (const auto &pair : moduleRef.impl->functionMap) {
+            const Intrinsics::Function *intrinsicFunction = pair.value;
+            thunkSpecs.push_back({intrinsicFunction->getNativeFunction(), intrinsicFunction->getType(), intrinsicFunction->getCallingConvention(), intrinsicFunction->getName()});
+        }
+        functions = LLVMJIT::getIntrinsicThunks(thunkSpecs);
+
+        Uptr functionIndex = 0;
         for (const auto &pair : moduleRef.impl->functionMap) {
-            auto function = pair.value->instantiate(compartment);
-            functions.push_back(function);
-            exportMap.addOrFail(pair.key, asObject(function));
+            exportMap.addOrFail(pair.key, asObject(functions[functionIndex++]));
         }
 
         for (const auto &pair : moduleRef.impl->tableMap) {
@@ -143,10 +158,14 @@ ModuleInstance *Intrinsics::instantiateModule(Compartment *compartment, const In
         }
     }
 
-    Lock<Platform::Mutex> compartmentLock(compartment->mutex);
-    const Uptr id = compartment->moduleInstances.add(UINTPTR_MAX, nullptr);
-    auto moduleInstance = new ModuleInstance(compartment, id, std::move(exportMap), std::move(functions), std::move(tables), std::move(memories), std::move(globals), std::move(exceptionTypes), nullptr, {}, {}, nullptr, std::move(debugName));
-    compartment->moduleInstances[id] = moduleInstance;
+    ModuleInstance *moduleInstance;
+    {
+        Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
+        const Uptr id = compartment->moduleInstances.add(UINTPTR_MAX, nullptr);
+        moduleInstance = new ModuleInstance(compartment, id, std::move(exportMap), std::move(functions), std::move(tables), std::move(memories), std::move(globals), std::move(exceptionTypes), nullptr, {}, {}, nullptr, std::move(debugName));
+        compartment->moduleInstances[id] = moduleInstance;
+    }
+    addModuleInstanceReferences(moduleInstance);
     return moduleInstance;
 }
 
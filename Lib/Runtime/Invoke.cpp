@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "RuntimePrivate.h"
+#include "WAVM/Platform/Exception.h"
 
 using namespace WAVM;
 using namespace WAVM::IR;
@@ -15,13 +16,18 @@ UntaggedValue *Runtime::invokeFunctionUnchecked(Context *context, Function *func
     auto invokeFunctionPointer = LLVMJIT::getInvokeThunk(functionType);
 
     // Copy the arguments into the thunk arguments buffer in ContextRuntimeData.
-    ContextRuntimeData *contextRuntimeData = &context->compartment->runtimeData->contexts[context->id];
+    ContextRuntimeData *contextRuntimeData = context->runtimeData;
     U8 *argData = contextRuntimeData->thunkArgAndReturnData;
     Uptr argDataOffset = 0;
     for (Uptr argumentIndex = 0; argumentIndex < functionType.params().size(); ++argumentIndex) {
         const ValueType type = functionType.params()[argumentIndex];
         const UntaggedValue &argument = arguments[argumentIndex];
 
+        // WebAssembly code may store reference arguments anywhere, so they become uncounted.
+        if (isReferenceType(type) && argument.object) {
+            addUncountedReference(context->compartment, argument.object);
+        }
+
         // Naturally align each argument.
         const Uptr numArgBytes = getTypeByteWidth(type);
         argDataOffset = (argDataOffset + numArgBytes - 1) & -numArgBytes;
@@ -30,8 +36,42 @@ UntaggedValue *Runtime::invokeFunctionUnchecked(Context *context, Function *func
         argDataOffset += numArgBytes;
     }
 
-    // Call the invoke thunk.
-    contextRuntimeData = (*invokeFunctionPointer)(function, contextRuntimeData);
+    // Call the invoke thunk. If the compartment contains code that traps by raising a signal, catch
+    // the signal and turn it into a Trap exception. Integer division traps are raised by the
+    // hardware, and are only caught if the faulting instruction is in WebAssembly code: a fault in
+    // an intrinsic or the runtime is a bug, and jumping out of it would skip its destructors and
+    // leave its locks held, so it goes to the process's normal crash handling. No handler is
+    // installed for access violations, so they are only raised by the outOfBoundsMemoryTrap
+    // intrinsic that explicit bounds checks call, and by the table.get and table.set intrinsics
+    // for an index past the end of a table, at the address of the element.
+    if (!context->compartment->hasSignalTraps.load(std::memory_order_relaxed)) {
+        contextRuntimeData = (*invokeFunctionPointer)(function, contextRuntimeData);
+    } else {
+        Trap::Type trapType = Trap::Type::integerDivideByZeroOrIntegerOverflow;
+        const bool trapped = Platform::catchSignals(
+                [&]() { contextRuntimeData = (*invokeFunctionPointer)(function, contextRuntimeData); },
+                [&](Platform::Signal signal, const Platform::CallStack &callStack) {
+                    switch (signal.type) {
+                        case Platform::Signal::Type::intDivideByZeroOrOverflow:
+                            if (callStack.stackFrames.empty() || !LLVMJIT::getFunctionByAddress(callStack.stackFrames[0].ip)) {
+                                return false;
+                            }
+                            trapType = Trap::Type::integerDivideByZeroOrIntegerOverflow;
+                            return true;
+                        case Platform::Signal::Type::accessViolation: {
+                            Table *table = nullptr;
+                            Uptr tableIndex = 0;
+                            trapType = isAddressOwnedByTable(reinterpret_cast<U8 *>(signal.accessViolation.address), table, tableIndex) ? Trap::Type::outOfBoundsTableAccess : Trap::Type::outOfBoundsMemoryAccess;
+                            return true;
+                        }
+                        default:
+                            return false;
+                    };
+                });
+        if (trapped) {
+            throw Trap{trapType};
+        }
+    }
 
     // Return a pointer to the return value that was written to the ContextRuntimeData.
     return (UntaggedValue *) contextRuntimeData->thunkArgAndReturnData;
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <vector>
@@ -11,9 +12,8 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
-// Global lists of memories; used to query whether an address is reserved by one of them.
-static Platform::Mutex memoriesMutex;
-static std::vector<Memory *> memories;
+// A global set of memories; used to query whether an address is reserved by one of them.
+static ShardedRegistry<Memory> memoryRegistry;
 
 enum {
     numGuardPages = 1
@@ -24,14 +24,47 @@ static Uptr getPlatformPagesPerWebAssemblyPageLog2() {
     return IR::numBytesPerPageLog2 - Platform::getPageSizeLog2();
 }
 
-static Memory *createMemoryImpl(Compartment *compartment, IR::MemoryType type, Uptr numPages, std::string &&debugName) {
+// Sets a memory's size, and the copy of it in the compartment's runtime data that code compiled with
+// explicit bounds checks reads. The caller must hold the memory's resizingMutex.
+static void setMemoryNumPages(Memory *memory, Uptr numPages) {
+    memory->numPages.store(numPages, std::memory_order_release);
+    if (memory->id != UINTPTR_MAX) {
+        memory->compartment->runtimeData->memoryNumBytes[memory->id] = numPages * IR::numBytesPerPage;
+    }
+}
+
+// Commits pages at the end of a memory. The caller must hold the memory's resizingMutex.
+static bool commitMemoryPages(Memory *memory, Uptr beginPageIndex, Uptr numPagesToCommit) {
+    // If writes to the memory are tracked, commit the pages write-protected, so the first write to
+    // each page is tracked.
+    const Uptr platformPagesPerWebAssemblyPageLog2 = getPlatformPagesPerWebAssemblyPageLog2();
+    if (!Platform::commitVirtualPages(memory->baseAddress + beginPageIndex * IR::numBytesPerPage,
+                                      numPagesToCommit << platformPagesPerWebAssemblyPageLog2,
+                                      memory->dirtyPageTracker ? Platform::MemoryAccess::readOnly : Platform::MemoryAccess::readWrite)) {
+        return false;
+    }
+
+    if (memory->dirtyPageTracker) {
+        Platform::setDirtyPageTrackerNumPages(memory->dirtyPageTracker, (beginPageIndex + numPagesToCommit) << platformPagesPerWebAssemblyPageLog2);
+    }
+    return true;
+}
+
+static Memory *createMemoryImpl(Compartment *compartment, IR::MemoryType type, Uptr numPages, std::string &&debugName, bool explicitBoundsChecks) {
     Memory *memory = new Memory(compartment, type, std::move(debugName));
+    memory->explicitBoundsChecks = explicitBoundsChecks;
 
     // On a 64-bit runtime, allocate 8GB of address space for the memory.
     // This allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset
     // will always be within the reserved address-space.
+    // If the code accessing the memory checks that each access is within the memory, and calls the
+    // outOfBoundsMemoryTrap intrinsic if not, only reserve address space for the memory's maximum
+    // size, plus a guard page.
     const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
-    const Uptr memoryMaxBytes = Uptr(8ull * 1024 * 1024 * 1024);
+    Uptr memoryMaxBytes = Uptr(8ull * 1024 * 1024 * 1024);
+    if (explicitBoundsChecks) {
+        memoryMaxBytes = Uptr(std::min(type.size.max, U64(IR::maxMemoryPages))) * IR::numBytesPerPage;
+    }
     const Uptr memoryMaxPages = memoryMaxBytes >> pageBytesLog2;
 
     memory->baseAddress = Platform::allocateVirtualPages(memoryMaxPages + numGuardPages);
@@ -47,32 +80,32 @@ static Memory *createMemoryImpl(Compartment *compartment, IR::MemoryType type, U
         return nullptr;
     }
 
-    // Add the memory to the global array.
-    {
-        Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-        memories.push_back(memory);
-    }
+    // Add the memory to the global set.
+    memoryRegistry.add(memory);
 
     return memory;
 }
 
-Memory *Runtime::createMemory(Compartment *compartment, IR::MemoryType type, std::string &&debugName) {
+Memory *Runtime::createMemory(Compartment *compartment, IR::MemoryType type, std::string &&debugName, bool explicitBoundsChecks) {
     wavmAssert(type.size.min <= UINTPTR_MAX);
-    Memory *memory = createMemoryImpl(compartment, type, Uptr(type.size.min), std::move(debugName));
+    Memory *memory = createMemoryImpl(compartment, type, Uptr(type.size.min), std::move(debugName), explicitBoundsChecks);
     if (!memory) {
         return nullptr;
     }
 
     // Add the memory to the compartment's memories IndexMap.
     {
-        Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+        Lock<Platform::Mutex> memoriesLock(compartment->memoriesMutex);
 
         memory->id = compartment->memories.add(UINTPTR_MAX, memory);
         if (memory->id == UINTPTR_MAX) {
             delete memory;
             return nullptr;
         }
+        commitRuntimeData(&compartment->runtimeData->memoryBases[memory->id], sizeof(void *));
+        commitRuntimeData(&compartment->runtimeData->memoryNumBytes[memory->id], sizeof(Uptr));
         compartment->runtimeData->memoryBases[memory->id] = memory->baseAddress;
+        compartment->runtimeData->memoryNumBytes[memory->id] = memory->numPages.load(std::memory_order_acquire) * IR::numBytesPerPage;
     }
 
     return memory;
@@ -82,24 +115,50 @@ Memory *Runtime::cloneMemory(Memory *memory, Compartment *newCompartment) {
     Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
     const Uptr numPages = memory->numPages.load(std::memory_order_acquire);
     std::string debugName = memory->debugName;
-    Memory *newMemory = createMemoryImpl(newCompartment, memory->type, numPages, std::move(debugName));
+    Memory *newMemory = createMemoryImpl(newCompartment, memory->type, numPages, std::move(debugName), memory->explicitBoundsChecks);
     if (!newMemory) {
         return nullptr;
     }
-
-    // Copy the memory contents to the new memory.
-    memcpy(newMemory->baseAddress, memory->baseAddress, numPages * IR::numBytesPerPage);
+    newMemory->hasUncountedReferences.store(memory->hasUncountedReferences.load(std::memory_order_acquire), std::memory_order_release);
+
+    // Map the new memory copy-on-write from an image of the original memory's contents. If the
+    // original memory has been written since it was mapped from its current image, create a new
+    // image from its contents, and remap it from that image as well.
+    const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+    if (!memory->image || !Platform::isMemoryImageMappingUnmodified(memory->baseAddress, numPlatformPages)) {
+        Platform::MemoryImage *image = Platform::createMemoryImage(memory->baseAddress, numPlatformPages);
+        memory->image = image ? std::shared_ptr<Platform::MemoryImage>(image, Platform::destroyMemoryImage) : nullptr;
+
+        // Remapping the memory from the image made its pages writable, so write-protect them again
+        // if writes to the memory are tracked. Pages that were already dirty stay dirty.
+        if (image && memory->dirtyPageTracker && numPlatformPages) {
+            errorUnless(Platform::setVirtualPageAccess(memory->baseAddress, numPlatformPages, Platform::MemoryAccess::readOnly));
+        }
+    }
+    if (memory->image) {
+        // Pages committed after the image was created haven't been written, so they are already
+        // correctly zero in the new memory.
+        wavmAssert(Platform::getMemoryImageNumPages(memory->image.get()) <= numPlatformPages);
+        errorUnless(Platform::mapMemoryImage(memory->image.get(), newMemory->baseAddress));
+        newMemory->image = memory->image;
+    } else {
+        // If the platform doesn't support memory images, copy the memory contents to the new memory.
+        memcpy(newMemory->baseAddress, memory->baseAddress, numPages * IR::numBytesPerPage);
+    }
 
     resizingLock.unlock();
 
     // Insert the memory in the new compartment's memories array with the same index as it had in
     // the original compartment's memories IndexMap.
     {
-        Lock<Platform::Mutex> compartmentLock(newCompartment->mutex);
+        Lock<Platform::Mutex> memoriesLock(newCompartment->memoriesMutex);
 
         newMemory->id = memory->id;
         newCompartment->memories.insertOrFail(newMemory->id, newMemory);
+        commitRuntimeData(&newCompartment->runtimeData->memoryBases[newMemory->id], sizeof(void *));
+        commitRuntimeData(&newCompartment->runtimeData->memoryNumBytes[newMemory->id], sizeof(Uptr));
         newCompartment->runtimeData->memoryBases[newMemory->id] = newMemory->baseAddress;
+        newCompartment->runtimeData->memoryNumBytes[newMemory->id] = numPages * IR::numBytesPerPage;
     }
 
     return newMemory;
@@ -112,17 +171,15 @@ Runtime::Memory::~Memory() {
 
         wavmAssert(compartment->runtimeData->memoryBases[id] == baseAddress);
         compartment->runtimeData->memoryBases[id] = nullptr;
+        compartment->runtimeData->memoryNumBytes[id] = 0;
     }
 
-    // Remove the memory from the global array.
-    {
-        Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-        for (Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex) {
-            if (memories[memoryIndex] == this) {
-                memories.erase(memories.begin() + memoryIndex);
-                break;
-            }
-        }
+    // Remove the memory from the global set.
+    memoryRegistry.remove(this);
+
+    if (dirtyPageTracker) {
+        Platform::destroyDirtyPageTracker(dirtyPageTracker);
+        dirtyPageTracker = nullptr;
     }
 
     // Free the virtual address space.
@@ -137,17 +194,16 @@ Runtime::Memory::~Memory() {
 bool Runtime::isAddressOwnedByMemory(U8 *address, Memory *&outMemory, Uptr &outMemoryAddress) {
     // Iterate over all memories and check if the address is within the reserved address space for
     // each.
-    Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-    for (auto memory : memories) {
-        U8 *startAddress = memory->baseAddress;
-        U8 *endAddress = memory->baseAddress + memory->numReservedBytes;
-        if (address >= startAddress && address < endAddress) {
-            outMemory = memory;
-            outMemoryAddress = address - startAddress;
-            return true;
-        }
+    Memory *memory = memoryRegistry.find([address](Memory *memory) {
+        return address >= memory->baseAddress && address < memory->baseAddress + memory->numReservedBytes;
+    });
+    if (!memory) {
+        return false;
     }
-    return false;
+
+    outMemory = memory;
+    outMemoryAddress = address - memory->baseAddress;
+    return true;
 }
 
 Uptr Runtime::getMemoryNumPages(Memory *memory) {
@@ -175,16 +231,151 @@ Iptr Runtime::growMemory(Memory *memory, Uptr numPagesToGrow) {
     }
 
     // Try to commit the new pages, and return -1 if the commit fails.
-    if (!Platform::commitVirtualPages(
-            memory->baseAddress + previousNumPages * IR::numBytesPerPage,
-            numPagesToGrow << getPlatformPagesPerWebAssemblyPageLog2())) {
+    if (!commitMemoryPages(memory, previousNumPages, numPagesToGrow)) {
         return -1;
     }
 
-    memory->numPages.store(previousNumPages + numPagesToGrow, std::memory_order_release);
+    setMemoryNumPages(memory, previousNumPages + numPagesToGrow);
     return previousNumPages;
 }
 
+// Grows or shrinks a memory to the given number of pages. The caller must hold the memory's
+// resizingMutex.
+static void resizeMemoryImpl(Memory *memory, Uptr numPages) {
+    const Uptr previousNumPages = memory->numPages.load(std::memory_order_acquire);
+    errorUnless(numPages <= memory->type.size.max && numPages <= IR::maxMemoryPages);
+    if (numPages > previousNumPages) {
+        errorUnless(commitMemoryPages(memory, previousNumPages, numPages - previousNumPages));
+    } else if (numPages < previousNumPages) {
+        const Uptr platformPagesPerWebAssemblyPageLog2 = getPlatformPagesPerWebAssemblyPageLog2();
+        setMemoryNumPages(memory, numPages);
+        if (memory->dirtyPageTracker) {
+            Platform::setDirtyPageTrackerNumPages(memory->dirtyPageTracker, numPages << platformPagesPerWebAssemblyPageLog2);
+        }
+        Platform::decommitVirtualPages(memory->baseAddress + numPages * IR::numBytesPerPage,
+                                       (previousNumPages - numPages) << platformPagesPerWebAssemblyPageLog2);
+    }
+    setMemoryNumPages(memory, numPages);
+}
+
+MemoryDelta Runtime::captureMemoryDelta(Memory *memory) {
+    Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+    const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
+    const Uptr numPages = memory->numPages.load(std::memory_order_acquire);
+    const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+
+    MemoryDelta delta;
+    delta.numPages = numPages;
+    delta.numBytesPerPage = Uptr(1) << pageBytesLog2;
+
+    auto capturePage = [&](Uptr pageIndex) {
+        const U8 *page = memory->baseAddress + (pageIndex << pageBytesLog2);
+        delta.pageIndices.push_back(pageIndex);
+        delta.pageBytes.insert(delta.pageBytes.end(), page, page + delta.numBytesPerPage);
+    };
+
+    if (!memory->dirtyPageTracker) {
+        // The first delta contains all the memory's pages, since there is no earlier delta for it
+        // to be relative to.
+        delta.pageIndices.reserve(numPlatformPages);
+        delta.pageBytes.reserve(numPages * IR::numBytesPerPage);
+        for (Uptr pageIndex = 0; pageIndex < numPlatformPages; ++pageIndex) {
+            capturePage(pageIndex);
+        }
+
+        // If there are too many trackers to track writes to the memory, the next delta will also
+        // contain all its pages.
+        memory->dirtyPageTracker = Platform::createDirtyPageTracker(memory->baseAddress, numPlatformPages,
+                                                                    memory->numReservedBytes >> pageBytesLog2);
+    } else {
+        Platform::resetDirtyPages(memory->dirtyPageTracker, capturePage);
+    }
+
+    return delta;
+}
+
+static void writeMemoryDeltaPages(Memory *memory, const MemoryDelta &delta) {
+    errorUnless(delta.numBytesPerPage == Uptr(1) << Platform::getPageSizeLog2());
+    errorUnless(delta.pageBytes.size() == delta.pageIndices.size() * delta.numBytesPerPage);
+
+    const Uptr numPlatformPages = delta.numPages << getPlatformPagesPerWebAssemblyPageLog2();
+    for (Uptr deltaPageIndex = 0; deltaPageIndex < delta.pageIndices.size(); ++deltaPageIndex) {
+        const Uptr pageIndex = delta.pageIndices[deltaPageIndex];
+        errorUnless(pageIndex < numPlatformPages);
+        memcpy(memory->baseAddress + pageIndex * delta.numBytesPerPage,
+               delta.pageBytes.data() + deltaPageIndex * delta.numBytesPerPage, delta.numBytesPerPage);
+    }
+}
+
+void Runtime::applyMemoryDelta(Memory *memory, const MemoryDelta &delta) {
+    Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+    resizeMemoryImpl(memory, delta.numPages);
+    writeMemoryDeltaPages(memory, delta);
+}
+
+void Runtime::restoreMemoryCheckpoint(Memory *memory, const std::vector<MemoryDelta> &deltas, Uptr checkpointIndex) {
+    errorUnless(checkpointIndex < deltas.size());
+
+    Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+    const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
+
+    // Gather the pages written since the checkpoint: those in the later deltas, and those written
+    // since the last delta.
+    std::vector<Uptr> writtenPageIndices;
+    for (Uptr deltaIndex = checkpointIndex + 1; deltaIndex < deltas.size(); ++deltaIndex) {
+        writtenPageIndices.insert(writtenPageIndices.end(), deltas[deltaIndex].pageIndices.begin(),
+                                  deltas[deltaIndex].pageIndices.end());
+    }
+    if (memory->dirtyPageTracker) {
+        Platform::resetDirtyPages(memory->dirtyPageTracker, [&](Uptr pageIndex) {
+            writtenPageIndices.push_back(pageIndex);
+        });
+    } else {
+        // Writes to the memory aren't tracked, so any of its pages may have been written.
+        const Uptr numPlatformPages = memory->numPages.load(std::memory_order_acquire) << getPlatformPagesPerWebAssemblyPageLog2();
+        for (Uptr pageIndex = 0; pageIndex < numPlatformPages; ++pageIndex) {
+            writtenPageIndices.push_back(pageIndex);
+        }
+    }
+    std::sort(writtenPageIndices.begin(), writtenPageIndices.end());
+    writtenPageIndices.erase(std::unique(writtenPageIndices.begin(), writtenPageIndices.end()), writtenPageIndices.end());
+
+    const MemoryDelta &checkpoint = deltas[checkpointIndex];
+    errorUnless(checkpoint.numBytesPerPage == Uptr(1) << pageBytesLog2);
+    resizeMemoryImpl(memory, checkpoint.numPages);
+
+    // Restore each written page from the last delta up to the checkpoint that contains it. If no
+    // delta contains it, it was zero at the checkpoint.
+    const Uptr numPlatformPages = checkpoint.numPages << getPlatformPagesPerWebAssemblyPageLog2();
+    for (Uptr pageIndex : writtenPageIndices) {
+        if (pageIndex >= numPlatformPages) {
+            break;
+        }
+
+        U8 *page = memory->baseAddress + (pageIndex << pageBytesLog2);
+        const U8 *checkpointPage = nullptr;
+        for (Uptr deltaIndex = checkpointIndex + 1; deltaIndex > 0 && !checkpointPage; --deltaIndex) {
+            const MemoryDelta &delta = deltas[deltaIndex - 1];
+            auto it = std::lower_bound(delta.pageIndices.begin(), delta.pageIndices.end(), pageIndex);
+            if (it != delta.pageIndices.end() && *it == pageIndex) {
+                checkpointPage = delta.pageBytes.data() + ((it - delta.pageIndices.begin()) << pageBytesLog2);
+            }
+        }
+
+        if (checkpointPage) {
+            memcpy(page, checkpointPage, Uptr(1) << pageBytesLog2);
+        } else {
+            memset(page, 0, Uptr(1) << pageBytesLog2);
+        }
+    }
+
+    // The restored pages now match the checkpoint, so reset their dirty state to make the next
+    // delta relative to the checkpoint.
+    if (memory->dirtyPageTracker) {
+        Platform::resetDirtyPages(memory->dirtyPageTracker, [](Uptr) {});
+    }
+}
+
 U8 *Runtime::getMemoryBaseAddress(Memory *memory) {
     return memory->baseAddress;
 }
@@ -210,9 +401,20 @@ U8 *Runtime::getValidatedMemoryOffsetRange(Memory *memory, Uptr address, Uptr nu
 
     // Validate that the range [offset..offset+numBytes) is contained by the memory's committed
     // pages.
-    return ::getValidatedMemoryOffsetRangeImpl(memory, memory->baseAddress,
-                                               memory->numPages.load(std::memory_order_acquire) *
-                                               IR::numBytesPerPage, address, numBytes);
+    U8 *pointer = ::getValidatedMemoryOffsetRangeImpl(memory, memory->baseAddress,
+                                                      memory->numPages.load(std::memory_order_acquire) *
+                                                      IR::numBytesPerPage, address, numBytes);
+
+    // The caller may pass the range to a system call that writes to it, which fails on a
+    // write-protected page instead of faulting, so mark the range's tracked pages dirty up front.
+    if (memory->dirtyPageTracker && numBytes) {
+        const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
+        const Uptr beginPageIndex = Uptr(pointer - memory->baseAddress) >> pageBytesLog2;
+        const Uptr endPageIndex = (Uptr(pointer - memory->baseAddress) + numBytes + (Uptr(1) << pageBytesLog2) - 1) >> pageBytesLog2;
+        Platform::markDirtyPages(memory->dirtyPageTracker, beginPageIndex, endPageIndex - beginPageIndex);
+    }
+
+    return pointer;
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "memory.grow", I32, memory_grow, U32 deltaPages, Uptr memoryId) {
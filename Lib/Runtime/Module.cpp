@@ -39,7 +39,95 @@ static Value evaluateInitializer(const std::vector<Global *> &moduleGlobals, Ini
 
 ModuleRef Runtime::compileModule(const IR::Module &irModule) {
     std::vector<U8> objectCode = LLVMJIT::compileModule(irModule);
-    return std::make_shared<Module>(IR::Module(irModule), std::move(objectCode));
+
+    // Copy the IR without the function bodies: they aren't needed once the module is compiled.
+    IR::Module compactIR;
+    compactIR.featureSpec = irModule.featureSpec;
+    compactIR.types = irModule.types;
+    compactIR.functions.imports = irModule.functions.imports;
+    if (irModule.featureSpec.specializeInstances) {
+        compactIR.functions.defs = irModule.functions.defs;
+    } else {
+        compactIR.functions.defs.reserve(irModule.functions.defs.size());
+        for (const FunctionDef &functionDef : irModule.functions.defs) {
+            compactIR.functions.defs.push_back({functionDef.type, functionDef.nonParameterLocalTypes, {}, {}});
+        }
+    }
+    compactIR.tables = irModule.tables;
+    compactIR.memories = irModule.memories;
+    compactIR.globals = irModule.globals;
+    compactIR.exceptionTypes = irModule.exceptionTypes;
+    compactIR.exports = irModule.exports;
+    compactIR.dataSegments = irModule.dataSegments;
+    compactIR.elemSegments = irModule.elemSegments;
+    compactIR.userSections = irModule.userSections;
+    compactIR.startFunctionIndex = irModule.startFunctionIndex;
+    return std::make_shared<Module>(std::move(compactIR), std::move(objectCode));
+}
+
+ModuleRef Runtime::compileModule(IR::Module &&irModule) {
+    std::vector<U8> objectCode = LLVMJIT::compileModule(irModule);
+    return std::make_shared<Module>(std::move(irModule), std::move(objectCode));
+}
+
+Runtime::Module::Module(IR::Module &&inIR, std::shared_ptr<const std::vector<U8>> &&inObjectCode)
+        : ir(std::move(inIR)), objectCode(std::move(inObjectCode)) {
+    // Release the function bodies: they aren't needed once the module is compiled, unless the
+    // module is recompiled for each distinct set of instance values.
+    if (!ir.featureSpec.specializeInstances) {
+        for (FunctionDef &functionDef : ir.functions.defs) {
+            std::vector<U8>().swap(functionDef.code);
+            std::vector<std::vector<Uptr>>().swap(functionDef.branchTables);
+        }
+    }
+
+    // Deserialize the disassembly names once, and keep only the names of the definitions.
+    DisassemblyNames disassemblyNames;
+    getDisassemblyNames(ir, disassemblyNames);
+
+    plan.functionDefNames.reserve(ir.functions.defs.size());
+    for (Uptr functionDefIndex = 0; functionDefIndex < ir.functions.defs.size(); ++functionDefIndex) {
+        std::string &name = disassemblyNames.functions[ir.functions.imports.size() + functionDefIndex].name;
+        if (!name.size()) {
+            name = "<function #" + std::to_string(functionDefIndex) + ">";
+        }
+        plan.functionDefNames.push_back(std::move(name));
+    }
+    for (Uptr tableDefIndex = 0; tableDefIndex < ir.tables.defs.size(); ++tableDefIndex) {
+        plan.tableDefNames.push_back(std::move(disassemblyNames.tables[ir.tables.imports.size() + tableDefIndex]));
+    }
+    for (Uptr memoryDefIndex = 0; memoryDefIndex < ir.memories.defs.size(); ++memoryDefIndex) {
+        plan.memoryDefNames.push_back(std::move(disassemblyNames.memories[ir.memories.imports.size() + memoryDefIndex]));
+    }
+    for (Uptr exceptionTypeDefIndex = 0; exceptionTypeDefIndex < ir.exceptionTypes.defs.size(); ++exceptionTypeDefIndex) {
+        plan.exceptionTypeDefNames.push_back(std::move(disassemblyNames.exceptionTypes[ir.exceptionTypes.imports.size() + exceptionTypeDefIndex]));
+    }
+
+    for (Uptr segmentIndex = 0; segmentIndex < ir.dataSegments.size(); ++segmentIndex) {
+        if (!ir.dataSegments[segmentIndex].isActive) {
+            plan.passiveDataSegmentIndices.push_back(segmentIndex);
+        }
+    }
+    for (Uptr segmentIndex = 0; segmentIndex < ir.elemSegments.size(); ++segmentIndex) {
+        if (!ir.elemSegments[segmentIndex].isActive) {
+            plan.passiveElemSegmentIndices.push_back(segmentIndex);
+        }
+    }
+}
+
+// Returns the bindings for the wavmIntrinsics functions imported by compiled modules. They are the
+// same for every module instance, so they are only computed once.
+static const HashMap<std::string, LLVMJIT::FunctionBinding> &getWAVMIntrinsicsExportMap() {
+    static const HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap = [] {
+        HashMap<std::string, LLVMJIT::FunctionBinding> exportMap;
+        for (const HashMapPair<std::string, Intrinsics::Function *> &intrinsicFunctionPair :
+                Intrinsics::getUninstantiatedFunctions(INTRINSIC_MODULE_REF(wavmIntrinsics))) {
+            LLVMJIT::FunctionBinding functionBinding{intrinsicFunctionPair.value->getCallingConvention(), intrinsicFunctionPair.value->getNativeFunction()};
+            exportMap.add(intrinsicFunctionPair.key, functionBinding);
+        }
+        return exportMap;
+    }();
+    return wavmIntrinsicsExportMap;
 }
 
 ModuleInstance::~ModuleInstance() {
@@ -48,16 +136,99 @@ ModuleInstance::~ModuleInstance() {
     }
 }
 
+// The number of specializations of a module's object code that are cached. Instances with values
+// that aren't cached have their code compiled again.
+static constexpr Uptr maxSpecializedObjectCodes = 16;
+
+// Returns the module's object code specialized for an instance's tables, memories and globals,
+// compiling it if it isn't cached for the same values.
+static std::shared_ptr<const std::vector<U8>> getSpecializedObjectCode(const Runtime::Module *module, const std::vector<Table *> &tables, const std::vector<Memory *> &memories, const std::vector<Global *> &globals) {
+    LLVMJIT::InstanceSpecialization specialization;
+    specialization.tableReferenceBias = reinterpret_cast<Uptr>(getOutOfBoundsElement());
+    specialization.tableUninitializedElement = reinterpret_cast<Uptr>(getUninitializedElement());
+
+    // The key identifies the values the code is specialized for. The table reference bias and
+    // uninitialized element are the same for all instances, so they aren't part of it.
+    std::vector<U64> specializationKey;
+    for (Table *table : tables) {
+        specialization.tableIds.push_back(table->id);
+        specializationKey.push_back(table->id);
+    }
+    for (Memory *memory : memories) {
+        specialization.memoryIds.push_back(memory->id);
+        specializationKey.push_back(memory->id);
+    }
+    for (Global *global : globals) {
+        specialization.globalValues.push_back(global->initialValue);
+        if (!global->type.isMutable && !isReferenceType(global->type.valueType)) {
+            // Only the bytes of the global's type are defined, so copy them into a zeroed value to
+            // make the key.
+            UntaggedValue keyValue;
+            memcpy(keyValue.bytes, global->initialValue.bytes, getTypeByteWidth(global->type.valueType));
+            specializationKey.push_back(keyValue.v128.u64[0]);
+            specializationKey.push_back(keyValue.v128.u64[1]);
+        }
+    }
+
+    {
+        Lock<Platform::Mutex> specializedObjectCodesLock(module->specializedObjectCodesMutex);
+        if (const std::shared_ptr<const std::vector<U8>> *objectCode = module->specializedObjectCodes.get(specializationKey)) {
+            return *objectCode;
+        }
+    }
+
+    // Compile the code without holding the lock, so instantiations with other values aren't blocked
+    // by it. If another thread compiles the same specialization meanwhile, its code is used.
+    std::shared_ptr<const std::vector<U8>> objectCode = std::make_shared<const std::vector<U8>>(LLVMJIT::compileModule(module->ir, &specialization));
+
+    Lock<Platform::Mutex> specializedObjectCodesLock(module->specializedObjectCodesMutex);
+    if (const std::shared_ptr<const std::vector<U8>> *cachedObjectCode = module->specializedObjectCodes.get(specializationKey)) {
+        return *cachedObjectCode;
+    }
+    if (module->specializedObjectCodes.size() >= maxSpecializedObjectCodes) {
+        // Evict an arbitrary specialization to make room.
+        const std::vector<U64> evictedKey = (*module->specializedObjectCodes.begin()).key;
+        module->specializedObjectCodes.removeOrFail(evictedKey);
+    }
+    module->specializedObjectCodes.addOrFail(specializationKey, objectCode);
+    return objectCode;
+}
+
+// Counts an instantiation in progress in a compartment for the tracing collector, while in scope.
+struct PendingInstantiation {
+    PendingInstantiation(Compartment *inCompartment) : compartment(inCompartment) {
+        ++compartment->gcState.numPendingInstantiations;
+    }
+
+    ~PendingInstantiation() {
+        --compartment->gcState.numPendingInstantiations;
+    }
+
+private:
+    Compartment *compartment;
+};
+
 ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConstRefParam module, ImportBindings &&imports, std::string &&moduleDebugName) {
+    PendingInstantiation pendingInstantiation(compartment);
+
     Uptr id = UINTPTR_MAX;
     {
-        Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+        Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
         id = compartment->moduleInstances.add(UINTPTR_MAX, nullptr);
     }
     if (id == UINTPTR_MAX) {
         return nullptr;
     }
 
+    // Code compiled with hardware division traps or explicit bounds checks may be called from any
+    // function in the compartment, so invocations in the compartment must catch the signals its
+    // traps raise from now on. So must invocations in a compartment containing code that may use
+    // table.get or table.set, whose intrinsics raise a signal for an out-of-bounds index.
+    const bool mayAccessTables = module->ir.featureSpec.referenceTypes && module->ir.tables.size();
+    if (module->ir.featureSpec.hardwareDivideTraps || module->ir.featureSpec.explicitBoundsChecks || mayAccessTables) {
+        compartment->hasSignalTraps.store(true);
+    }
+
     // Check the type of the ModuleInstance's imports.
     std::vector<Function *> functions = std::move(imports.functions);
     errorUnless(functions.size() == module->ir.functions.imports.size());
@@ -81,6 +252,10 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
         Object *importObject = asObject(memories[importIndex]);
         errorUnless(isA(importObject, module->ir.memories.getType(importIndex)));
         errorUnless(isInCompartment(importObject, compartment));
+
+        // Memories that only reserve address space for their maximum size may only be imported by
+        // modules compiled with explicit bounds checks.
+        errorUnless(module->ir.featureSpec.explicitBoundsChecks || !memories[importIndex]->explicitBoundsChecks);
     }
 
     std::vector<Global *> globals = std::move(imports.globals);
@@ -99,19 +274,23 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
         errorUnless(isInCompartment(importObject, compartment));
     }
 
-    // Deserialize the disassembly names.
-    DisassemblyNames disassemblyNames;
-    getDisassemblyNames(module->ir, disassemblyNames);
+    const InstantiationPlan &plan = module->plan;
+    functions.reserve(functions.size() + module->ir.functions.defs.size());
+    tables.reserve(tables.size() + module->ir.tables.defs.size());
+    memories.reserve(memories.size() + module->ir.memories.defs.size());
+    globals.reserve(globals.size() + module->ir.globals.defs.size());
+    exceptionTypes.reserve(exceptionTypes.size() + module->ir.exceptionTypes.defs.size());
 
     // Instantiate the module's memory and table definitions.
     for (Uptr tableDefIndex = 0; tableDefIndex < module->ir.tables.defs.size(); ++tableDefIndex) {
-        std::string debugName = disassemblyNames.tables[module->ir.tables.imports.size() + tableDefIndex];
+        std::string debugName = plan.tableDefNames[tableDefIndex];
         auto table = createTable(compartment, module->ir.tables.defs[tableDefIndex].type, std::move(debugName));
+        table->definingModuleInstanceId = id;
         tables.push_back(table);
     }
     for (Uptr memoryDefIndex = 0; memoryDefIndex < module->ir.memories.defs.size(); ++memoryDefIndex) {
-        std::string debugName = disassemblyNames.memories[module->ir.memories.imports.size() + memoryDefIndex];
-        auto memory = createMemory(compartment, module->ir.memories.defs[memoryDefIndex].type, std::move(debugName));
+        std::string debugName = plan.memoryDefNames[memoryDefIndex];
+        auto memory = createMemory(compartment, module->ir.memories.defs[memoryDefIndex].type, std::move(debugName), module->ir.featureSpec.explicitBoundsChecks);
 
         memories.push_back(memory);
     }
@@ -127,34 +306,31 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
     for (Uptr exceptionTypeDefIndex = 0;
          exceptionTypeDefIndex < module->ir.exceptionTypes.defs.size(); ++exceptionTypeDefIndex) {
         const ExceptionTypeDef &exceptionTypeDef = module->ir.exceptionTypes.defs[exceptionTypeDefIndex];
-        std::string debugName = disassemblyNames.exceptionTypes[module->ir.exceptionTypes.imports.size() +
-                                                                exceptionTypeDefIndex];
+        std::string debugName = plan.exceptionTypeDefNames[exceptionTypeDefIndex];
+        exceptionTypes.push_back(createExceptionType(compartment, exceptionTypeDef.type, std::move(debugName)));
     }
 
     // Set up the values to bind to the symbols in the LLVMJIT object code.
-    HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap;
-    for (const HashMapPair<std::string, Intrinsics::Function *> &intrinsicFunctionPair :
-            Intrinsics::getUninstantiatedFunctions(INTRINSIC_MODULE_REF(wavmIntrinsics))) {
-        LLVMJIT::FunctionBinding functionBinding{intrinsicFunctionPair.value->getCallingConvention(), intrinsicFunctionPair.value->getNativeFunction()};
-        wavmIntrinsicsExportMap.add(intrinsicFunctionPair.key, functionBinding);
-    }
-
     std::vector<LLVMJIT::FunctionBinding> jitFunctionImports;
+    jitFunctionImports.reserve(module->ir.functions.imports.size());
     for (Uptr importIndex = 0; importIndex < module->ir.functions.imports.size(); ++importIndex) {
         jitFunctionImports.push_back({CallingConvention::wasm, const_cast<U8 *>(functions[importIndex]->code)});
     }
 
     std::vector<LLVMJIT::TableBinding> jitTables;
+    jitTables.reserve(tables.size());
     for (Table *table : tables) {
         jitTables.push_back({table->id});
     }
 
     std::vector<LLVMJIT::MemoryBinding> jitMemories;
+    jitMemories.reserve(memories.size());
     for (Memory *memory : memories) {
         jitMemories.push_back({memory->id});
     }
 
     std::vector<LLVMJIT::GlobalBinding> jitGlobals;
+    jitGlobals.reserve(globals.size());
     for (Global *global : globals) {
         LLVMJIT::GlobalBinding globalSpec;
         globalSpec.type = global->type;
@@ -167,27 +343,31 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
     }
 
     std::vector<LLVMJIT::ExceptionTypeBinding> jitExceptionTypes;
+    jitExceptionTypes.reserve(exceptionTypes.size());
     for (ExceptionType *exceptionType : exceptionTypes) {
         jitExceptionTypes.push_back({exceptionType->id});
     }
 
     // Create a FunctionMutableData for each function definition.
+    const std::string functionDebugNamePrefix = "wasm!" + moduleDebugName + '!';
     std::vector<FunctionMutableData *> functionDefMutableDatas;
-    for (Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size(); ++functionDefIndex) {
-        std::string debugName = disassemblyNames.functions[module->ir.functions.imports.size() + functionDefIndex].name;
-        if (!debugName.size()) {
-            debugName = "<function #" + std::to_string(functionDefIndex) + ">";
-        }
-        debugName = "wasm!" + moduleDebugName + '!' + debugName;
-
+    functionDefMutableDatas.reserve(module->ir.functions.defs.size());
+    for (const std::string &functionDefName : plan.functionDefNames) {
+        std::string debugName;
+        debugName.reserve(functionDebugNamePrefix.size() + functionDefName.size());
+        debugName += functionDebugNamePrefix;
+        debugName += functionDefName;
         functionDefMutableDatas.push_back(new FunctionMutableData(std::move(debugName)));
     }
 
+    // If the module specializes its instances' code, get the code for this instance.
+    std::shared_ptr<const std::vector<U8>> objectCode = module->objectCode;
+    if (module->ir.featureSpec.specializeInstances) {
+        objectCode = getSpecializedObjectCode(module.get(), tables, memories, globals);
+    }
+
     // Load the compiled module's object code with this module instance's imports.
-    std::vector<FunctionType> jitTypes = module->ir.types;
-    std::vector<Runtime::Function *> jitFunctionDefs;
-    jitFunctionDefs.resize(module->ir.functions.defs.size(), nullptr);
-    std::shared_ptr<LLVMJIT::Module> jitModule = LLVMJIT::loadModule(module->objectCode, std::move(wavmIntrinsicsExportMap), std::move(jitTypes), std::move(jitFunctionImports), std::move(jitTables), std::move(jitMemories), std::move(jitGlobals), std::move(jitExceptionTypes), {id}, reinterpret_cast<Uptr>(getOutOfBoundsElement()), functionDefMutableDatas);
+    std::shared_ptr<LLVMJIT::Module> jitModule = LLVMJIT::loadModule(*objectCode, getWAVMIntrinsicsExportMap(), module->ir.types, std::move(jitFunctionImports), std::move(jitTables), std::move(jitMemories), std::move(jitGlobals), std::move(jitExceptionTypes), {id}, reinterpret_cast<Uptr>(getOutOfBoundsElement()), reinterpret_cast<Uptr>(getUninitializedElement()), functionDefMutableDatas);
 
     // LLVMJIT::loadModule filled in the functionDefMutableDatas' function pointers with the
     // compiled functions. Add those functions to the module.
@@ -196,7 +376,7 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
     }
 
     // Set up the instance's exports.
-    HashMap<std::string, Object *> exportMap;
+    HashMap<std::string, Object *> exportMap(module->ir.exports.size());
     for (const Export &exportIt : module->ir.exports) {
         Object *exportedObject = nullptr;
         switch (exportIt.kind) {
@@ -221,24 +401,22 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
         exportMap.addOrFail(exportIt.name, exportedObject);
     }
 
-    // Copy the module's passive data and table segments into the ModuleInstance for later use.
-    PassiveDataSegmentMap passiveDataSegments;
-    PassiveElemSegmentMap passiveElemSegments;
-    for (Uptr segmentIndex = 0; segmentIndex < module->ir.dataSegments.size(); ++segmentIndex) {
-        const DataSegment &dataSegment = module->ir.dataSegments[segmentIndex];
-        if (!dataSegment.isActive) {
-            passiveDataSegments.add(segmentIndex, std::make_shared<std::vector<U8>>(dataSegment.data));
-        }
+    // Give the ModuleInstance the module's passive data and table segments for later use. The
+    // passive data segments alias the module's immutable segment bytes, and keep the module alive
+    // for as long as the instance references them.
+    PassiveDataSegmentMap passiveDataSegments(plan.passiveDataSegmentIndices.size());
+    PassiveElemSegmentMap passiveElemSegments(plan.passiveElemSegmentIndices.size());
+    for (Uptr segmentIndex : plan.passiveDataSegmentIndices) {
+        passiveDataSegments.add(segmentIndex, std::shared_ptr<const std::vector<U8>>(module, &module->ir.dataSegments[segmentIndex].data));
     }
-    for (Uptr segmentIndex = 0; segmentIndex < module->ir.elemSegments.size(); ++segmentIndex) {
+    for (Uptr segmentIndex : plan.passiveElemSegmentIndices) {
         const ElemSegment &elemSegment = module->ir.elemSegments[segmentIndex];
-        if (!elemSegment.isActive) {
-            auto passiveElemSegmentObjects = std::make_shared<std::vector<Object *>>();
-            for (Uptr functionIndex : elemSegment.indices) {
-                passiveElemSegmentObjects->push_back(asObject(functions[functionIndex]));
-            }
-            passiveElemSegments.add(segmentIndex, passiveElemSegmentObjects);
+        auto passiveElemSegmentObjects = std::make_shared<std::vector<Object *>>();
+        passiveElemSegmentObjects->reserve(elemSegment.indices.size());
+        for (Uptr functionIndex : elemSegment.indices) {
+            passiveElemSegmentObjects->push_back(asObject(functions[functionIndex]));
         }
+        passiveElemSegments.add(segmentIndex, passiveElemSegmentObjects);
     }
 
     // Look up the module's start function.
@@ -251,9 +429,10 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
     // Create the ModuleInstance and add it to the compartment's modules list.
     ModuleInstance *moduleInstance = new ModuleInstance(compartment, id, std::move(exportMap), std::move(functions), std::move(tables), std::move(memories), std::move(globals), std::move(exceptionTypes), startFunction, std::move(passiveDataSegments), std::move(passiveElemSegments), std::move(jitModule), std::move(moduleDebugName));
     {
-        Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+        Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
         compartment->moduleInstances[id] = moduleInstance;
     }
+    addModuleInstanceReferences(moduleInstance);
 
     // Copy the module's data segments into their designated memory instances.
     for (const DataSegment &dataSegment : module->ir.dataSegments) {
@@ -294,6 +473,58 @@ ModuleInstance *Runtime::instantiateModule(Compartment *compartment, ModuleConst
     return moduleInstance;
 }
 
+ModuleInstance *Runtime::cloneModuleInstance(ModuleInstance *moduleInstance, Compartment *newCompartment) {
+    // Remap the module's references to objects in the original compartment to the corresponding
+    // objects in the new compartment.
+    HashMap<std::string, Object *> newExportMap;
+    for (const auto &pair : moduleInstance->exportMap) {
+        newExportMap.addOrFail(pair.key, remapToClonedCompartment(pair.value, newCompartment));
+    }
+    std::vector<Function *> newFunctions = moduleInstance->functions;
+    std::vector<Table *> newTables;
+    for (Table *table : moduleInstance->tables) {
+        newTables.push_back(remapToClonedCompartment(table, newCompartment));
+    }
+    std::vector<Memory *> newMemories;
+    for (Memory *memory : moduleInstance->memories) {
+        newMemories.push_back(remapToClonedCompartment(memory, newCompartment));
+    }
+    std::vector<Global *> newGlobals;
+    for (Global *global : moduleInstance->globals) {
+        newGlobals.push_back(remapToClonedCompartment(global, newCompartment));
+    }
+    std::vector<ExceptionType *> newExceptionTypes;
+    for (ExceptionType *exceptionType : moduleInstance->exceptionTypes) {
+        newExceptionTypes.push_back(remapToClonedCompartment(exceptionType, newCompartment));
+    }
+
+    // The passive segments are immutable, and passive elem segments only contain functions, which
+    // are shared between compartments, so the segments can be shared with the original instance.
+    PassiveDataSegmentMap newPassiveDataSegments;
+    {
+        Lock<Platform::Mutex> passiveDataSegmentsLock(moduleInstance->passiveDataSegmentsMutex);
+        newPassiveDataSegments = moduleInstance->passiveDataSegments;
+    }
+    PassiveElemSegmentMap newPassiveElemSegments;
+    {
+        Lock<Platform::Mutex> passiveElemSegmentsLock(moduleInstance->passiveElemSegmentsMutex);
+        newPassiveElemSegments = moduleInstance->passiveElemSegments;
+    }
+
+    // The compiled code only refers to the module instance and its objects by ID, so the clone can
+    // share the original instance's JIT module.
+    std::shared_ptr<LLVMJIT::Module> jitModule = moduleInstance->jitModule;
+    std::string debugName = moduleInstance->debugName;
+
+    ModuleInstance *newModuleInstance = new ModuleInstance(newCompartment, moduleInstance->id, std::move(newExportMap), std::move(newFunctions), std::move(newTables), std::move(newMemories), std::move(newGlobals), std::move(newExceptionTypes), moduleInstance->startFunction, std::move(newPassiveDataSegments), std::move(newPassiveElemSegments), std::move(jitModule), std::move(debugName));
+    newModuleInstance->hasUncountedReferences.store(moduleInstance->hasUncountedReferences.load(std::memory_order_acquire), std::memory_order_release);
+    {
+        Lock<Platform::Mutex> moduleInstancesLock(newCompartment->moduleInstancesMutex);
+        newCompartment->moduleInstances.insertOrFail(newModuleInstance->id, newModuleInstance);
+    }
+    return newModuleInstance;
+}
+
 Function *Runtime::getStartFunction(ModuleInstance *moduleInstance) {
     return moduleInstance->startFunction;
 }
@@ -1,8 +1,8 @@
-#include <inttypes.h>
+#include <algorithm>
 #include <atomic>
+#include <thread>
 #include <utility>
 #include <vector>
-#include <iostream>
 
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/Lock.h"
@@ -10,8 +10,75 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
+// Functions that were rooted while any compartment was being marked. Functions may be shared by
+// several compartments, so addGCRoot can't tell which compartment to mark them in: each collector
+// checks which of them are in its compartment when it finishes marking.
+static Platform::Mutex newFunctionRootsMutex;
+static std::vector<Function *> newFunctionRoots;
+static std::atomic<Uptr> numMarkingCompartments{0};
+
+// The kinds of objects in a compartment, in the order the root scan and sweep visit them. Module
+// instances are first, so the references they hold are released before the objects they refer to
+// are swept.
+enum {
+    numGCObjectKinds = 6
+};
+
+static bool isMarking(const IncrementalGCState &gcState) {
+    const GCPhase phase = gcState.phase.load(std::memory_order_acquire);
+    return phase == GCPhase::scanningRoots || phase == GCPhase::marking;
+}
+
 Runtime::GCObject::GCObject(ObjectKind inKind, Compartment *inCompartment)
-        : Object{inKind}, compartment(inCompartment), numRootReferences(0) {
+        : Object{inKind}, compartment(inCompartment), numRootReferences(0),
+          gcMarkEpoch(inKind == ObjectKind::compartment ? 0
+                                                        : inCompartment->gcState.epoch.load(std::memory_order_acquire)) {
+}
+
+// Returns the module instance in the compartment that contains the function, or null. The caller
+// must not hold the compartment's moduleInstancesMutex.
+static ModuleInstance *getFunctionModuleInstance(Compartment *compartment, Function *function) {
+    if (function->moduleInstanceId == UINTPTR_MAX) {
+        return nullptr;
+    }
+
+    Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
+    if (!compartment->moduleInstances.contains(function->moduleInstanceId)) {
+        return nullptr;
+    }
+    ModuleInstance *moduleInstance = compartment->moduleInstances[function->moduleInstanceId];
+    return moduleInstance && moduleInstance->jitModule.get() == function->mutableData->jitModule ? moduleInstance
+                                                                                                : nullptr;
+}
+
+// Marks an object, and queues it to have its references scanned. Functions mark their module
+// instance. The caller must hold the compartment's GC mutex, and not its moduleInstancesMutex.
+static void markObject(Compartment *compartment, Object *object) {
+    if (!object) {
+        return;
+    }
+
+    GCObject *gcObject;
+    if (object->kind == ObjectKind::function) {
+        gcObject = getFunctionModuleInstance(compartment, asFunction(object));
+        if (!gcObject) {
+            return;
+        }
+    } else if (object->kind == ObjectKind::compartment) {
+        // The compartment isn't collected by the tracing collector: it's deleted once it has no
+        // roots and no objects.
+        return;
+    } else {
+        gcObject = (GCObject *) object;
+    }
+    wavmAssert(gcObject->compartment == compartment);
+
+    IncrementalGCState &gcState = compartment->gcState;
+    const Uptr epoch = gcState.epoch.load(std::memory_order_acquire);
+    if (gcObject->gcMarkEpoch != epoch) {
+        gcObject->gcMarkEpoch = epoch;
+        gcState.greyObjects.push_back(gcObject);
+    }
 }
 
 void Runtime::addGCRoot(Object *object) {
@@ -19,185 +86,597 @@ void Runtime::addGCRoot(Object *object) {
         Function *function = (Function *) object;
         wavmAssert(function->mutableData);
         ++function->mutableData->numRootReferences;
+
+        if (numMarkingCompartments.load()) {
+            Lock<Platform::Mutex> newFunctionRootsLock(newFunctionRootsMutex);
+            newFunctionRoots.push_back(function);
+        }
     } else {
         GCObject *gcObject = (GCObject *) object;
         ++gcObject->numRootReferences;
+
+        // If the collector is marking the compartment, mark the newly rooted object.
+        IncrementalGCState &gcState = gcObject->compartment->gcState;
+        if (isMarking(gcState)) {
+            Lock<Platform::Mutex> gcLock(gcState.mutex);
+            if (isMarking(gcState)) {
+                markObject(gcObject->compartment, gcObject);
+            }
+        }
     }
 }
 
-void Runtime::removeGCRoot(Object *object) {
+void Runtime::addUncountedReference(Compartment *compartment, Object *object, Uptr referrerModuleInstanceId) {
     if (object->kind == ObjectKind::function) {
         Function *function = (Function *) object;
-        wavmAssert(function->mutableData);
-        --function->mutableData->numRootReferences;
+        if (function->moduleInstanceId == UINTPTR_MAX) {
+            return;
+        }
+        if (function->moduleInstanceId != referrerModuleInstanceId &&
+            !function->mutableData->hasUncountedReferences.load(std::memory_order_acquire)) {
+            function->mutableData->hasUncountedReferences.store(true, std::memory_order_release);
+        }
     } else {
         GCObject *gcObject = (GCObject *) object;
-        --gcObject->numRootReferences;
+        if (!gcObject->hasUncountedReferences.load(std::memory_order_acquire)) {
+            gcObject->hasUncountedReferences.store(true, std::memory_order_release);
+        }
+    }
+
+    // If the collector is marking the compartment, mark the referenced object: the collector may
+    // have already scanned the object the reference is being stored in.
+    IncrementalGCState &gcState = compartment->gcState;
+    if (isMarking(gcState)) {
+        Lock<Platform::Mutex> gcLock(gcState.mutex);
+        if (isMarking(gcState)) {
+            markObject(compartment, object);
+        }
     }
 }
 
-struct GCState {
-    Compartment *compartment;
-    HashSet<GCObject *> unreferencedObjects;
-    std::vector<GCObject *> pendingScanObjects;
+void Runtime::addModuleInstanceReferences(ModuleInstance *moduleInstance) {
+    Compartment *compartment = moduleInstance->compartment;
+    IncrementalGCState &gcState = compartment->gcState;
+    Lock<Platform::Mutex> gcLock(gcState.mutex);
+
+    // The instance was created marked if the collector is marking the compartment, so the objects
+    // it references must be marked as well.
+    const bool marking = isMarking(gcState);
+    auto addReference = [&](GCObject *object) {
+        ++object->numObjectReferences;
+        if (marking) {
+            markObject(compartment, object);
+        }
+    };
 
-    GCState(Compartment *inCompartment) : compartment(inCompartment) {
+    for (Table *table : moduleInstance->tables) {
+        addReference(table);
+    }
+    for (Memory *memory : moduleInstance->memories) {
+        addReference(memory);
+    }
+    for (Global *global : moduleInstance->globals) {
+        addReference(global);
+    }
+    for (ExceptionType *exceptionType : moduleInstance->exceptionTypes) {
+        addReference(exceptionType);
     }
 
-    void visitReference(Object *object) {
-        if (object) {
-            if (object->kind == ObjectKind::function) {
-                Function *function = asFunction(object);
-                if (function->moduleInstanceId != UINTPTR_MAX) {
-                    wavmAssert(compartment->moduleInstances.contains(function->moduleInstanceId));
-                    ModuleInstance *moduleInstance = compartment->moduleInstances[function->moduleInstanceId];
-                    visitReference(moduleInstance);
-                }
-            } else if (unreferencedObjects.remove((GCObject *) object)) {
-                pendingScanObjects.push_back((GCObject *) object);
+    // Reference each module instance that the instance imports functions from once.
+    {
+        Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
+        for (Function *function : moduleInstance->functions) {
+            if (function->moduleInstanceId == UINTPTR_MAX || function->moduleInstanceId == moduleInstance->id ||
+                !compartment->moduleInstances.contains(function->moduleInstanceId)) {
+                continue;
+            }
+
+            ModuleInstance *importedModuleInstance = compartment->moduleInstances[function->moduleInstanceId];
+            if (importedModuleInstance &&
+                std::find(moduleInstance->importedModuleInstances.begin(), moduleInstance->importedModuleInstances.end(), importedModuleInstance) == moduleInstance->importedModuleInstances.end()) {
+                moduleInstance->importedModuleInstances.push_back(importedModuleInstance);
             }
         }
     }
+    for (ModuleInstance *importedModuleInstance : moduleInstance->importedModuleInstances) {
+        addReference(importedModuleInstance);
+    }
 
-    template<typename Array> void visitReferenceArray(const Array &array) {
-        for (auto reference : array) {
-            visitReference(asObject(reference));
+    // WebAssembly code may store references to the instance's functions in its mutable
+    // reference-typed globals without a write barrier, so if it has any, its functions are treated
+    // as having uncounted references.
+    bool hasMutableReferenceGlobal = false;
+    for (Global *global : moduleInstance->globals) {
+        if (global->type.isMutable && isReferenceType(global->type.valueType)) {
+            hasMutableReferenceGlobal = true;
+            break;
+        }
+    }
+    if (hasMutableReferenceGlobal) {
+        for (Function *function : moduleInstance->functions) {
+            if (function->moduleInstanceId == moduleInstance->id) {
+                function->mutableData->hasUncountedReferences.store(true, std::memory_order_release);
+            }
         }
     }
+}
 
-    void initGCObject(GCObject *object, bool forceRoot = false) {
-        if (forceRoot || object->numRootReferences > 0) {
-            pendingScanObjects.push_back(object);
-        } else {
-            unreferencedObjects.add(object);
+// Releases the counted references held by a module instance that is about to be deleted. Objects
+// whose last counted reference was released are added to releasedObjects.
+static void removeModuleInstanceReferences(ModuleInstance *moduleInstance, std::vector<GCObject *> &releasedObjects) {
+    auto removeReference = [&](GCObject *object) {
+        if (--object->numObjectReferences == 0) {
+            releasedObjects.push_back(object);
         }
+    };
+
+    for (Table *table : moduleInstance->tables) {
+        removeReference(table);
+    }
+    for (Memory *memory : moduleInstance->memories) {
+        removeReference(memory);
+    }
+    for (Global *global : moduleInstance->globals) {
+        removeReference(global);
+    }
+    for (ExceptionType *exceptionType : moduleInstance->exceptionTypes) {
+        removeReference(exceptionType);
+    }
+    for (ModuleInstance *importedModuleInstance : moduleInstance->importedModuleInstances) {
+        removeReference(importedModuleInstance);
     }
+    moduleInstance->importedModuleInstances.clear();
+}
 
-    void scanObject(GCObject *object) {
-        wavmAssert(!object->compartment || object->compartment == compartment);
-        visitReference(object->compartment);
+// Returns whether all of an object's references are counted, and none remain.
+static bool isUnreferenced(GCObject *object) {
+    if (object->numRootReferences.load(std::memory_order_acquire) ||
+        object->numObjectReferences.load(std::memory_order_acquire) ||
+        object->hasUncountedReferences.load(std::memory_order_acquire)) {
+        return false;
+    }
 
-        // Gather the child references for this object based on its kind.
-        switch (object->kind) {
-            case ObjectKind::table: {
-                Table *table = asTable(object);
+    if (object->kind == ObjectKind::moduleInstance) {
+        ModuleInstance *moduleInstance = asModuleInstance(object);
 
-                Lock<Platform::Mutex> resizingLock(table->resizingMutex);
-                const Uptr numElements = getTableNumElements(table);
-                for (Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex) {
-                    visitReference(getTableElement(table, elementIndex));
-                }
-                break;
-            }
-            case ObjectKind::global: {
-                Global *global = asGlobal(object);
-                if (isReferenceType(global->type.valueType)) {
-                    if (global->type.isMutable) {
-                        visitReference(compartment->initialContextMutableGlobals[global->mutableGlobalIndex].object);
-                        for (Context *context : compartment->contexts) {
-                            visitReference(context->runtimeData->mutableGlobals[global->mutableGlobalIndex].object);
-                        }
-                    }
-                    visitReference(global->initialValue.object);
-                }
-                break;
+        // The instance's functions may be referenced directly.
+        for (Function *function : moduleInstance->functions) {
+            if (function->moduleInstanceId == moduleInstance->id &&
+                (function->mutableData->numRootReferences.load(std::memory_order_acquire) ||
+                 function->mutableData->hasUncountedReferences.load(std::memory_order_acquire))) {
+                return false;
             }
-            case ObjectKind::moduleInstance: {
-                ModuleInstance *moduleInstance = asModuleInstance(object);
-                visitReferenceArray(moduleInstance->functions);
-                visitReferenceArray(moduleInstance->tables);
-                visitReferenceArray(moduleInstance->memories);
-                visitReferenceArray(moduleInstance->globals);
-                visitReferenceArray(moduleInstance->exceptionTypes);
-
-                {
-                    Lock<Platform::Mutex> passiveElemSegmentLock(moduleInstance->passiveElemSegmentsMutex);
-                    for (const auto &passiveElemSegmentPair : moduleInstance->passiveElemSegments) {
-                        visitReferenceArray(*passiveElemSegmentPair.value);
-                    }
-                }
+        }
 
-                break;
+        // The tables the instance defined may contain its functions, so they must be deleted with
+        // it: they may only be referenced by the instance.
+        for (Table *table : moduleInstance->tables) {
+            if (table->definingModuleInstanceId == moduleInstance->id &&
+                (table->numRootReferences.load(std::memory_order_acquire) ||
+                 table->hasUncountedReferences.load(std::memory_order_acquire) ||
+                 table->numObjectReferences.load(std::memory_order_acquire) !=
+                         Uptr(std::count(moduleInstance->tables.begin(), moduleInstance->tables.end(), table)))) {
+                return false;
             }
-            case ObjectKind::compartment: {
-                wavmAssert(object == compartment);
-                break;
+        }
+    }
+
+    return true;
+}
+
+// Deletes an object, holding the compartment mutex for its kind.
+static void deleteGCObject(Compartment *compartment, GCObject *object) {
+    switch (object->kind) {
+        case ObjectKind::table: {
+            Lock<Platform::Mutex> tablesLock(compartment->tablesMutex);
+            delete object;
+            break;
+        }
+        case ObjectKind::memory: {
+            Lock<Platform::Mutex> memoriesLock(compartment->memoriesMutex);
+            delete object;
+            break;
+        }
+        case ObjectKind::global: {
+            Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
+            delete object;
+            break;
+        }
+        case ObjectKind::exceptionType: {
+            Lock<Platform::Mutex> exceptionTypesLock(compartment->exceptionTypesMutex);
+            delete object;
+            break;
+        }
+        case ObjectKind::moduleInstance: {
+            Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
+            delete object;
+            break;
+        }
+        case ObjectKind::context: {
+            Lock<Platform::Mutex> contextsLock(compartment->contextsMutex);
+            delete object;
+            break;
+        }
+        default:
+            Errors::unreachable();
+    };
+}
+
+// Deletes the released objects that are unreferenced, and the objects that were only referenced by
+// them. While the tracing collector is running, the objects are deleted when it completes. The
+// caller must hold the compartment's GC mutex.
+static void deleteReleasedObjects(Compartment *compartment, std::vector<GCObject *> &&releasedObjects) {
+    IncrementalGCState &gcState = compartment->gcState;
+    while (releasedObjects.size()) {
+        GCObject *object = releasedObjects.back();
+        releasedObjects.pop_back();
+
+        if (!isUnreferenced(object)) {
+            continue;
+        } else if (gcState.phase.load(std::memory_order_acquire) != GCPhase::idle) {
+            gcState.deferredReleases.add(object);
+            continue;
+        }
+
+        if (object->kind == ObjectKind::moduleInstance) {
+            removeModuleInstanceReferences(asModuleInstance(object), releasedObjects);
+        }
+        deleteGCObject(compartment, object);
+    }
+}
+
+// Deletes the compartment if it has no roots and no objects, and returns whether it was deleted.
+static bool tryDeleteEmptyCompartment(Compartment *compartment) {
+    {
+        Lock<const Compartment> compartmentLock(*compartment);
+        if (compartment->numRootReferences.load(std::memory_order_acquire) ||
+            compartment->gcState.phase.load(std::memory_order_acquire) != GCPhase::idle ||
+            compartment->moduleInstances.size() || compartment->tables.size() || compartment->memories.size() ||
+            compartment->globals.size() || compartment->exceptionTypes.size() || compartment->contexts.size()) {
+            return false;
+        }
+    }
+
+    delete compartment;
+    return true;
+}
+
+void Runtime::removeGCRoot(Object *object) {
+    if (object->kind == ObjectKind::function) {
+        // Functions may be shared by cloned compartments, so removing the last root reference to a
+        // function doesn't delete its module instance: the instance is deleted when its own last
+        // reference is removed, or by the tracing collector.
+        Function *function = (Function *) object;
+        wavmAssert(function->mutableData);
+        --function->mutableData->numRootReferences;
+    } else {
+        GCObject *gcObject = (GCObject *) object;
+        if (--gcObject->numRootReferences == 0) {
+            Compartment *compartment = gcObject->compartment;
+            if (gcObject->kind == ObjectKind::compartment) {
+                tryDeleteEmptyCompartment(compartment);
+            } else {
+                Lock<Platform::Mutex> gcLock(compartment->gcState.mutex);
+                deleteReleasedObjects(compartment, {gcObject});
             }
+        }
+    }
+}
 
-            case ObjectKind::memory:
-            case ObjectKind::exceptionType:
-            case ObjectKind::context:
-                break;
+// Visits the objects of one kind from the collector's cursor, until the budget is exhausted.
+// Returns true if all objects of the kind were visited.
+template<typename Element, typename Visit>
+static bool visitIndexMapFromCursor(IncrementalGCState &gcState, Platform::Mutex &mutex, IndexMap<Uptr, Element *> &objects, Uptr &budget, Visit &&visit) {
+    Lock<Platform::Mutex> objectsLock(mutex);
+    auto objectIt = objects.lowerBound(gcState.cursorObjectIndex);
+    while (objectIt && budget) {
+        // Advance the iterator before visiting the object, since the visitor may delete it.
+        Element *object = *objectIt;
+        gcState.cursorObjectIndex = objectIt.getIndex() + 1;
+        ++objectIt;
+
+        // Module instances are added to the map as null before they are created.
+        if (object) {
+            visit(object);
+        }
+        --budget;
+    }
+    return !objectIt;
+}
 
-            case ObjectKind::function:
+// Visits the compartment's objects from the collector's cursor, until the budget is exhausted.
+// Returns true if all objects were visited.
+template<typename Visit> static bool visitObjectsFromCursor(Compartment *compartment, Uptr &budget, Visit &&visit) {
+    IncrementalGCState &gcState = compartment->gcState;
+    while (budget && gcState.cursorKindIndex < numGCObjectKinds) {
+        bool visitedAllObjectsOfKind = false;
+        switch (gcState.cursorKindIndex) {
+            case 0:
+                visitedAllObjectsOfKind = visitIndexMapFromCursor(gcState, compartment->moduleInstancesMutex, compartment->moduleInstances, budget, visit);
+                break;
+            case 1:
+                visitedAllObjectsOfKind = visitIndexMapFromCursor(gcState, compartment->tablesMutex, compartment->tables, budget, visit);
+                break;
+            case 2:
+                visitedAllObjectsOfKind = visitIndexMapFromCursor(gcState, compartment->memoriesMutex, compartment->memories, budget, visit);
+                break;
+            case 3:
+                visitedAllObjectsOfKind = visitIndexMapFromCursor(gcState, compartment->globalsMutex, compartment->globals, budget, visit);
+                break;
+            case 4:
+                visitedAllObjectsOfKind = visitIndexMapFromCursor(gcState, compartment->exceptionTypesMutex, compartment->exceptionTypes, budget, visit);
+                break;
+            case 5:
+                visitedAllObjectsOfKind = visitIndexMapFromCursor(gcState, compartment->contextsMutex, compartment->contexts, budget, visit);
+                break;
             default:
                 Errors::unreachable();
         };
+
+        if (visitedAllObjectsOfKind) {
+            ++gcState.cursorKindIndex;
+            gcState.cursorObjectIndex = 0;
+        }
     }
-};
+    return gcState.cursorKindIndex == numGCObjectKinds;
+}
 
-static bool collectGarbageImpl(Compartment *compartment) {
-    Lock<Platform::Mutex> compartmentLock(compartment->mutex);
-    GCState state(compartment);
+static void resetCursor(IncrementalGCState &gcState) {
+    gcState.cursorKindIndex = 0;
+    gcState.cursorObjectIndex = 0;
+}
 
-    // Initialize the GC state from the compartment's various sets of objects.
-    state.initGCObject(compartment);
-    for (ModuleInstance *moduleInstance : compartment->moduleInstances) {
-        // Transfer root markings from functions to their module instance.
-        bool hasRootFunction = false;
-        for (Function *function : moduleInstance->functions) {
-            if (function->mutableData->numRootReferences) {
-                hasRootFunction = true;
-                break;
+static bool isRoot(GCObject *object) {
+    if (object->numRootReferences.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    // Transfer root markings from functions to their module instance.
+    if (object->kind == ObjectKind::moduleInstance) {
+        for (Function *function : asModuleInstance(object)->functions) {
+            if (function->mutableData->numRootReferences.load(std::memory_order_acquire)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Returns the values of a mutable global in the compartment's contexts, and the value used to
+// initialize new contexts.
+static void getMutableGlobalValues(Compartment *compartment, Global *global, std::vector<Object *> &outObjects) {
+    Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
+    Lock<Platform::Mutex> contextsLock(compartment->contextsMutex);
+    outObjects.push_back(compartment->initialContextMutableGlobals[global->mutableGlobalIndex].object);
+    for (Context *context : compartment->contexts) {
+        outObjects.push_back(context->runtimeData->mutableGlobals[global->mutableGlobalIndex].object);
+    }
+}
+
+// Marks the objects referenced by a marked object, and returns the amount of work done.
+static Uptr scanObject(Compartment *compartment, GCObject *object) {
+    wavmAssert(object->compartment == compartment);
+
+    // Gather the child references for this object based on its kind. References to functions are
+    // gathered before marking them, since marking a function locks the compartment's
+    // moduleInstancesMutex.
+    std::vector<Object *> childObjects;
+    switch (object->kind) {
+        case ObjectKind::table: {
+            Table *table = asTable(object);
+
+            Lock<Platform::Mutex> resizingLock(table->resizingMutex);
+            const Uptr numElements = getTableNumElements(table);
+            childObjects.reserve(numElements);
+            for (Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex) {
+                Object *element = getTableElement(table, elementIndex);
+
+                // Skip runs of functions from the same module instance.
+                if (element && childObjects.size() && element->kind == ObjectKind::function &&
+                    childObjects.back()->kind == ObjectKind::function &&
+                    asFunction(element)->moduleInstanceId == asFunction(childObjects.back())->moduleInstanceId) {
+                    continue;
+                }
+                if (element) {
+                    childObjects.push_back(element);
+                }
             }
+            break;
         }
+        case ObjectKind::global: {
+            Global *global = asGlobal(object);
+            if (isReferenceType(global->type.valueType)) {
+                if (global->type.isMutable) {
+                    getMutableGlobalValues(compartment, global, childObjects);
+                }
+                childObjects.push_back(global->initialValue.object);
+            }
+            break;
+        }
+        case ObjectKind::moduleInstance: {
+            // The instance's passive elem segments only contain its own functions and the functions
+            // it imports, so they don't need to be scanned.
+            ModuleInstance *moduleInstance = asModuleInstance(object);
+            childObjects.insert(childObjects.end(), moduleInstance->tables.begin(), moduleInstance->tables.end());
+            childObjects.insert(childObjects.end(), moduleInstance->memories.begin(), moduleInstance->memories.end());
+            childObjects.insert(childObjects.end(), moduleInstance->globals.begin(), moduleInstance->globals.end());
+            childObjects.insert(childObjects.end(), moduleInstance->exceptionTypes.begin(), moduleInstance->exceptionTypes.end());
+            childObjects.insert(childObjects.end(), moduleInstance->importedModuleInstances.begin(), moduleInstance->importedModuleInstances.end());
+            break;
+        }
+
+        case ObjectKind::memory:
+        case ObjectKind::exceptionType:
+        case ObjectKind::context:
+            break;
+
+        case ObjectKind::compartment:
+        case ObjectKind::function:
+        default:
+            Errors::unreachable();
+    };
 
-        state.initGCObject(moduleInstance, hasRootFunction);
+    for (Object *childObject : childObjects) {
+        markObject(compartment, childObject);
     }
-    for (Memory *memory : compartment->memories) {
-        state.initGCObject(memory);
+    return 1 + childObjects.size();
+}
+
+// Marks the roots that may have been added without being seen by the root scan or the write
+// barrier, and returns whether marking is complete.
+static bool finishMarking(Compartment *compartment) {
+    IncrementalGCState &gcState = compartment->gcState;
+
+    // Mark the functions that were rooted since marking started.
+    std::vector<Function *> functionRoots;
+    {
+        Lock<Platform::Mutex> newFunctionRootsLock(newFunctionRootsMutex);
+        functionRoots = newFunctionRoots;
     }
-    for (Table *table : compartment->tables) {
-        state.initGCObject(table);
+    for (Function *function : functionRoots) {
+        if (function->mutableData->numRootReferences.load(std::memory_order_acquire)) {
+            markObject(compartment, asObject(function));
+        }
     }
-    for (ExceptionType *exceptionType : compartment->exceptionTypes) {
-        state.initGCObject(exceptionType);
+
+    // WebAssembly code writes mutable globals without a write barrier, so rescan the values of the
+    // marked reference-typed mutable globals.
+    std::vector<Global *> markedMutableReferenceGlobals;
+    {
+        const Uptr epoch = gcState.epoch.load(std::memory_order_acquire);
+        Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
+        for (Global *global : compartment->globals) {
+            if (global->gcMarkEpoch == epoch && global->type.isMutable && isReferenceType(global->type.valueType)) {
+                markedMutableReferenceGlobals.push_back(global);
+            }
+        }
     }
-    for (Global *global : compartment->globals) {
-        state.initGCObject(global);
+    std::vector<Object *> globalValues;
+    for (Global *global : markedMutableReferenceGlobals) {
+        getMutableGlobalValues(compartment, global, globalValues);
     }
-    for (Context *context : compartment->contexts) {
-        state.initGCObject(context);
+    for (Object *object : globalValues) {
+        markObject(compartment, object);
     }
 
-    // Scan the objects added to the referenced set so far: gather their child references and
-    // recurse.
-    const Uptr numInitialObjects = state.pendingScanObjects.size() + state.unreferencedObjects.size();
-    const Uptr numRoots = state.pendingScanObjects.size();
-    while (state.pendingScanObjects.size()) {
-        GCObject *object = state.pendingScanObjects.back();
-        state.pendingScanObjects.pop_back();
-        state.scanObject(object);
-    };
+    // Objects created for an instantiation in progress may not be referenced by anything yet, so
+    // don't sweep until it completes.
+    return !gcState.greyObjects.size() && !gcState.numPendingInstantiations.load(std::memory_order_acquire);
+}
 
-    // Delete each unreferenced object that isn't the compartment.
-    bool wasCompartmentUnreferenced = false;
-    for (GCObject *object : state.unreferencedObjects) {
-        if (object == compartment) {
-            wasCompartmentUnreferenced = true;
-        } else {
-            delete object;
-        }
-    }
+// Runs the collector until it does maxWorkUnits of work or completes a collection. Returns true if
+// a collection was completed.
+static bool collectGarbageSlice(Compartment *compartment, Uptr maxWorkUnits) {
+    IncrementalGCState &gcState = compartment->gcState;
+    Lock<Platform::Mutex> gcLock(gcState.mutex);
+
+    Uptr budget = maxWorkUnits;
+    while (budget) {
+        switch (gcState.phase.load(std::memory_order_acquire)) {
+            case GCPhase::idle: {
+                // Start a new collection. Objects are unmarked by advancing the epoch, and objects
+                // created from here on are created marked.
+                ++gcState.epoch;
+                resetCursor(gcState);
+                ++numMarkingCompartments;
+                gcState.phase.store(GCPhase::scanningRoots, std::memory_order_release);
+                break;
+            }
+            case GCPhase::scanningRoots: {
+                if (visitObjectsFromCursor(compartment, budget, [compartment](GCObject *object) {
+                        if (isRoot(object)) {
+                            markObject(compartment, object);
+                        }
+                    })) {
+                    gcState.phase.store(GCPhase::marking, std::memory_order_release);
+                }
+                break;
+            }
+            case GCPhase::marking: {
+                if (gcState.greyObjects.size()) {
+                    GCObject *object = gcState.greyObjects.back();
+                    gcState.greyObjects.pop_back();
+                    const Uptr workUnits = scanObject(compartment, object);
+                    budget -= std::min(budget, workUnits);
+                } else if (finishMarking(compartment)) {
+                    resetCursor(gcState);
+                    gcState.phase.store(GCPhase::releasingReferences, std::memory_order_release);
 
-    // Delete the compartment last, if it wasn't referenced.
-    compartmentLock.unlock();
-    if (wasCompartmentUnreferenced) {
-        delete compartment;
+                    if (--numMarkingCompartments == 0) {
+                        Lock<Platform::Mutex> newFunctionRootsLock(newFunctionRootsMutex);
+                        newFunctionRoots.clear();
+                    }
+                } else if (!gcState.greyObjects.size()) {
+                    // Wait for the instantiations in progress to complete.
+                    return false;
+                }
+                break;
+            }
+            case GCPhase::releasingReferences: {
+                // Release the references held by unmarked module instances before deleting any
+                // unmarked objects, so no reference to a deleted object is released.
+                const Uptr epoch = gcState.epoch.load(std::memory_order_acquire);
+                HashSet<GCObject *> &deferredReleases = gcState.deferredReleases;
+                if (visitIndexMapFromCursor(gcState, compartment->moduleInstancesMutex, compartment->moduleInstances, budget, [epoch, &deferredReleases](ModuleInstance *moduleInstance) {
+                        if (moduleInstance->gcMarkEpoch != epoch) {
+                            std::vector<GCObject *> releasedObjects;
+                            removeModuleInstanceReferences(moduleInstance, releasedObjects);
+                            for (GCObject *releasedObject : releasedObjects) {
+                                if (releasedObject->gcMarkEpoch == epoch) {
+                                    deferredReleases.add(releasedObject);
+                                }
+                            }
+                        }
+                    })) {
+                    resetCursor(gcState);
+                    gcState.phase.store(GCPhase::sweeping, std::memory_order_release);
+                }
+                break;
+            }
+            case GCPhase::sweeping: {
+                const Uptr epoch = gcState.epoch.load(std::memory_order_acquire);
+                HashSet<GCObject *> &deferredReleases = gcState.deferredReleases;
+                if (visitObjectsFromCursor(compartment, budget, [epoch, &deferredReleases](GCObject *object) {
+                        if (object->gcMarkEpoch != epoch) {
+                            deferredReleases.remove(object);
+                            delete object;
+                        }
+                    })) {
+                    gcState.phase.store(GCPhase::idle, std::memory_order_release);
+
+                    // Delete the objects that were released during the collection and weren't swept,
+                    // if they are still unreferenced.
+                    std::vector<GCObject *> releasedObjects;
+                    for (GCObject *object : deferredReleases) {
+                        releasedObjects.push_back(object);
+                    }
+                    deferredReleases.clear();
+                    deleteReleasedObjects(compartment, std::move(releasedObjects));
+                    return true;
+                }
+                break;
+            }
+            default:
+                Errors::unreachable();
+        };
     }
 
-    std::cout << "Collected garbage in %.2fms: %" PRIuPTR " roots, %" PRIuPTR " objects, %" PRIuPTR << " garbage\n"
-              << numRoots << numInitialObjects << Uptr(state.unreferencedObjects.size());
+    return false;
+}
+
+bool Runtime::collectCompartmentGarbageIncrementally(Compartment *compartment, Uptr maxWorkUnits) {
+    return collectGarbageSlice(compartment, maxWorkUnits);
+}
+
+bool Runtime::collectCompartmentGarbage(Compartment *compartment) {
+    // Finish any collection in progress, then run a complete collection.
+    const bool wasCollecting = compartment->gcState.phase.load(std::memory_order_acquire) != GCPhase::idle;
+    for (Uptr numCollections = wasCollecting ? 2 : 1; numCollections > 0; --numCollections) {
+        while (!collectGarbageSlice(compartment, UINTPTR_MAX)) {
+            std::this_thread::yield();
+        };
+    }
 
-    return wasCompartmentUnreferenced;
+    return tryDeleteEmptyCompartment(compartment);
 }
@@ -11,7 +11,10 @@ Context *Runtime::createContext(Compartment *compartment) {
     wavmAssert(compartment);
     Context *context = new Context(compartment);
     {
-        Lock<Platform::Mutex> lock(compartment->mutex);
+        // Lock the globals mutex to read initialContextMutableGlobals, and the contexts mutex to add
+        // the context.
+        Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
+        Lock<Platform::Mutex> contextsLock(compartment->contextsMutex);
 
         // Allocate an ID for the context in the compartment.
         context->id = compartment->contexts.add(UINTPTR_MAX, context);
@@ -19,21 +22,88 @@ Context *Runtime::createContext(Compartment *compartment) {
             delete context;
             return nullptr;
         }
-        context->runtimeData = &compartment->runtimeData->contexts[context->id];
 
-        // Commit the page(s) for the context's runtime data.
-        errorUnless(Platform::commitVirtualPages((U8 *) context->runtimeData,
-                                                 sizeof(ContextRuntimeData) >> Platform::getPageSizeLog2()));
+        // Reserve the context's runtime data, and commit the pages for the mutable globals allocated
+        // in the compartment.
+        const Uptr numMutableGlobals = compartment->initialContextMutableGlobals.size();
+        context->runtimeData = (ContextRuntimeData *) reserveRuntimeData(sizeof(ContextRuntimeData));
+        commitRuntimeData(context->runtimeData, offsetof(ContextRuntimeData, mutableGlobals) + numMutableGlobals * sizeof(IR::UntaggedValue));
 
-        // Initialize the context's global data.
-        memcpy(context->runtimeData->mutableGlobals, compartment->initialContextMutableGlobals, maxGlobalBytes);
+        // Initialize the context's global data, and the pointer to the compartment's runtime data.
+        if (numMutableGlobals) {
+            memcpy(context->runtimeData->mutableGlobals, compartment->initialContextMutableGlobals.data(), numMutableGlobals * sizeof(IR::UntaggedValue));
+        }
+        context->runtimeData->compartmentRuntimeData = compartment->runtimeData;
     }
 
     return context;
 }
 
+Context *Runtime::cloneContext(Context *context, Compartment *newCompartment) {
+    Context *newContext = createContext(newCompartment);
+    if (!newContext) {
+        return nullptr;
+    }
+
+    // Copy the original context's mutable global values, remapping references to objects in the
+    // original compartment.
+    std::vector<U32> referenceMutableGlobalIndices;
+    {
+        Lock<Platform::Mutex> globalsLock(newCompartment->globalsMutex);
+
+        // The new compartment has the same mutable globals as the original, so it can't have more
+        // mutable global storage than the original context.
+        const Uptr numMutableGlobals = newCompartment->initialContextMutableGlobals.size();
+        wavmAssert(numMutableGlobals <= context->compartment->initialContextMutableGlobals.size());
+        if (numMutableGlobals) {
+            memcpy(newContext->runtimeData->mutableGlobals, context->runtimeData->mutableGlobals, numMutableGlobals * sizeof(IR::UntaggedValue));
+        }
+
+        for (Global *global : newCompartment->globals) {
+            if (global->type.isMutable && isReferenceType(global->type.valueType)) {
+                referenceMutableGlobalIndices.push_back(global->mutableGlobalIndex);
+            }
+        }
+    }
+    for (U32 mutableGlobalIndex : referenceMutableGlobalIndices) {
+        IR::UntaggedValue &value = newContext->runtimeData->mutableGlobals[mutableGlobalIndex];
+        value.object = remapToClonedCompartment(value.object, newCompartment);
+    }
+
+    return newContext;
+}
+
 Runtime::Context::~Context() {
     compartment->contexts.removeOrFail(id);
+
+    if (runtimeData) {
+        freeRuntimeData((U8 *) runtimeData, sizeof(ContextRuntimeData));
+        runtimeData = nullptr;
+    }
+}
+
+// Allocates storage for a mutable global in the compartment's contexts, and sets its value in
+// them. The caller must hold the compartment's globals mutex.
+static void addMutableGlobal(Compartment *compartment, U32 mutableGlobalIndex, IR::UntaggedValue initialValue) {
+    Lock<Platform::Mutex> contextsLock(compartment->contextsMutex);
+    wavmAssert(!compartment->globalDataAllocationMask.contains(mutableGlobalIndex));
+    compartment->globalDataAllocationMask.add(mutableGlobalIndex);
+
+    // If the contexts don't have storage for the global yet, commit it.
+    if (mutableGlobalIndex >= compartment->initialContextMutableGlobals.size()) {
+        const Uptr previousNumMutableGlobals = compartment->initialContextMutableGlobals.size();
+        const Uptr numNewMutableGlobals = mutableGlobalIndex + 1 - previousNumMutableGlobals;
+        compartment->initialContextMutableGlobals.resize(mutableGlobalIndex + 1);
+        for (Context *context : compartment->contexts) {
+            commitRuntimeData(&context->runtimeData->mutableGlobals[previousNumMutableGlobals], numNewMutableGlobals * sizeof(IR::UntaggedValue));
+        }
+    }
+
+    // Initialize the global value for each context, and the data used to initialize new contexts.
+    compartment->initialContextMutableGlobals[mutableGlobalIndex] = initialValue;
+    for (Context *context : compartment->contexts) {
+        context->runtimeData->mutableGlobals[mutableGlobalIndex] = initialValue;
+    }
 }
 
 Global *Runtime::createGlobal(Compartment *compartment, GlobalType type, Value initialValue) {
@@ -41,26 +111,26 @@ Global *Runtime::createGlobal(Compartment *compartment, GlobalType type, Value i
     errorUnless(!isReferenceType(type.valueType) || !initialValue.object ||
                 isInCompartment(initialValue.object, compartment));
 
+    // References from globals aren't counted, since mutable globals may be written by WebAssembly
+    // code.
+    if (isReferenceType(type.valueType) && initialValue.object) {
+        addUncountedReference(compartment, initialValue.object);
+    }
+
     U32 mutableGlobalIndex = UINT32_MAX;
     if (type.isMutable) {
+        Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
         mutableGlobalIndex = compartment->globalDataAllocationMask.getSmallestNonMember();
         if (mutableGlobalIndex == maxMutableGlobals) {
             return nullptr;
         }
-        compartment->globalDataAllocationMask.add(mutableGlobalIndex);
-
-        // Initialize the global value for each context, and the data used to initialize new
-        // contexts.
-        compartment->initialContextMutableGlobals[mutableGlobalIndex] = initialValue;
-        for (Context *context : compartment->contexts) {
-            context->runtimeData->mutableGlobals[mutableGlobalIndex] = initialValue;
-        }
+        addMutableGlobal(compartment, mutableGlobalIndex, initialValue);
     }
 
     // Create the global and add it to the compartment's list of globals.
     Global *global = new Global(compartment, type, mutableGlobalIndex, initialValue);
     {
-        Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+        Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
         global->id = compartment->globals.add(UINTPTR_MAX, global);
         if (global->id == UINTPTR_MAX) {
             delete global;
@@ -71,6 +141,41 @@ Global *Runtime::createGlobal(Compartment *compartment, GlobalType type, Value i
     return global;
 }
 
+Global *Runtime::cloneGlobal(Global *global, Compartment *newCompartment) {
+    Global *newGlobal = new Global(newCompartment, global->type, global->mutableGlobalIndex, global->initialValue);
+    newGlobal->id = global->id;
+    newGlobal->hasUncountedReferences.store(global->hasUncountedReferences.load(std::memory_order_acquire), std::memory_order_release);
+
+    // Allocate the same mutable global index in the new compartment, and copy the value used to
+    // initialize new contexts.
+    if (global->type.isMutable) {
+        IR::UntaggedValue initialContextValue = global->compartment->initialContextMutableGlobals[global->mutableGlobalIndex];
+        Lock<Platform::Mutex> globalsLock(newCompartment->globalsMutex);
+        addMutableGlobal(newCompartment, global->mutableGlobalIndex, initialContextValue);
+    }
+
+    {
+        Lock<Platform::Mutex> globalsLock(newCompartment->globalsMutex);
+        newCompartment->globals.insertOrFail(newGlobal->id, newGlobal);
+    }
+
+    return newGlobal;
+}
+
+void Runtime::remapClonedGlobalValue(Global *newGlobal) {
+    if (!isReferenceType(newGlobal->type.valueType)) {
+        return;
+    }
+
+    Compartment *newCompartment = newGlobal->compartment;
+    newGlobal->initialValue.object = remapToClonedCompartment(newGlobal->initialValue.object, newCompartment);
+    if (newGlobal->type.isMutable) {
+        Lock<Platform::Mutex> contextsLock(newCompartment->contextsMutex);
+        IR::UntaggedValue &initialContextValue = newCompartment->initialContextMutableGlobals[newGlobal->mutableGlobalIndex];
+        initialContextValue.object = remapToClonedCompartment(initialContextValue.object, newCompartment);
+    }
+}
+
 Runtime::Global::~Global() {
     if (id != UINTPTR_MAX) {
         compartment->globals.removeOrFail(id);
@@ -83,6 +188,36 @@ Runtime::Global::~Global() {
     }
 }
 
+Runtime::ExceptionType *Runtime::createExceptionType(Compartment *compartment, IR::ExceptionType sig, std::string &&debugName) {
+    ExceptionType *exceptionType = new ExceptionType(compartment, sig, std::move(debugName));
+
+    Lock<Platform::Mutex> exceptionTypesLock(compartment->exceptionTypesMutex);
+    exceptionType->id = compartment->exceptionTypes.add(UINTPTR_MAX, exceptionType);
+    if (exceptionType->id == UINTPTR_MAX) {
+        exceptionTypesLock.unlock();
+        delete exceptionType;
+        return nullptr;
+    }
+    return exceptionType;
+}
+
+Runtime::ExceptionType *Runtime::cloneExceptionType(ExceptionType *exceptionType, Compartment *newCompartment) {
+    std::string debugName = exceptionType->debugName;
+    ExceptionType *newExceptionType = new ExceptionType(newCompartment, exceptionType->sig, std::move(debugName));
+    newExceptionType->id = exceptionType->id;
+    newExceptionType->hasUncountedReferences.store(exceptionType->hasUncountedReferences.load(std::memory_order_acquire), std::memory_order_release);
+
+    Lock<Platform::Mutex> exceptionTypesLock(newCompartment->exceptionTypesMutex);
+    newCompartment->exceptionTypes.insertOrFail(newExceptionType->id, newExceptionType);
+    return newExceptionType;
+}
+
+Runtime::ExceptionType::~ExceptionType() {
+    if (id != UINTPTR_MAX) {
+        compartment->exceptionTypes.removeOrFail(id);
+    }
+}
+
 #define DEFINE_OBJECT_TYPE(kindId, kindName, Type)                                                 \
     Runtime::Type* Runtime::as##kindName(Object* object)                                           \
     {                                                                                              \
@@ -165,20 +300,20 @@ FunctionType Runtime::getFunctionType(Function *function) {
 
 ModuleInstance *Runtime::getModuleInstanceFromRuntimeData(ContextRuntimeData *contextRuntimeData, Uptr moduleInstanceId) {
     Compartment *compartment = getCompartmentRuntimeData(contextRuntimeData)->compartment;
-    Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+    Lock<Platform::Mutex> moduleInstancesLock(compartment->moduleInstancesMutex);
     wavmAssert(compartment->moduleInstances.contains(moduleInstanceId));
     return compartment->moduleInstances[moduleInstanceId];
 }
 
 Table *Runtime::getTableFromRuntimeData(ContextRuntimeData *contextRuntimeData, Uptr tableId) {
     Compartment *compartment = getCompartmentRuntimeData(contextRuntimeData)->compartment;
-    Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+    Lock<Platform::Mutex> tablesLock(compartment->tablesMutex);
     wavmAssert(compartment->tables.contains(tableId));
     return compartment->tables[tableId];
 }
 
 Memory *Runtime::getMemoryFromRuntimeData(ContextRuntimeData *contextRuntimeData, Uptr memoryId) {
     Compartment *compartment = getCompartmentRuntimeData(contextRuntimeData)->compartment;
-    Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+    Lock<Platform::Mutex> memoriesLock(compartment->memoriesMutex);
     return compartment->memories[memoryId];
 }
@@ -6,8 +6,10 @@
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/IndexMap.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -27,9 +29,21 @@ namespace WAVM {
     namespace Runtime {
 
         // A private base class for all runtime objects that are garbage collected.
+        //
+        // Objects are deleted deterministically when their last reference is removed, as long as all
+        // their references are counted: root references, and references from the immutable fields
+        // of module instances. Once an object is stored somewhere references aren't counted (a table
+        // element, a reference-typed global, or an argument to WebAssembly code), it may only be
+        // deleted by the compartment's tracing collector, which also reclaims reference cycles.
         struct GCObject : Object {
             Compartment *const compartment;
             std::atomic<Uptr> numRootReferences;
+            std::atomic<Uptr> numObjectReferences{0};
+            std::atomic<bool> hasUncountedReferences{false};
+
+            // The compartment's GC epoch when the object was last marked by the tracing collector.
+            // Only accessed while holding the compartment's GC mutex.
+            Uptr gcMarkEpoch;
 
             GCObject(ObjectKind inKind, Compartment *inCompartment);
 
@@ -48,6 +62,11 @@ namespace WAVM {
             const IR::TableType type;
             std::string debugName;
 
+            // If the table was defined by a module instance, its ID. Storing the defining instance's
+            // functions in the table doesn't prevent the instance from being deleted by reference
+            // counting: the table is deleted with it.
+            Uptr definingModuleInstanceId = UINTPTR_MAX;
+
             Element *elements = nullptr;
             Uptr numReservedBytes = 0;
             Uptr numReservedElements = 0;
@@ -67,6 +86,9 @@ namespace WAVM {
         // at the end of the array will, when re-adding this Function's address, point to this Object.
         extern Object *getOutOfBoundsElement();
 
+        // This is used as a sentinel value for null table elements.
+        extern Object *getUninitializedElement();
+
         // An instance of a WebAssembly Memory.
         struct Memory : GCObject {
             Uptr id = UINTPTR_MAX;
@@ -76,9 +98,19 @@ namespace WAVM {
             U8 *baseAddress = nullptr;
             Uptr numReservedBytes = 0;
 
+            // Whether the memory only reserves address space for its maximum size, and so may only be
+            // accessed by code that explicitly bounds checks addresses.
+            bool explicitBoundsChecks = false;
+
             mutable Platform::Mutex resizingMutex;
             std::atomic<Uptr> numPages{0};
 
+            // If the memory has been cloned, the image its initial pages are mapped copy-on-write from.
+            std::shared_ptr<Platform::MemoryImage> image;
+
+            // If deltas have been captured from the memory, tracks the pages written since the last one.
+            Platform::DirtyPageTracker *dirtyPageTracker = nullptr;
+
             Memory(Compartment *inCompartment, const IR::MemoryType &inType, std::string &&inDebugName)
                     : GCObject(ObjectKind::memory, inCompartment), type(inType), debugName(std::move(inDebugName)) {
             }
@@ -92,7 +124,9 @@ namespace WAVM {
 
             const IR::GlobalType type;
             const U32 mutableGlobalIndex;
-            const IR::UntaggedValue initialValue;
+            // Only written by cloneCompartment, to remap a reference to an object in the original
+            // compartment.
+            IR::UntaggedValue initialValue;
 
             Global(Compartment *inCompartment, IR::GlobalType inType, U32 inMutableGlobalId, IR::UntaggedValue inInitialValue)
                     : GCObject(ObjectKind::global, inCompartment), type(inType), mutableGlobalIndex(inMutableGlobalId),
@@ -117,18 +151,46 @@ namespace WAVM {
             ~ExceptionType() override;
         };
 
-        // A compiled WebAssembly module.
+        typedef HashMap<Uptr, std::shared_ptr<const std::vector<U8>>> PassiveDataSegmentMap;
+        typedef HashMap<Uptr, std::shared_ptr<std::vector<Object *>>> PassiveElemSegmentMap;
+
+        // The parts of instantiating a module that don't depend on the instance, computed once when
+        // the module is created.
+        struct InstantiationPlan {
+            // The debug names of the module's definitions, indexed by definition index. Functions
+            // without a name in the name section are given a name derived from their index.
+            std::vector<std::string> functionDefNames;
+            std::vector<std::string> tableDefNames;
+            std::vector<std::string> memoryDefNames;
+            std::vector<std::string> exceptionTypeDefNames;
+
+            // The indices of the module's passive data and elem segments. Instances share the
+            // module's passive data segment bytes instead of copying them.
+            std::vector<Uptr> passiveDataSegmentIndices;
+            std::vector<Uptr> passiveElemSegmentIndices;
+        };
+
+        // A compiled WebAssembly module. Only the parts of the IR needed to instantiate and introspect
+        // the module are kept: the function bodies are released once the module is compiled, unless
+        // the module specializes its instances' code. The object code is immutable, so modules
+        // derived from this one (e.g. snapshots) share it.
         struct Module {
             IR::Module ir;
-            std::vector<U8> objectCode;
+            std::shared_ptr<const std::vector<U8>> objectCode;
+            InstantiationPlan plan;
 
-            Module(IR::Module &&inIR, std::vector<U8> &&inObjectCode) : ir(inIR), objectCode(std::move(inObjectCode)) {
+            // If the module specializes its instances' code, maps the values the code was
+            // specialized for to the object code, for at most a fixed number of specializations.
+            mutable Platform::Mutex specializedObjectCodesMutex;
+            mutable HashMap<std::vector<U64>, std::shared_ptr<const std::vector<U8>>> specializedObjectCodes;
+
+            Module(IR::Module &&inIR, std::shared_ptr<const std::vector<U8>> &&inObjectCode);
+
+            Module(IR::Module &&inIR, std::vector<U8> &&inObjectCode)
+                    : Module(std::move(inIR), std::make_shared<const std::vector<U8>>(std::move(inObjectCode))) {
             }
         };
 
-        typedef HashMap<Uptr, std::shared_ptr<std::vector<U8>>> PassiveDataSegmentMap;
-        typedef HashMap<Uptr, std::shared_ptr<std::vector<Object *>>> PassiveElemSegmentMap;
-
         // An instance of a WebAssembly module.
         struct ModuleInstance : GCObject {
             const Uptr id;
@@ -152,6 +214,10 @@ namespace WAVM {
 
             const std::shared_ptr<LLVMJIT::Module> jitModule;
 
+            // The other module instances that this instance imports functions from. Each holds a
+            // counted reference from this instance.
+            std::vector<ModuleInstance *> importedModuleInstances;
+
             ModuleInstance(Compartment *inCompartment, Uptr inID, HashMap<std::string, Object *> &&inExportMap, std::vector<Function *> &&inFunctions, std::vector<Table *> &&inTables, std::vector<Memory *> &&inMemories, std::vector<Global *> &&inGlobals, std::vector<ExceptionType *> &&inExceptionTypes, Function *inStartFunction, PassiveDataSegmentMap &&inPassiveDataSegments, PassiveElemSegmentMap &&inPassiveElemSegments, std::shared_ptr<LLVMJIT::Module> &&inJITModule, std::string &&inDebugName)
                     : GCObject(ObjectKind::moduleInstance, inCompartment), id(inID), debugName(std::move(inDebugName)),
                       exportMap(std::move(inExportMap)), functions(std::move(inFunctions)), tables(std::move(inTables)),
@@ -174,11 +240,57 @@ namespace WAVM {
             ~Context();
         };
 
+        enum class GCPhase : Uptr {
+            idle, scanningRoots, marking, releasingReferences, sweeping
+        };
+
+        // The state of a compartment's incremental tracing collector.
+        struct IncrementalGCState {
+            // Locked by collector slices, by the write barrier while the collector is marking, and
+            // when deleting objects by reference counting. It must be locked before any of the
+            // compartment's other mutexes.
+            Platform::Mutex mutex;
+
+            std::atomic<GCPhase> phase{GCPhase::idle};
+
+            // Incremented at the start of each collection. Objects created during a collection are
+            // marked with the new epoch, so they survive it.
+            std::atomic<Uptr> epoch{0};
+
+            // Marked objects that haven't had their references scanned yet.
+            std::vector<GCObject *> greyObjects;
+
+            // The position of the root scan or sweep: an index into the kinds of objects, and an
+            // index into the compartment's IndexMap for that kind.
+            Uptr cursorKindIndex = 0;
+            Uptr cursorObjectIndex = 0;
+
+            // Objects whose last reference was removed while a collection was in progress. They are
+            // deleted, if still unreferenced, when the collection completes.
+            HashSet<GCObject *> deferredReleases;
+
+            // The number of instantiateModule calls in progress in the compartment. Objects created
+            // for an instance aren't referenced until the instance is created, so the collector
+            // doesn't start sweeping until there are no instantiations in progress.
+            std::atomic<Uptr> numPendingInstantiations{0};
+        };
+
         struct Compartment : GCObject {
-            mutable Platform::Mutex mutex;
+            mutable IncrementalGCState gcState;
+
+            // Each kind of object has its own mutex, so objects of different kinds can be created
+            // concurrently. If more than one of them is locked, they must be locked in the order they
+            // are declared, after gcState.mutex. lock() and unlock() lock all of them, for operations
+            // on the whole compartment.
+            mutable Platform::Mutex moduleInstancesMutex;
+            mutable Platform::Mutex tablesMutex;
+            mutable Platform::Mutex memoriesMutex;
+            // Also protects globalDataAllocationMask and initialContextMutableGlobals.
+            mutable Platform::Mutex globalsMutex;
+            mutable Platform::Mutex exceptionTypesMutex;
+            mutable Platform::Mutex contextsMutex;
 
             struct CompartmentRuntimeData *runtimeData;
-            U8 *unalignedRuntimeData;
 
             IndexMap<Uptr, Table *> tables;
             IndexMap<Uptr, Memory *> memories;
@@ -187,14 +299,89 @@ namespace WAVM {
             IndexMap<Uptr, ModuleInstance *> moduleInstances;
             IndexMap<Uptr, Context *> contexts;
 
+            // The values used to initialize the mutable globals of new contexts. Each context has
+            // committed storage for as many mutable globals as there are elements in this array.
             DenseStaticIntSet<U32, maxMutableGlobals> globalDataAllocationMask;
-            IR::UntaggedValue initialContextMutableGlobals[maxMutableGlobals];
+            std::vector<IR::UntaggedValue> initialContextMutableGlobals;
+
+            // Whether a module whose code traps by raising a signal has been instantiated in the
+            // compartment: one compiled with FeatureSpec::hardwareDivideTraps or
+            // FeatureSpec::explicitBoundsChecks, or one that may use table.get or table.set. If so,
+            // invoking a function must catch the signals.
+            std::atomic<bool> hasSignalTraps{false};
 
             Compartment();
 
             ~Compartment();
+
+            void lock() const;
+
+            void unlock() const;
         };
 
+        // A set of objects that are added and removed from many threads. It is split into shards with
+        // their own mutexes, so adding objects from different threads rarely contends. Memories and
+        // tables are registered in one, since a fault must be attributed to the memory or table that
+        // owns its address without knowing which compartment it is in.
+        template<typename Object> struct ShardedRegistry {
+            void add(Object *object) {
+                Shard &shard = getShard(object);
+                Lock<Platform::Mutex> shardLock(shard.mutex);
+                shard.objects.push_back(object);
+            }
+
+            void remove(Object *object) {
+                Shard &shard = getShard(object);
+                Lock<Platform::Mutex> shardLock(shard.mutex);
+                for (Uptr objectIndex = 0; objectIndex < shard.objects.size(); ++objectIndex) {
+                    if (shard.objects[objectIndex] == object) {
+                        shard.objects[objectIndex] = shard.objects.back();
+                        shard.objects.pop_back();
+                        break;
+                    }
+                }
+            }
+
+            // Returns the first object that the predicate returns true for, or null.
+            template<typename Predicate> Object *find(Predicate &&predicate) {
+                for (Shard &shard : shards) {
+                    Lock<Platform::Mutex> shardLock(shard.mutex);
+                    for (Object *object : shard.objects) {
+                        if (predicate(object)) {
+                            return object;
+                        }
+                    }
+                }
+                return nullptr;
+            }
+
+        private:
+            enum {
+                numShards = 64
+            };
+
+            struct alignas(64) Shard {
+                Platform::Mutex mutex;
+                std::vector<Object *> objects;
+            };
+
+            Shard shards[numShards];
+
+            Shard &getShard(Object *object) {
+                return shards[Hash<Uptr>()(reinterpret_cast<Uptr>(object)) % numShards];
+            }
+        };
+
+        // Adds the counted references from a module instance to the objects it uses. Must be called
+        // once the instance has been added to its compartment, without holding any of its locks.
+        void addModuleInstanceReferences(ModuleInstance *moduleInstance);
+
+        // Records that an object was stored somewhere its references aren't counted. The object may
+        // then only be deleted by the tracing collector. A table element referencing a function of
+        // the module instance with referrerModuleInstanceId doesn't count, since the instance and the
+        // table it defined are deleted together.
+        void addUncountedReference(Compartment *compartment, Object *object, Uptr referrerModuleInstanceId = UINTPTR_MAX);
+
         DECLARE_INTRINSIC_MODULE(wavmIntrinsics);
 
         void dummyReferenceAtomics();
@@ -210,12 +397,23 @@ namespace WAVM {
         bool isAddressOwnedByMemory(U8 *address, Memory *&outMemory, Uptr &outMemoryAddress);
 
         // Clones objects into a new compartment with the same ID.
-        Table *cloneTable(Table *memory, Compartment *newCompartment);
+        Table *cloneTable(Table *table, Compartment *newCompartment);
+
+        // The elements of a cloned table and the value of a cloned global refer to objects in the
+        // original compartment, since they may refer to objects that are cloned after them. Once all
+        // the objects are cloned, these functions remap them to the new compartment's objects.
+        void remapClonedTableElements(Table *newTable);
+
+        void remapClonedGlobalValue(Global *newGlobal);
 
         Memory *cloneMemory(Memory *memory, Compartment *newCompartment);
 
         ExceptionType *cloneExceptionType(ExceptionType *exceptionType, Compartment *newCompartment);
 
+        // Creates an exception type in a compartment. Returns null if the compartment has no free
+        // exception type IDs.
+        ExceptionType *createExceptionType(Compartment *compartment, IR::ExceptionType sig, std::string &&debugName);
+
         ModuleInstance *cloneModuleInstance(ModuleInstance *moduleInstance, Compartment *newCompartment);
 
         // Clone a global with same ID and mutable data offset (if mutable) in a new compartment.
@@ -226,5 +424,14 @@ namespace WAVM {
         Table *getTableFromRuntimeData(ContextRuntimeData *contextRuntimeData, Uptr tableId);
 
         Memory *getMemoryFromRuntimeData(ContextRuntimeData *contextRuntimeData, Uptr memoryId);
+
+        // Runtime data is reserved for the maximum number of objects, and committed as objects are
+        // created: these functions reserve runtime data, and commit the pages of it that contain an
+        // address range.
+        U8 *reserveRuntimeData(Uptr numBytes);
+
+        void freeRuntimeData(U8 *runtimeData, Uptr numBytes);
+
+        void commitRuntimeData(void *address, Uptr numBytes);
     }
 }
@@ -0,0 +1,459 @@
+#include <string.h>
+#include <memory>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Serialization.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::Serialization;
+
+// The name of the user section that marks a module as a pre-initialized snapshot.
+static const char *preinitializedSectionName = "wavm.preinitialized";
+
+// Runs of zero bytes shorter than this are included in the surrounding data segment instead of
+// splitting it, since each segment has some fixed overhead.
+static constexpr Uptr minZeroBytesBetweenSegments = 64;
+
+static constexpr U8 precompiledModuleMagic[8] = {0, 'w', 'a', 'v', 'm', 'o', 'b', 'j'};
+// Version 2: wasm functions pop their stack arguments, to support tail calls.
+// Version 3: snapshots store the values of their imported mutable globals.
+// Version 4: inline table.get and table.set bounds check the index.
+// Version 5: explicit bounds checks of shared memories load the memory's current size.
+static constexpr U32 precompiledModuleVersion = 5;
+
+static bool getInitializerForValue(ValueType type, const UntaggedValue &value, InitializerExpression &outInitializer) {
+    switch (type) {
+        case ValueType::i32:
+            outInitializer = InitializerExpression(value.i32);
+            return true;
+        case ValueType::i64:
+            outInitializer = InitializerExpression(value.i64);
+            return true;
+        case ValueType::f32:
+            outInitializer = InitializerExpression(value.f32);
+            return true;
+        case ValueType::f64:
+            outInitializer = InitializerExpression(value.f64);
+            return true;
+        case ValueType::v128:
+            outInitializer = InitializerExpression(value.v128);
+            return true;
+        case ValueType::anyref:
+        case ValueType::anyfunc:
+        case ValueType::nullref:
+            // Only null references can be expressed as an initializer.
+            if (value.object) {
+                return false;
+            }
+            outInitializer = InitializerExpression(nullptr);
+            return true;
+        default:
+            Errors::unreachable();
+    };
+}
+
+static void snapshotMemory(Uptr memoryIndex, Memory *memory, std::vector<DataSegment> &outDataSegments) {
+    const U8 *baseAddress = getMemoryBaseAddress(memory);
+    const Uptr numBytes = getMemoryNumPages(memory) * IR::numBytesPerPage;
+
+    Uptr offset = 0;
+    while (offset < numBytes) {
+        // Skip zero bytes: the memory will be zero-initialized when the snapshot is instantiated.
+        while (offset < numBytes && !baseAddress[offset]) {
+            ++offset;
+        }
+        if (offset == numBytes) {
+            break;
+        }
+
+        // Find the end of the non-zero run, including any short runs of zeroes within it.
+        const Uptr beginOffset = offset;
+        Uptr endOffset = offset;
+        while (offset < numBytes) {
+            if (baseAddress[offset]) {
+                endOffset = ++offset;
+            } else if (offset - endOffset >= minZeroBytesBetweenSegments) {
+                break;
+            } else {
+                ++offset;
+            }
+        }
+
+        DataSegment dataSegment;
+        dataSegment.isActive = true;
+        dataSegment.memoryIndex = memoryIndex;
+        dataSegment.baseOffset = InitializerExpression(I32(U32(beginOffset)));
+        dataSegment.data.assign(baseAddress + beginOffset, baseAddress + endOffset);
+        outDataSegments.push_back(std::move(dataSegment));
+    }
+}
+
+static bool snapshotTable(Uptr tableIndex, Table *table, const HashMap<Uptr, Uptr> &functionIndexMap, std::vector<ElemSegment> &outElemSegments) {
+    const Uptr numElements = getTableNumElements(table);
+
+    Uptr elementIndex = 0;
+    while (elementIndex < numElements) {
+        if (!getTableElement(table, elementIndex)) {
+            ++elementIndex;
+            continue;
+        }
+
+        // Gather the run of non-null elements into a single segment.
+        ElemSegment elemSegment;
+        elemSegment.isActive = true;
+        elemSegment.tableIndex = tableIndex;
+        elemSegment.baseOffset = InitializerExpression(I32(U32(elementIndex)));
+        for (; elementIndex < numElements; ++elementIndex) {
+            Object *object = getTableElement(table, elementIndex);
+            if (!object) {
+                break;
+            }
+
+            // Elem segments may only refer to the module's own function index space.
+            const Uptr *functionIndex = functionIndexMap.get(reinterpret_cast<Uptr>(object));
+            if (!functionIndex) {
+                return false;
+            }
+            elemSegment.indices.push_back(*functionIndex);
+        }
+        outElemSegments.push_back(std::move(elemSegment));
+    }
+    return true;
+}
+
+ModuleRef Runtime::snapshotModuleInstance(Context *context, ModuleConstRefParam module, ModuleInstance *moduleInstance) {
+    wavmAssert(context && moduleInstance);
+    wavmAssert(context->compartment == moduleInstance->compartment);
+
+    IR::Module snapshotIR = module->ir;
+
+    // The snapshot state is applied by the appended segments. Empty the original active segments
+    // instead of removing them, so the indices of passive segments are unchanged.
+    for (DataSegment &dataSegment : snapshotIR.dataSegments) {
+        if (dataSegment.isActive) {
+            dataSegment.data.clear();
+        } else {
+            Lock<Platform::Mutex> passiveDataSegmentsLock(moduleInstance->passiveDataSegmentsMutex);
+            if (!moduleInstance->passiveDataSegments.contains(&dataSegment - snapshotIR.dataSegments.data())) {
+                dataSegment.data.clear();
+            }
+        }
+    }
+    for (ElemSegment &elemSegment : snapshotIR.elemSegments) {
+        if (elemSegment.isActive) {
+            elemSegment.indices.clear();
+        } else {
+            Lock<Platform::Mutex> passiveElemSegmentsLock(moduleInstance->passiveElemSegmentsMutex);
+            if (!moduleInstance->passiveElemSegments.contains(&elemSegment - snapshotIR.elemSegments.data())) {
+                elemSegment.indices.clear();
+            }
+        }
+    }
+
+    // Capture the contents of each memory, and make sure the snapshot's memory is at least as large
+    // as the memory was when the snapshot was taken.
+    for (Uptr memoryIndex = 0; memoryIndex < moduleInstance->memories.size(); ++memoryIndex) {
+        Memory *memory = moduleInstance->memories[memoryIndex];
+        MemoryType &memoryType = snapshotIR.memories.isImport(memoryIndex)
+                                 ? snapshotIR.memories.imports[memoryIndex].type
+                                 : snapshotIR.memories.defs[memoryIndex - snapshotIR.memories.imports.size()].type;
+        memoryType.size.min = std::max(memoryType.size.min, U64(getMemoryNumPages(memory)));
+
+        snapshotMemory(memoryIndex, memory, snapshotIR.dataSegments);
+    }
+
+    // Capture the contents of each table.
+    HashMap<Uptr, Uptr> functionIndexMap;
+    for (Uptr functionIndex = 0; functionIndex < moduleInstance->functions.size(); ++functionIndex) {
+        functionIndexMap.set(reinterpret_cast<Uptr>(moduleInstance->functions[functionIndex]), functionIndex);
+    }
+    for (Uptr tableIndex = 0; tableIndex < moduleInstance->tables.size(); ++tableIndex) {
+        Table *table = moduleInstance->tables[tableIndex];
+        TableType &tableType = snapshotIR.tables.isImport(tableIndex)
+                               ? snapshotIR.tables.imports[tableIndex].type
+                               : snapshotIR.tables.defs[tableIndex - snapshotIR.tables.imports.size()].type;
+        tableType.size.min = std::max(tableType.size.min, U64(getTableNumElements(table)));
+
+        if (!snapshotTable(tableIndex, table, functionIndexMap, snapshotIR.elemSegments)) {
+            return nullptr;
+        }
+    }
+
+    // Replace the initializers of the module's mutable globals with their current values in the
+    // context.
+    for (Uptr globalDefIndex = 0; globalDefIndex < snapshotIR.globals.defs.size(); ++globalDefIndex) {
+        GlobalDef &globalDef = snapshotIR.globals.defs[globalDefIndex];
+        if (globalDef.type.isMutable) {
+            Global *global = moduleInstance->globals[snapshotIR.globals.imports.size() + globalDefIndex];
+            const UntaggedValue &value = context->runtimeData->mutableGlobals[global->mutableGlobalIndex];
+            if (!getInitializerForValue(globalDef.type.valueType, value, globalDef.initializer)) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Imported mutable globals don't have an initializer, so their current values are stored in the
+    // preinitialized section, and restored when the snapshot is instantiated.
+    ArrayOutputStream importedGlobalsStream;
+    for (Uptr importIndex = 0; importIndex < snapshotIR.globals.imports.size(); ++importIndex) {
+        const GlobalType &globalType = snapshotIR.globals.imports[importIndex].type;
+        if (globalType.isMutable) {
+            Global *global = moduleInstance->globals[importIndex];
+            UntaggedValue value = context->runtimeData->mutableGlobals[global->mutableGlobalIndex];
+
+            // As with the initializers, only null references can be stored in the snapshot.
+            if (isReferenceType(globalType.valueType) && value.object) {
+                return nullptr;
+            }
+            serializeNativeValue(importedGlobalsStream, value);
+        }
+    }
+
+    // The start function has already run, so remove it from the snapshot, and mark the snapshot so
+    // embedders know to skip their own initialization. A snapshot of a snapshot replaces the
+    // original's section, which holds stale imported global values.
+    snapshotIR.startFunctionIndex = UINTPTR_MAX;
+    Uptr userSectionIndex = 0;
+    if (findUserSection(snapshotIR, preinitializedSectionName, userSectionIndex)) {
+        snapshotIR.userSections[userSectionIndex].data = importedGlobalsStream.getBytes();
+    } else {
+        snapshotIR.userSections.push_back({preinitializedSectionName, importedGlobalsStream.getBytes()});
+    }
+
+    // The snapshot only changes the module's state, not its code, so it shares the module's object
+    // code.
+    std::shared_ptr<const std::vector<U8>> objectCode = module->objectCode;
+    return std::make_shared<Module>(std::move(snapshotIR), std::move(objectCode));
+}
+
+bool Runtime::isPreinitializedModule(ModuleConstRefParam module) {
+    Uptr userSectionIndex = 0;
+    return findUserSection(module->ir, preinitializedSectionName, userSectionIndex);
+}
+
+void Runtime::restoreSnapshotImportedGlobals(ModuleConstRefParam module, ModuleInstance *moduleInstance) {
+    const std::vector<Global *> &globals = moduleInstance->globals;
+    Uptr userSectionIndex = 0;
+    if (!findUserSection(module->ir, preinitializedSectionName, userSectionIndex)) {
+        return;
+    }
+
+    const std::vector<U8> &importedGlobalValues = module->ir.userSections[userSectionIndex].data;
+    MemoryInputStream importedGlobalsStream(importedGlobalValues.data(), importedGlobalValues.size());
+    for (Uptr importIndex = 0; importIndex < module->ir.globals.imports.size(); ++importIndex) {
+        Global *global = globals[importIndex];
+        if (global->type.isMutable) {
+            UntaggedValue value;
+            serializeNativeValue(importedGlobalsStream, value);
+
+            // Set the global's value in the compartment's contexts, and the value used to initialize
+            // new contexts.
+            Compartment *compartment = global->compartment;
+            Lock<Platform::Mutex> contextsLock(compartment->contextsMutex);
+            compartment->initialContextMutableGlobals[global->mutableGlobalIndex] = value;
+            for (Context *context : compartment->contexts) {
+                context->runtimeData->mutableGlobals[global->mutableGlobalIndex] = value;
+            }
+        }
+    }
+}
+
+const IR::Module &Runtime::getModuleIR(ModuleConstRefParam module) {
+    return module->ir;
+}
+
+//
+// Precompiled module serialization
+//
+
+// The serialization functions are declared in the IR namespace so they are found by argument
+// dependent lookup when serializing arrays of IR types.
+namespace WAVM {
+    namespace IR {
+        template<typename Stream> static void serializeByteArray(Stream &stream, std::vector<U8> &bytes) {
+            Uptr numBytes = bytes.size();
+            serializeNativeValue(stream, numBytes);
+            if (Stream::isInput) {
+                const U8 *inputBytes = stream.advance(numBytes);
+                bytes.assign(inputBytes, inputBytes + numBytes);
+            } else {
+                serializeBytes(stream, bytes.data(), numBytes);
+            }
+        }
+
+        template<typename Stream> static void serializeUptr(Stream &stream, Uptr &value) {
+            serializeNativeValue(stream, value);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, ValueType &type) {
+            serializeNativeValue(stream, type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, TypeTuple &typeTuple) {
+            std::vector<ValueType> elems(typeTuple.begin(), typeTuple.end());
+            Serialization::serialize(stream, elems);
+            if (Stream::isInput) {
+                typeTuple = TypeTuple(elems);
+            }
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, FunctionType &functionType) {
+            TypeTuple results = functionType.results();
+            TypeTuple params = functionType.params();
+            serialize(stream, results);
+            serialize(stream, params);
+            if (Stream::isInput) {
+                functionType = FunctionType(results, params);
+            }
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, ExceptionType &exceptionType) {
+            serialize(stream, exceptionType.params);
+        }
+
+        // These types are plain data, and a precompiled module is only loaded by the same build of
+        // WAVM that saved it, so they are serialized as native values.
+        template<typename Stream> static void serialize(Stream &stream, IndexedFunctionType &type) {
+            serializeNativeValue(stream, type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, TableType &type) {
+            serializeNativeValue(stream, type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, MemoryType &type) {
+            serializeNativeValue(stream, type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, GlobalType &type) {
+            serializeNativeValue(stream, type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, InitializerExpression &initializer) {
+            serializeNativeValue(stream, initializer);
+        }
+
+        template<typename Stream, typename Type> static void serialize(Stream &stream, Import<Type> &import) {
+            serialize(stream, import.type);
+            Serialization::serialize(stream, import.moduleName);
+            Serialization::serialize(stream, import.exportName);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, FunctionDef &functionDef) {
+            serialize(stream, functionDef.type);
+            Serialization::serialize(stream, functionDef.nonParameterLocalTypes);
+            serializeByteArray(stream, functionDef.code);
+            serializeArray(stream, functionDef.branchTables, [](Stream &stream, std::vector<Uptr> &branchTable) {
+                serializeArray(stream, branchTable, serializeUptr<Stream>);
+            });
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, TableDef &tableDef) {
+            serialize(stream, tableDef.type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, MemoryDef &memoryDef) {
+            serialize(stream, memoryDef.type);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, GlobalDef &globalDef) {
+            serialize(stream, globalDef.type);
+            serialize(stream, globalDef.initializer);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, ExceptionTypeDef &exceptionTypeDef) {
+            serialize(stream, exceptionTypeDef.type);
+        }
+
+        template<typename Stream, typename Definition, typename Type> static void serialize(Stream &stream, IndexSpace<Definition, Type> &indexSpace) {
+            Serialization::serialize(stream, indexSpace.imports);
+            Serialization::serialize(stream, indexSpace.defs);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, Export &exportIt) {
+            Serialization::serialize(stream, exportIt.name);
+            serializeNativeValue(stream, exportIt.kind);
+            serializeUptr(stream, exportIt.index);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, DataSegment &dataSegment) {
+            serializeNativeValue(stream, dataSegment.isActive);
+            serializeUptr(stream, dataSegment.memoryIndex);
+            serialize(stream, dataSegment.baseOffset);
+            serializeByteArray(stream, dataSegment.data);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, ElemSegment &elemSegment) {
+            serializeNativeValue(stream, elemSegment.isActive);
+            serializeUptr(stream, elemSegment.tableIndex);
+            serialize(stream, elemSegment.baseOffset);
+            serializeArray(stream, elemSegment.indices, serializeUptr<Stream>);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, UserSection &userSection) {
+            Serialization::serialize(stream, userSection.name);
+            serializeByteArray(stream, userSection.data);
+        }
+
+        template<typename Stream> static void serialize(Stream &stream, Module &irModule) {
+            serializeNativeValue(stream, irModule.featureSpec);
+            Serialization::serialize(stream, irModule.types);
+            serialize(stream, irModule.functions);
+            serialize(stream, irModule.tables);
+            serialize(stream, irModule.memories);
+            serialize(stream, irModule.globals);
+            serialize(stream, irModule.exceptionTypes);
+            Serialization::serialize(stream, irModule.exports);
+            Serialization::serialize(stream, irModule.dataSegments);
+            Serialization::serialize(stream, irModule.elemSegments);
+            Serialization::serialize(stream, irModule.userSections);
+            serializeUptr(stream, irModule.startFunctionIndex);
+        }
+    }
+}
+
+std::vector<U8> Runtime::saveCompiledModule(ModuleConstRefParam module) {
+    ArrayOutputStream stream;
+    serializeBytes(stream, precompiledModuleMagic, sizeof(precompiledModuleMagic));
+    U32 version = precompiledModuleVersion;
+    serialize(stream, version);
+
+    IR::Module irModule = module->ir;
+    std::vector<U8> objectCode = *module->objectCode;
+    IR::serialize(stream, irModule);
+    IR::serializeByteArray(stream, objectCode);
+    return std::move(stream.getBytes());
+}
+
+bool Runtime::isCompiledModuleBytes(const U8 *bytes, Uptr numBytes) {
+    return numBytes >= sizeof(precompiledModuleMagic) &&
+           !memcmp(bytes, precompiledModuleMagic, sizeof(precompiledModuleMagic));
+}
+
+ModuleRef Runtime::loadCompiledModule(const U8 *bytes, Uptr numBytes) {
+    if (!isCompiledModuleBytes(bytes, numBytes)) {
+        return nullptr;
+    }
+
+    try {
+        MemoryInputStream stream(bytes + sizeof(precompiledModuleMagic), numBytes - sizeof(precompiledModuleMagic));
+        U32 version = 0;
+        serialize(stream, version);
+        if (version != precompiledModuleVersion) {
+            return nullptr;
+        }
+
+        IR::Module irModule;
+        std::vector<U8> objectCode;
+        IR::serialize(stream, irModule);
+        IR::serializeByteArray(stream, objectCode);
+        return std::make_shared<Module>(std::move(irModule), std::move(objectCode));
+    } catch (FatalSerializationException) {
+        return nullptr;
+    }
+}
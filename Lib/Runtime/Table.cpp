@@ -5,14 +5,14 @@
 
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Exception.h"
 #include "WAVM/Platform/Memory.h"
 
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
-// Global lists of tables; used to query whether an address is reserved by one of them.
-static Platform::Mutex tablesMutex;
-static std::vector<Table *> tables;
+// A global set of tables; used to query whether an address is reserved by one of them.
+static ShardedRegistry<Table> tableRegistry;
 
 enum {
     numGuardPages = 1
@@ -34,7 +34,7 @@ Object *Runtime::getOutOfBoundsElement() {
     return asObject(function);
 }
 
-static Object *getUninitializedElement() {
+Object *Runtime::getUninitializedElement() {
     static Function *function = makeDummyFunction("uninitialized table element");
     return asObject(function);
 }
@@ -65,14 +65,20 @@ static Table *createTableImpl(Compartment *compartment, IR::TableType type, std:
         return nullptr;
     }
 
-    // Add the table to the global array.
-    {
-        Lock<Platform::Mutex> tablesLock(tablesMutex);
-        tables.push_back(table);
-    }
+    // Add the table to the global set.
+    tableRegistry.add(table);
     return table;
 }
 
+// Sets a table's size, and the copy of it in the compartment's runtime data that the inline
+// table.get and table.set code reads. The caller must hold the table's resizingMutex.
+static void setTableNumElements(Table *table, Uptr numElements) {
+    table->numElements.store(numElements, std::memory_order_release);
+    if (table->id != UINTPTR_MAX) {
+        table->compartment->runtimeData->tableNumElements[table->id] = numElements;
+    }
+}
+
 static Iptr growTableImpl(Table *table, Uptr numElementsToGrow, bool initializeNewElements) {
     if (!numElementsToGrow) {
         return table->numElements.load(std::memory_order_acquire);
@@ -105,7 +111,7 @@ static Iptr growTableImpl(Table *table, Uptr numElementsToGrow, bool initializeN
         }
     }
 
-    table->numElements.store(newNumElements, std::memory_order_release);
+    setTableNumElements(table, newNumElements);
     return previousNumElements;
 }
 
@@ -124,19 +130,76 @@ Table *Runtime::createTable(Compartment *compartment, IR::TableType type, std::s
 
     // Add the table to the compartment's tables IndexMap.
     {
-        Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+        Lock<Platform::Mutex> tablesLock(compartment->tablesMutex);
 
         table->id = compartment->tables.add(UINTPTR_MAX, table);
         if (table->id == UINTPTR_MAX) {
             delete table;
             return nullptr;
         }
+        commitRuntimeData(&compartment->runtimeData->tableBases[table->id], sizeof(void *));
+        commitRuntimeData(&compartment->runtimeData->tableNumElements[table->id], sizeof(Uptr));
         compartment->runtimeData->tableBases[table->id] = table->elements;
+        compartment->runtimeData->tableNumElements[table->id] = table->numElements.load(std::memory_order_acquire);
     }
 
     return table;
 }
 
+Table *Runtime::cloneTable(Table *table, Compartment *newCompartment) {
+    Lock<Platform::Mutex> resizingLock(table->resizingMutex);
+
+    // Create the new table.
+    const Uptr numElements = table->numElements.load(std::memory_order_acquire);
+    std::string debugName = table->debugName;
+    Table *newTable = createTableImpl(newCompartment, table->type, std::move(debugName));
+    if (!newTable) {
+        return nullptr;
+    }
+    newTable->definingModuleInstanceId = table->definingModuleInstanceId;
+    newTable->hasUncountedReferences.store(table->hasUncountedReferences.load(std::memory_order_acquire), std::memory_order_release);
+
+    // Grow the table to the same size as the original, without initializing the new elements since
+    // they will be written immediately following this.
+    if (growTableImpl(newTable, numElements, false) == -1) {
+        delete newTable;
+        return nullptr;
+    }
+
+    // Copy the original table's elements to the new table. They still refer to objects in the
+    // original compartment until remapClonedTableElements is called.
+    for (Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex) {
+        newTable->elements[elementIndex].biasedValue.store(table->elements[elementIndex].biasedValue.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    resizingLock.unlock();
+
+    // Insert the table in the new compartment's tables array with the same index as it had in the
+    // original compartment's tables IndexMap.
+    {
+        Lock<Platform::Mutex> tablesLock(newCompartment->tablesMutex);
+
+        newTable->id = table->id;
+        newCompartment->tables.insertOrFail(newTable->id, newTable);
+        commitRuntimeData(&newCompartment->runtimeData->tableBases[newTable->id], sizeof(void *));
+        commitRuntimeData(&newCompartment->runtimeData->tableNumElements[newTable->id], sizeof(Uptr));
+        newCompartment->runtimeData->tableBases[newTable->id] = newTable->elements;
+        newCompartment->runtimeData->tableNumElements[newTable->id] = numElements;
+    }
+
+    return newTable;
+}
+
+void Runtime::remapClonedTableElements(Table *newTable) {
+    Lock<Platform::Mutex> resizingLock(newTable->resizingMutex);
+    const Uptr numElements = newTable->numElements.load(std::memory_order_acquire);
+    for (Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex) {
+        Object *element = biasedTableElementValueToObject(newTable->elements[elementIndex].biasedValue.load(std::memory_order_acquire));
+        Object *newElement = remapToClonedCompartment(element, newTable->compartment);
+        newTable->elements[elementIndex].biasedValue.store(objectToBiasedTableElementValue(newElement), std::memory_order_release);
+    }
+}
+
 Table::~Table() {
     if (id != UINTPTR_MAX) {
 
@@ -145,18 +208,11 @@ Table::~Table() {
 
         wavmAssert(compartment->runtimeData->tableBases[id] == elements);
         compartment->runtimeData->tableBases[id] = nullptr;
+        compartment->runtimeData->tableNumElements[id] = 0;
     }
 
-    // Remove the table from the global array.
-    {
-        Lock<Platform::Mutex> tablesLock(tablesMutex);
-        for (Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex) {
-            if (tables[tableIndex] == this) {
-                tables.erase(tables.begin() + tableIndex);
-                break;
-            }
-        }
-    }
+    // Remove the table from the global set.
+    tableRegistry.remove(this);
 
     // Free the virtual address space.
     const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
@@ -212,6 +268,10 @@ Object *Runtime::setTableElement(Table *table, Uptr index, Object *newValue) {
         newValue = getUninitializedElement();
     }
 
+    // Record the uncounted reference from the table before writing it, so the tracing collector
+    // can't miss the object if it's marking the compartment.
+    addUncountedReference(table->compartment, newValue, table->definingModuleInstanceId);
+
     // Write the table element.
     Object *oldObject = setTableElementNonNull(table, index, newValue);
 
@@ -230,13 +290,44 @@ Uptr Runtime::getTableNumElements(Table *table) {
     return table->numElements.load(std::memory_order_acquire);
 }
 
+bool Runtime::isAddressOwnedByTable(U8 *address, Table *&outTable, Uptr &outTableIndex) {
+    // Iterate over all tables and check if the address is within the reserved address space for
+    // each.
+    Table *table = tableRegistry.find([address](Table *table) {
+        return address >= reinterpret_cast<U8 *>(table->elements) && address < reinterpret_cast<U8 *>(table->elements) + table->numReservedBytes;
+    });
+    if (!table) {
+        return false;
+    }
+
+    outTable = table;
+    outTableIndex = (address - reinterpret_cast<U8 *>(table->elements)) / sizeof(Table::Element);
+    return true;
+}
+
+// The inline table.get and table.set code calls the intrinsics for indices past the end of the
+// table, so they must not access the element. Elements past the end may be in uncommitted pages, or
+// hold the out-of-bounds sentinel, which must not be returned to or overwritten by WebAssembly code.
+// Instead, raise an access violation at the element's address, which invoke turns into a Trap, as
+// it would for a fault in the table's reserved pages.
+static void validateTableIndex(Table *table, Uptr index) {
+    if (index >= table->numElements.load(std::memory_order_acquire)) {
+        Platform::Signal signal;
+        signal.type = Platform::Signal::Type::accessViolation;
+        signal.accessViolation.address = reinterpret_cast<Uptr>(table->elements + index);
+        Platform::raiseSignal(signal);
+    }
+}
+
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "table.get", Object*, table_get, U32 index, Uptr tableId) {
     Table *table = getTableFromRuntimeData(contextRuntimeData, tableId);
+    validateTableIndex(table, index);
     return getTableElement(table, index);
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "table.set", void, table_set, U32 index, Object *value, Uptr tableId) {
     Table *table = getTableFromRuntimeData(contextRuntimeData, tableId);
+    validateTableIndex(table, index);
     setTableElement(table, index, value);
 }
 
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "WAVM/Inline/BasicTypes.h"
+
+namespace WAVM {
+    namespace Benchmark {
+        // Benchmarks run a short version of themselves when passed --quick, so the test suite can
+        // check that they still work without spending the time to get stable measurements.
+        inline bool isQuickRun(int argc, char **argv) {
+            for (int argIndex = 1; argIndex < argc; ++argIndex) {
+                if (!strcmp(argv[argIndex], "--quick")) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Calls func numIterations times, and returns the average number of nanoseconds per call in
+        // the fastest of a few repetitions.
+        template<typename Func> double measureNanosecondsPerIteration(Uptr numIterations, Func &&func) {
+            double bestNanosecondsPerIteration = 0.0;
+            for (Uptr repetition = 0; repetition < 3; ++repetition) {
+                const auto startTime = std::chrono::steady_clock::now();
+                for (Uptr iteration = 0; iteration < numIterations; ++iteration) {
+                    func();
+                }
+                const auto endTime = std::chrono::steady_clock::now();
+
+                const double nanosecondsPerIteration =
+                        std::chrono::duration<double, std::nano>(endTime - startTime).count() / double(numIterations);
+                if (!repetition || nanosecondsPerIteration < bestNanosecondsPerIteration) {
+                    bestNanosecondsPerIteration = nanosecondsPerIteration;
+                }
+            }
+            return bestNanosecondsPerIteration;
+        }
+
+        inline void printResult(const char *name, double nanosecondsPerIteration) {
+            printf("%-56s %12.2f ns\n", name, nanosecondsPerIteration);
+        }
+    }
+}
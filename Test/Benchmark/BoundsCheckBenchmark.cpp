@@ -0,0 +1,122 @@
+// Compares the cost of memory accesses in modules compiled with explicit bounds checks against
+// modules that rely on the guard pages reserved after each memory. Also checks that an explicit
+// bounds check traps for an access that overhangs the end of a memory, shared or not, and that
+// table.get and table.set trap for an index past the end of a table.
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Sums loads and stores a running total at addresses that step through the first 64KB of memory.
+static const char *benchmarkWAST =
+        "(module\n"
+        "  (memory 1)\n"
+        "  (func (export \"loadAndStore\") (param $numIterations i32) (result i32)\n"
+        "    (local $address i32) (local $sum i32)\n"
+        "    (block $done\n"
+        "      (loop $loop\n"
+        "        (br_if $done (i32.eqz (get_local $numIterations)))\n"
+        "        (set_local $sum (i32.add (get_local $sum) (i32.load (get_local $address))))\n"
+        "        (i64.store offset=8 (get_local $address) (i64.extend_u/i32 (get_local $sum)))\n"
+        "        (set_local $address (i32.and (i32.add (get_local $address) (i32.const 68)) (i32.const 0xffe0)))\n"
+        "        (set_local $numIterations (i32.sub (get_local $numIterations) (i32.const 1)))\n"
+        "        (br $loop)))\n"
+        "    (get_local $sum)))\n";
+
+// Loads from an address in a memory of one page.
+static const char *loadWAST =
+        "(module\n"
+        "  (memory 1 1)\n"
+        "  (func (export \"load\") (param $address i32) (result i32)\n"
+        "    (i32.load (get_local $address))))\n";
+static const char *sharedLoadWAST =
+        "(module\n"
+        "  (memory 1 1 shared)\n"
+        "  (func (export \"load\") (param $address i32) (result i32)\n"
+        "    (i32.load (get_local $address))))\n";
+
+static void checkBoundsCheckTraps(const char *wast) {
+    ModuleRef module = Benchmark::compileWASTModule(wast, [](FeatureSpec &featureSpec) {
+        featureSpec.explicitBoundsChecks = true;
+    });
+
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    Function *function = Benchmark::instantiateAndGetFunction(compartment, module, "load");
+
+    // The last 4 bytes of the memory may be loaded, but a load of the last 3 bytes and one past the
+    // end must trap.
+    invokeFunctionChecked(context, function, {Value(I32(IR::numBytesPerPage - 4))});
+    bool trapped = false;
+    try {
+        invokeFunctionChecked(context, function, {Value(I32(IR::numBytesPerPage - 3))});
+    } catch (Trap trap) {
+        trapped = trap.type == Trap::Type::outOfBoundsMemoryAccess;
+    }
+    errorUnless(trapped);
+}
+
+// Gets and sets an element of a table of two elements.
+static const char *tableWAST =
+        "(module\n"
+        "  (table 2 anyref)\n"
+        "  (func (export \"get\") (param $index i32) (result anyref)\n"
+        "    (table.get 0 (get_local $index)))\n"
+        "  (func (export \"set\") (param $index i32)\n"
+        "    (table.set 0 (get_local $index) (ref.null))))\n";
+
+static void checkTableAccessTraps() {
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    ModuleInstance *moduleInstance = instantiateModule(compartment, Benchmark::compileWASTModule(tableWAST), {}, "benchmark");
+    errorUnless(moduleInstance);
+
+    for (const char *exportName : {"get", "set"}) {
+        Function *function = asFunction(getInstanceExport(moduleInstance, exportName));
+        invokeFunctionChecked(context, function, {Value(I32(1))});
+        for (I32 index : {2, -1}) {
+            bool trapped = false;
+            try {
+                invokeFunctionChecked(context, function, {Value(index)});
+            } catch (Trap trap) {
+                trapped = trap.type == Trap::Type::outOfBoundsTableAccess;
+            }
+            errorUnless(trapped);
+        }
+    }
+}
+
+static void runBenchmark(const char *name, bool explicitBoundsChecks, Uptr numIterations, U32 numAccessesPerIteration) {
+    ModuleRef module = Benchmark::compileWASTModule(benchmarkWAST, [explicitBoundsChecks](FeatureSpec &featureSpec) {
+        featureSpec.explicitBoundsChecks = explicitBoundsChecks;
+    });
+
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    Function *function = Benchmark::instantiateAndGetFunction(compartment, module, "loadAndStore");
+
+    const std::vector<Value> args{Value(I32(numAccessesPerIteration))};
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        invokeFunctionChecked(context, function, args);
+    });
+    Benchmark::printResult(name, nanoseconds / numAccessesPerIteration);
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numAccessesPerIteration = isQuickRun ? 1000 : 1000000;
+
+    checkBoundsCheckTraps(loadWAST);
+    checkBoundsCheckTraps(sharedLoadWAST);
+    checkTableAccessTraps();
+
+    runBenchmark("load+store, guard page bounds checks (per iteration)", false, numIterations, numAccessesPerIteration);
+    runBenchmark("load+store, explicit bounds checks (per iteration)", true, numIterations, numAccessesPerIteration);
+    return 0;
+}
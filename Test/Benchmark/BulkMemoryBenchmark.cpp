@@ -0,0 +1,114 @@
+// Measures the bulk memory kernels used for memory.copy and memory.fill over a sweep of sizes,
+// against the C library's memcpy, memset and memmove. The kernel is chosen by size and by the host
+// CPU's features, so the sweep covers each size range the kernel selection distinguishes. Before
+// timing each size, the kernels' results are checked, including overlapping moves in both
+// directions.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Platform/Intrinsic.h"
+
+using namespace WAVM;
+
+// Overlapping moves offset the destination from the source by this many bytes.
+static constexpr Uptr moveOverlapBytes = 8;
+
+static void fillPattern(U8 *bytes, Uptr numBytes, U8 seed) {
+    for (Uptr byteIndex = 0; byteIndex < numBytes; ++byteIndex) {
+        bytes[byteIndex] = U8(byteIndex * 131 + seed);
+    }
+}
+
+// Checks the kernels' results against the C library's for one size. The ranges start at odd offsets,
+// so the kernels' unaligned heads are checked too.
+static void checkKernels(Uptr numBytes) {
+    std::vector<U8> source(numBytes + 64);
+    std::vector<U8> dest(numBytes + 64);
+    std::vector<U8> expected(numBytes + 64);
+    fillPattern(source.data(), source.size(), 1);
+
+    fillPattern(dest.data(), dest.size(), 2);
+    fillPattern(expected.data(), expected.size(), 2);
+    Platform::bytewiseMemCopy(dest.data() + 3, source.data() + 5, numBytes);
+    memcpy(expected.data() + 3, source.data() + 5, numBytes);
+    errorUnless(dest == expected);
+
+    Platform::bytewiseMemSet(dest.data() + 3, 0xa5, numBytes);
+    memset(expected.data() + 3, 0xa5, numBytes);
+    errorUnless(dest == expected);
+
+    // Move up, where each source byte must be read before the copy overwrites it, and then down.
+    fillPattern(dest.data(), dest.size(), 3);
+    fillPattern(expected.data(), expected.size(), 3);
+    Platform::bytewiseMemMove(dest.data() + 3 + moveOverlapBytes, dest.data() + 3, numBytes);
+    memmove(expected.data() + 3 + moveOverlapBytes, expected.data() + 3, numBytes);
+    errorUnless(dest == expected);
+
+    Platform::bytewiseMemMove(dest.data() + 3, dest.data() + 3 + moveOverlapBytes, numBytes);
+    memmove(expected.data() + 3, expected.data() + 3 + moveOverlapBytes, numBytes);
+    errorUnless(dest == expected);
+}
+
+template<typename Func> static void runBenchmark(const char *operationName, Uptr numBytes, Uptr numIterations, Func &&func) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s, %" PRIuPTR " bytes", operationName, numBytes);
+    Benchmark::printResult(name, Benchmark::measureNanosecondsPerIteration(numIterations, func));
+}
+
+static void runBenchmarks(U8 *source, U8 *dest, Uptr numBytes, Uptr numIterations) {
+    runBenchmark("bytewiseMemCopy", numBytes, numIterations, [&]() {
+        Platform::bytewiseMemCopy(dest, source, numBytes);
+    });
+    runBenchmark("memcpy", numBytes, numIterations, [&]() {
+        memcpy(dest, source, numBytes);
+    });
+
+    runBenchmark("bytewiseMemSet", numBytes, numIterations, [&]() {
+        Platform::bytewiseMemSet(dest, U8(numIterations), numBytes);
+    });
+    runBenchmark("memset", numBytes, numIterations, [&]() {
+        memset(dest, U8(numIterations), numBytes);
+    });
+
+    runBenchmark("bytewiseMemMove, overlapping up", numBytes, numIterations, [&]() {
+        Platform::bytewiseMemMove(dest + moveOverlapBytes, dest, numBytes);
+    });
+    runBenchmark("memmove, overlapping up", numBytes, numIterations, [&]() {
+        memmove(dest + moveOverlapBytes, dest, numBytes);
+    });
+    runBenchmark("bytewiseMemMove, overlapping down", numBytes, numIterations, [&]() {
+        Platform::bytewiseMemMove(dest, dest + moveOverlapBytes, numBytes);
+    });
+    runBenchmark("memmove, overlapping down", numBytes, numIterations, [&]() {
+        memmove(dest, dest + moveOverlapBytes, numBytes);
+    });
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+
+    // The sizes step by factors of 4 from 16 bytes, through the short string instruction, vector
+    // loop and string instruction ranges, to sizes that use non-temporal stores.
+    const Uptr maxNumBytes = isQuickRun ? Uptr(16) * 1024 * 1024 : Uptr(64) * 1024 * 1024;
+    const Uptr numBytesPerSize = isQuickRun ? Uptr(16) * 1024 * 1024 : Uptr(256) * 1024 * 1024;
+
+    std::vector<U8> source(maxNumBytes + moveOverlapBytes);
+    std::vector<U8> dest(maxNumBytes + moveOverlapBytes);
+    fillPattern(source.data(), source.size(), 1);
+    fillPattern(dest.data(), dest.size(), 2);
+
+    for (Uptr numBytes = 16; numBytes <= maxNumBytes; numBytes *= 4) {
+        // Also check a size that isn't a whole number of vectors, to check the kernels' tails.
+        checkKernels(numBytes);
+        checkKernels(numBytes + 37);
+
+        const Uptr numIterations = numBytesPerSize / numBytes;
+        runBenchmarks(source.data(), dest.data(), numBytes, numIterations ? numIterations : 1);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Measures call-dense code: a loop that calls a small function and accesses memory on both sides of
+// each call, so the caller needs the memory's base address after every call. Also checks that the
+// caller can still access a memory after a callee grows it.
+
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// The callee adds a value to a word of memory, and returns the old word mixed with the value. The
+// caller loads the value it passes before the call, and another word after it, at addresses that
+// step through the first 32KB of memory. The running sum starts at the number of calls, so the
+// memory doesn't stay zeroed.
+static const char *benchmarkWAST =
+        "(module\n"
+        "  (memory 1)\n"
+        "  (func $step (param $address i32) (param $value i32) (result i32)\n"
+        "    (local $old i32)\n"
+        "    (set_local $old (i32.load (get_local $address)))\n"
+        "    (i32.store (get_local $address) (i32.add (get_local $old) (get_local $value)))\n"
+        "    (i32.xor (get_local $old) (get_local $value)))\n"
+        "  (func (export \"run\") (param $numCalls i32) (result i32)\n"
+        "    (local $address i32) (local $sum i32)\n"
+        "    (set_local $sum (get_local $numCalls))\n"
+        "    (block $done\n"
+        "      (loop $loop\n"
+        "        (br_if $done (i32.eqz (get_local $numCalls)))\n"
+        "        (set_local $sum (call $step (get_local $address)\n"
+        "          (i32.add (get_local $sum) (i32.load offset=4 (get_local $address)))))\n"
+        "        (set_local $sum (i32.add (get_local $sum) (i32.load offset=8 (get_local $address))))\n"
+        "        (set_local $address (i32.and (i32.add (get_local $address) (i32.const 68)) (i32.const 0x7ffc)))\n"
+        "        (set_local $numCalls (i32.sub (get_local $numCalls) (i32.const 1)))\n"
+        "        (br $loop)))\n"
+        "    (get_local $sum)))\n";
+
+// Computes the result of the benchmark module's run function.
+static I32 computeExpectedResult(U32 numCalls) {
+    std::vector<U8> memory(IR::numBytesPerPage + 16, 0);
+    auto load = [&](U32 address) {
+        U32 value;
+        memcpy(&value, memory.data() + address, sizeof(value));
+        return value;
+    };
+
+    U32 address = 0;
+    U32 sum = numCalls;
+    for (; numCalls; --numCalls) {
+        const U32 value = sum + load(address + 4);
+        const U32 old = load(address);
+        const U32 updated = old + value;
+        memcpy(memory.data() + address, &updated, sizeof(updated));
+        sum = old ^ value;
+        sum += load(address + 8);
+        address = (address + 68) & 0x7ffc;
+    }
+    return I32(sum);
+}
+
+// The callee grows the memory by a page, and the caller stores to and loads from the new page.
+static const char *growWAST =
+        "(module\n"
+        "  (memory 1 2)\n"
+        "  (func $grow (result i32) (memory.grow (i32.const 1)))\n"
+        "  (func (export \"growAndAccess\") (result i32)\n"
+        "    (drop (i32.load (i32.const 0)))\n"
+        "    (drop (call $grow))\n"
+        "    (i32.store (i32.const 65536) (i32.const 42))\n"
+        "    (i32.load (i32.const 65536))))\n";
+
+static void checkAccessAfterGrow() {
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    Function *function = Benchmark::instantiateAndGetFunction(compartment, Benchmark::compileWASTModule(growWAST), "growAndAccess");
+    errorUnless(invokeFunctionChecked(context, function, {})[0].i32 == 42);
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numCallsPerIteration = isQuickRun ? 1000 : 1000000;
+
+    checkAccessAfterGrow();
+
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    Function *function = Benchmark::instantiateAndGetFunction(compartment, Benchmark::compileWASTModule(benchmarkWAST), "run");
+
+    // Only the first call starts with zeroed memory, so only its result is known. Make enough calls
+    // that the addresses wrap around, and the callee updates words it has already updated.
+    const U32 numCheckedCalls = 4096;
+    errorUnless(invokeFunctionChecked(context, function, {Value(I32(numCheckedCalls))})[0].i32 == computeExpectedResult(numCheckedCalls));
+
+    const std::vector<Value> args{Value(I32(numCallsPerIteration))};
+
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        invokeFunctionChecked(context, function, args);
+    });
+    Benchmark::printResult("call with memory accesses around it (per call)", nanoseconds / numCallsPerIteration);
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Measures float-to-int conversions in a loop like the output stage of an image or audio decoder:
+// it loads normalized samples, scales them, converts them to integers, and stores the integers.
+// Each trapping and saturating conversion is measured separately. Also checks each conversion's
+// results for the operands at the edges of its range, where a lowering that detects invalid
+// operands from the hardware's result could go wrong, and the saturating conversions' results for
+// NaNs and out-of-range operands.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static constexpr U32 numSamples = 4096;
+static constexpr U32 outputOffset = 32768;
+
+// A conversion operator to measure, and the results it must produce. Expected results are the
+// signed interpretation of the result's bits.
+struct Conversion {
+    const char *op;
+    ValueType floatType;
+    ValueType intType;
+    std::vector<std::pair<F64, I64>> checks;
+};
+
+// Returns a module that converts one operand with the conversion, and a decode loop that converts
+// the samples in memory to bytes. The loop wraps around the samples until it has converted as many
+// as it's asked to.
+static std::string getConversionWAST(const Conversion &conversion) {
+    const std::string floatType = asString(conversion.floatType);
+    const std::string intType = asString(conversion.intType);
+    const std::string sampleShift = conversion.floatType == ValueType::f32 ? "2" : "3";
+    std::string convertedSample = "(" + std::string(conversion.op) + " (" + floatType + ".mul (" + floatType +
+                                  ".load (i32.shl (get_local $index) (i32.const " + sampleShift + "))) (" + floatType +
+                                  ".const 255)))";
+    if (conversion.intType == ValueType::i64) {
+        convertedSample = "(i32.wrap/i64 " + convertedSample + ")";
+    }
+
+    return "(module\n"
+           "  (memory (export \"memory\") 1)\n"
+           "  (func (export \"convert\") (param " + floatType + ") (result " + intType + ")\n"
+           "    (" + conversion.op + " (get_local 0)))\n"
+           "  (func (export \"decode\") (param $numSamples i32) (result i32)\n"
+           "    (local $index i32) (local $value i32) (local $sum i32)\n"
+           "    (block $done\n"
+           "      (loop $loop\n"
+           "        (br_if $done (i32.eqz (get_local $numSamples)))\n"
+           "        (set_local $value " + convertedSample + ")\n"
+           "        (i32.store8 offset=" + std::to_string(outputOffset) + " (get_local $index) (get_local $value))\n"
+           "        (set_local $sum (i32.add (get_local $sum) (get_local $value)))\n"
+           "        (set_local $index (i32.and (i32.add (get_local $index) (i32.const 1)) (i32.const " + std::to_string(numSamples - 1) + ")))\n"
+           "        (set_local $numSamples (i32.sub (get_local $numSamples) (i32.const 1)))\n"
+           "        (br $loop)))\n"
+           "    (get_local $sum)))\n";
+}
+
+// Returns a sample in [0, 1) that is spread over the range, but doesn't depend on the host's
+// random number generator.
+static F64 getSample(U32 index) {
+    return F64(((index * 2654435761u) >> 16) & 0xffff) / 65536.0;
+}
+
+static void checkConversion(Context *context, ModuleInstance *moduleInstance, const Conversion &conversion) {
+    Function *function = asFunction(getInstanceExport(moduleInstance, "convert"));
+    for (const auto &check : conversion.checks) {
+        const Value operand = conversion.floatType == ValueType::f32 ? Value(F32(check.first)) : Value(check.first);
+        const Value result = invokeFunctionChecked(context, function, {operand})[0];
+        errorUnless((conversion.intType == ValueType::i32 ? I64(result.i32) : result.i64) == check.second);
+    }
+}
+
+static void runBenchmark(const Conversion &conversion, Uptr numIterations, U32 numSamplesPerIteration) {
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    ModuleInstance *moduleInstance = instantiateModule(compartment, Benchmark::compileWASTModule(getConversionWAST(conversion).c_str()), {}, "benchmark");
+    errorUnless(moduleInstance);
+    checkConversion(context, moduleInstance, conversion);
+
+    // Write the samples, and compute the sum of the converted samples that decode should return.
+    U8 *memoryBase = getMemoryBaseAddress(asMemory(getInstanceExport(moduleInstance, "memory")));
+    U32 expectedSum = 0;
+    for (U32 sampleIndex = 0; sampleIndex < numSamples; ++sampleIndex) {
+        if (conversion.floatType == ValueType::f32) {
+            const F32 sample = F32(getSample(sampleIndex));
+            memcpy(memoryBase + sampleIndex * sizeof(F32), &sample, sizeof(F32));
+        } else {
+            const F64 sample = getSample(sampleIndex);
+            memcpy(memoryBase + sampleIndex * sizeof(F64), &sample, sizeof(F64));
+        }
+    }
+    for (U32 sampleIndex = 0; sampleIndex < numSamplesPerIteration; ++sampleIndex) {
+        const U32 wrappedIndex = sampleIndex & (numSamples - 1);
+        expectedSum += U32(conversion.floatType == ValueType::f32 ? F32(getSample(wrappedIndex)) * F32(255) : getSample(wrappedIndex) * 255);
+    }
+
+    Function *function = asFunction(getInstanceExport(moduleInstance, "decode"));
+    const std::vector<Value> args{Value(I32(numSamplesPerIteration))};
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        errorUnless(U32(invokeFunctionChecked(context, function, args)[0].i32) == expectedSum);
+    });
+    Benchmark::printResult((std::string(conversion.op) + " decode (per sample)").c_str(), nanoseconds / numSamplesPerIteration);
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numSamplesPerIteration = isQuickRun ? 1000 : 1000000;
+
+    // The trapping conversions are only checked with valid operands, including the minimum signed
+    // integer, which is also the result cvttss2si/cvttsd2si return for invalid operands.
+    const std::vector<Conversion> conversions{
+            {"i32.trunc_s/f32", ValueType::f32, ValueType::i32, {{-2147483648.0, INT32_MIN}, {2147483520.0, 2147483520}, {-1.9, -1}}},
+            {"i32.trunc_u/f32", ValueType::f32, ValueType::i32, {{4294967040.0, -256}, {-0.9, 0}, {3.9, 3}}},
+            {"i32.trunc_s/f64", ValueType::f64, ValueType::i32, {{-2147483648.9, INT32_MIN}, {2147483647.9, INT32_MAX}}},
+            {"i32.trunc_u/f64", ValueType::f64, ValueType::i32, {{4294967295.9, -1}, {-0.9, 0}}},
+            {"i64.trunc_s/f64", ValueType::f64, ValueType::i64, {{-9223372036854775808.0, INT64_MIN}, {-1.5, -1}}},
+            {"i32.trunc_s:sat/f32", ValueType::f32, ValueType::i32, {{NAN, 0}, {INFINITY, INT32_MAX}, {-INFINITY, INT32_MIN}, {3e9, INT32_MAX}, {-2147483648.0, INT32_MIN}}},
+            {"i32.trunc_u:sat/f32", ValueType::f32, ValueType::i32, {{NAN, 0}, {-1.0, 0}, {5e9, -1}, {4294967040.0, -256}}},
+            {"i32.trunc_s:sat/f64", ValueType::f64, ValueType::i32, {{NAN, 0}, {3e9, INT32_MAX}, {-3e9, INT32_MIN}, {-2147483648.9, INT32_MIN}}},
+            {"i64.trunc_s:sat/f64", ValueType::f64, ValueType::i64, {{NAN, 0}, {1e19, INT64_MAX}, {-1e19, INT64_MIN}, {-9223372036854775808.0, INT64_MIN}}},
+    };
+    for (const Conversion &conversion : conversions) {
+        runBenchmark(conversion, numIterations, numSamplesPerIteration);
+    }
+    return 0;
+}
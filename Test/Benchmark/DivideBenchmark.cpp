@@ -0,0 +1,69 @@
+// Compares the cost of integer division in modules compiled with explicit checks for a zero divisor
+// and signed overflow against modules that rely on the hardware division instruction to trap.
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Divides a running total by a divisor that changes each iteration, so the divisor isn't a constant
+// and the checks can't be folded away. The divisor is never zero unless $divisorBase is zero.
+static const char *benchmarkWAST =
+        "(module\n"
+        "  (func (export \"divide\") (param $numIterations i32) (param $divisorBase i32) (result i32)\n"
+        "    (local $divisor i32) (local $sum i32)\n"
+        "    (set_local $sum (i32.const 0x7fffffff))\n"
+        "    (block $done\n"
+        "      (loop $loop\n"
+        "        (br_if $done (i32.eqz (get_local $numIterations)))\n"
+        "        (set_local $divisor (i32.mul (get_local $divisorBase) (i32.add (i32.and (get_local $numIterations) (i32.const 7)) (i32.const 1))))\n"
+        "        (set_local $sum (i32.add (i32.div_s (get_local $sum) (get_local $divisor))\n"
+        "                                 (i32.rem_u (get_local $numIterations) (get_local $divisor))))\n"
+        "        (set_local $sum (i32.add (i32.div_u (i32.const 0x7fffffff) (get_local $divisor))\n"
+        "                                 (i32.rem_s (get_local $sum) (get_local $divisor))))\n"
+        "        (set_local $numIterations (i32.sub (get_local $numIterations) (i32.const 1)))\n"
+        "        (br $loop)))\n"
+        "    (get_local $sum)))\n";
+
+static void runBenchmark(const char *name, bool hardwareDivideTraps, Uptr numIterations, U32 numLoopsPerIteration) {
+    ModuleRef module = Benchmark::compileWASTModule(benchmarkWAST, [hardwareDivideTraps](FeatureSpec &featureSpec) {
+        featureSpec.hardwareDivideTraps = hardwareDivideTraps;
+    });
+
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    Function *function = Benchmark::instantiateAndGetFunction(compartment, module, "divide");
+
+    const std::vector<Value> args{Value(I32(numLoopsPerIteration)), Value(I32(3))};
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        invokeFunctionChecked(context, function, args);
+    });
+    Benchmark::printResult(name, nanoseconds / numLoopsPerIteration);
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // Check that the hardware trap for a zero divisor is caught and reported as a Trap.
+    if (hardwareDivideTraps) {
+        bool trapped = false;
+        try {
+            invokeFunctionChecked(context, function, {Value(I32(1)), Value(I32(0))});
+        } catch (Trap trap) {
+            trapped = trap.type == Trap::Type::integerDivideByZeroOrIntegerOverflow;
+        }
+        errorUnless(trapped);
+    }
+#endif
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numLoopsPerIteration = isQuickRun ? 1000 : 1000000;
+
+    runBenchmark("4 divides, explicit checks (per iteration)", false, numIterations, numLoopsPerIteration);
+    runBenchmark("4 divides, hardware traps (per iteration)", true, numIterations, numLoopsPerIteration);
+    return 0;
+}
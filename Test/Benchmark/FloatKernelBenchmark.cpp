@@ -0,0 +1,104 @@
+// Measures a numeric kernel that rounds and clamps floats, using the ceil, floor, trunc, nearest,
+// min and max operators, for f32 and f64. Also checks the operators' results for the special cases
+// where WebAssembly's semantics differ from the C library's and the hardware's: NaNs, signed zeros
+// and ties.
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Returns a module with a kernel for one float type: it derives a value from the loop counter,
+// rounds it each way, clamps the rounded value, and sums the results.
+static std::string getKernelWAST(const char *type) {
+    std::string wast =
+            "(module\n"
+            "  (func (export \"kernel\") (param $numIterations i32) (result T)\n"
+            "    (local $x T) (local $sum T)\n"
+            "    (block $done\n"
+            "      (loop $loop\n"
+            "        (br_if $done (i32.eqz (get_local $numIterations)))\n"
+            "        (set_local $x (T.mul (T.convert_s/i32 (get_local $numIterations)) (T.const -0.37)))\n"
+            "        (set_local $sum (T.add (get_local $sum)\n"
+            "          (T.add (T.add (T.ceil (get_local $x)) (T.floor (get_local $x)))\n"
+            "                 (T.add (T.trunc (get_local $x))\n"
+            "                        (T.min (T.max (T.nearest (get_local $x)) (T.const -1000)) (T.const 1000))))))\n"
+            "        (set_local $numIterations (i32.sub (get_local $numIterations) (i32.const 1)))\n"
+            "        (br $loop)))\n"
+            "    (get_local $sum))\n"
+            "  (func (export \"ceil\") (param T) (result T) (T.ceil (get_local 0)))\n"
+            "  (func (export \"floor\") (param T) (result T) (T.floor (get_local 0)))\n"
+            "  (func (export \"trunc\") (param T) (result T) (T.trunc (get_local 0)))\n"
+            "  (func (export \"nearest\") (param T) (result T) (T.nearest (get_local 0)))\n"
+            "  (func (export \"min\") (param T T) (result T) (T.min (get_local 0) (get_local 1)))\n"
+            "  (func (export \"max\") (param T T) (result T) (T.max (get_local 0) (get_local 1))))\n";
+    for (Uptr offset = wast.find('T'); offset != std::string::npos; offset = wast.find('T', offset + strlen(type))) {
+        wast.replace(offset, 1, type);
+    }
+    return wast;
+}
+
+// Checks the result of one of the kernel module's operator functions. NaN results are only checked
+// to be NaNs, since WebAssembly doesn't specify their sign or payload.
+static void checkOperator(Context *context, ModuleInstance *moduleInstance, const char *exportName, const std::vector<Value> &args, F64 expectedResult) {
+    Function *function = asFunction(getInstanceExport(moduleInstance, exportName));
+    const Value result = invokeFunctionChecked(context, function, args)[0];
+    const F64 resultF64 = result.type == ValueType::f32 ? F64(result.f32) : result.f64;
+    if (isnan(expectedResult)) {
+        errorUnless(isnan(resultF64));
+    } else {
+        errorUnless(resultF64 == expectedResult && signbit(resultF64) == signbit(expectedResult));
+    }
+}
+
+template<typename Float> static void checkOperators(Context *context, ModuleInstance *moduleInstance) {
+    const Float nan = Float(NAN);
+    checkOperator(context, moduleInstance, "ceil", {Value(Float(-0.5))}, -0.0);
+    checkOperator(context, moduleInstance, "floor", {Value(Float(-0.5))}, -1.0);
+    checkOperator(context, moduleInstance, "trunc", {Value(Float(-0.5))}, -0.0);
+    checkOperator(context, moduleInstance, "nearest", {Value(Float(2.5))}, 2.0);
+    checkOperator(context, moduleInstance, "nearest", {Value(Float(-3.5))}, -4.0);
+    checkOperator(context, moduleInstance, "floor", {Value(nan)}, NAN);
+    checkOperator(context, moduleInstance, "min", {Value(Float(-0.0)), Value(Float(0.0))}, -0.0);
+    checkOperator(context, moduleInstance, "min", {Value(Float(0.0)), Value(Float(-0.0))}, -0.0);
+    checkOperator(context, moduleInstance, "max", {Value(Float(-0.0)), Value(Float(0.0))}, 0.0);
+    checkOperator(context, moduleInstance, "max", {Value(Float(0.0)), Value(Float(-0.0))}, 0.0);
+    checkOperator(context, moduleInstance, "min", {Value(Float(1.0)), Value(nan)}, NAN);
+    checkOperator(context, moduleInstance, "max", {Value(nan), Value(Float(1.0))}, NAN);
+    checkOperator(context, moduleInstance, "min", {Value(Float(1.0)), Value(Float(-INFINITY))}, -INFINITY);
+    checkOperator(context, moduleInstance, "max", {Value(Float(1.0)), Value(Float(2.0))}, 2.0);
+}
+
+template<typename Float> static void runBenchmark(const char *name, const char *type, Uptr numIterations, U32 numLoopsPerIteration) {
+    ModuleRef module = Benchmark::compileWASTModule(getKernelWAST(type).c_str());
+
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    ModuleInstance *moduleInstance = instantiateModule(compartment, module, {}, "benchmark");
+    errorUnless(moduleInstance);
+    checkOperators<Float>(context, moduleInstance);
+
+    Function *function = asFunction(getInstanceExport(moduleInstance, "kernel"));
+    const std::vector<Value> args{Value(I32(numLoopsPerIteration))};
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        invokeFunctionChecked(context, function, args);
+    });
+    Benchmark::printResult(name, nanoseconds / numLoopsPerIteration);
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numLoopsPerIteration = isQuickRun ? 1000 : 1000000;
+
+    runBenchmark<F32>("f32 round and clamp kernel (per iteration)", "f32", numIterations, numLoopsPerIteration);
+    runBenchmark<F64>("f64 round and clamp kernel (per iteration)", "f64", numIterations, numLoopsPerIteration);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Measures the cost of adding, removing and looking up IndexMap elements in maps of different
+// sizes. The compartment allocates object IDs with IndexMap, so these costs should stay constant as
+// the number of objects in a compartment grows, even after many IDs have been freed and reused.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "Benchmark.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/IndexMap.h"
+
+using namespace WAVM;
+
+static void runBenchmarks(Uptr numElements, Uptr numIterations) {
+    IndexMap<Uptr, Uptr> map(0, numElements - 1);
+    for (Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex) {
+        map.add(UINTPTR_MAX, elementIndex);
+    }
+
+    // With every index allocated, remove an element and add one in its place, stepping through the
+    // map so each remove frees a different index.
+    Uptr nextIndex = 0;
+    char name[128];
+    snprintf(name, sizeof(name), "remove+add in a full map of %" PRIuPTR " elements", numElements);
+    Benchmark::printResult(name, Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        map.removeOrFail(nextIndex);
+        if (map.add(UINTPTR_MAX, nextIndex) != nextIndex) {
+            Errors::fatal("IndexMap didn't reuse the freed index");
+        }
+        nextIndex = (nextIndex + 7919) % numElements;
+    }));
+
+    // Look up elements in a pseudo-random order.
+    Uptr sum = 0;
+    snprintf(name, sizeof(name), "lookup in a map of %" PRIuPTR " elements", numElements);
+    Benchmark::printResult(name, Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        sum += map[nextIndex];
+        nextIndex = (nextIndex + 7919) % numElements;
+    }));
+    if (sum == UINTPTR_MAX) {
+        printf("%" PRIuPTR "\n", sum);
+    }
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1000 : 10000000;
+    for (Uptr numElements : {Uptr(1024), Uptr(65536), Uptr(1048576)}) {
+        runBenchmarks(numElements, numIterations);
+    }
+    return 0;
+}
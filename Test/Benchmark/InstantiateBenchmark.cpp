@@ -0,0 +1,75 @@
+// Measures how the throughput of instantiating modules in a single compartment scales with the
+// number of threads instantiating them.
+
+#include <inttypes.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Each instance creates a memory, a table and mutable and immutable globals. The module is compiled
+// with explicit bounds checks so its memories only reserve address space for their maximum size,
+// and many instances can exist at once.
+static const char *benchmarkWAST =
+        "(module\n"
+        "  (memory 1 1)\n"
+        "  (table 16 anyfunc)\n"
+        "  (global $counter (mut i32) (i32.const 0))\n"
+        "  (global $limit i64 (i64.const 1000))\n"
+        "  (func $increment (export \"increment\") (result i32)\n"
+        "    (set_global $counter (i32.add (get_global $counter) (i32.const 1)))\n"
+        "    (get_global $counter))\n"
+        "  (elem (i32.const 0) $increment))\n";
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numInstancesPerThread = isQuickRun ? 8 : 512;
+    const Uptr maxThreads = isQuickRun ? 2 : std::max(1u, std::thread::hardware_concurrency());
+
+    ModuleRef module = Benchmark::compileWASTModule(benchmarkWAST, [](FeatureSpec &featureSpec) {
+        featureSpec.explicitBoundsChecks = true;
+    });
+
+    for (Uptr numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        Compartment *compartment = createCompartment();
+
+        // Start the threads together, so they contend for the compartment for the whole run.
+        std::atomic<bool> start{false};
+        std::vector<std::thread> threads;
+        for (Uptr threadIndex = 0; threadIndex < numThreads; ++threadIndex) {
+            threads.emplace_back([&]() {
+                while (!start.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                for (Uptr instanceIndex = 0; instanceIndex < numInstancesPerThread; ++instanceIndex) {
+                    if (!instantiateModule(compartment, module, {}, "benchmark")) {
+                        Errors::fatal("Failed to instantiate benchmark module");
+                    }
+                }
+            });
+        }
+
+        const auto startTime = std::chrono::steady_clock::now();
+        start.store(true, std::memory_order_release);
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        const auto endTime = std::chrono::steady_clock::now();
+
+        const double nanoseconds = std::chrono::duration<double, std::nano>(endTime - startTime).count();
+        const double instancesPerSecond = double(numThreads * numInstancesPerThread) / (nanoseconds * 1e-9);
+        printf("%3" PRIuPTR " threads: %12.0f instantiations/s\n", numThreads, instancesPerSecond);
+
+        // Nothing references the instances, so collecting the compartment deletes it along with them.
+        collectCompartmentGarbage(compartment);
+    }
+    return 0;
+}
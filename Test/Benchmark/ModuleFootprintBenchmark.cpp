@@ -0,0 +1,112 @@
+// Measures the resident memory used to compile a large module, and kept by the compiled module. A
+// compiled module keeps the IR needed to instantiate it, but releases its function bodies, so the
+// resident set should shrink by about the size of the function bodies once the IR the module was
+// compiled from is released.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <utility>
+
+#include "Benchmark.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/IR/Validate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Runtime/Runtime.h"
+
+#if defined(__linux__)
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Returns the number of bytes in the process's resident set, or 0 if it can't be measured.
+static Uptr getResidentBytes() {
+#if defined(__linux__)
+    // Return freed heap memory to the system first, so the resident set only counts live memory.
+    malloc_trim(0);
+
+    FILE *statmFile = fopen("/proc/self/statm", "r");
+    if (!statmFile) {
+        return 0;
+    }
+    Uptr numPages = 0;
+    Uptr numResidentPages = 0;
+    const bool readStatm = fscanf(statmFile, "%" SCNuPTR " %" SCNuPTR, &numPages, &numResidentPages) == 2;
+    fclose(statmFile);
+    return readStatm ? numResidentPages * Uptr(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+// Returns the largest number of bytes the process's resident set has had, or 0 if it can't be
+// measured.
+static Uptr getPeakResidentBytes() {
+#if defined(__linux__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : Uptr(usage.ru_maxrss) * 1024;
+#else
+    return 0;
+#endif
+}
+
+// Generates a module with many functions of the same size. The function bodies make up nearly all of
+// the module's IR.
+static IR::Module generateModule(Uptr numFunctions, Uptr numConstantsPerFunction) {
+    IR::Module irModule;
+    irModule.types.push_back(FunctionType());
+    for (Uptr functionIndex = 0; functionIndex < numFunctions; ++functionIndex) {
+        Serialization::ArrayOutputStream codeStream;
+        OperatorEncoderStream encoder(codeStream);
+        for (Uptr constantIndex = 0; constantIndex < numConstantsPerFunction; ++constantIndex) {
+            encoder.i32_const({I32(constantIndex)});
+            encoder.drop();
+        }
+        encoder.end();
+        irModule.functions.defs.push_back({{0}, {}, std::move(codeStream.getBytes()), {}});
+    }
+
+    IR::validatePreCodeSections(irModule);
+    DeferredCodeValidationState deferredCodeValidationState;
+    IR::validatePostCodeSections(irModule, deferredCodeValidationState);
+    return irModule;
+}
+
+static void printBytes(const char *name, Uptr numBytes) {
+    printf("%-56s %12.1f MiB\n", name, double(numBytes) / (1024.0 * 1024.0));
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numFunctions = isQuickRun ? 64 : 4096;
+    const Uptr numConstantsPerFunction = isQuickRun ? 1024 : 4096;
+
+    const Uptr initialResidentBytes = getResidentBytes();
+    IR::Module irModule = generateModule(numFunctions, numConstantsPerFunction);
+    Uptr numFunctionBodyBytes = 0;
+    for (const FunctionDef &functionDef : irModule.functions.defs) {
+        numFunctionBodyBytes += functionDef.code.size();
+    }
+    const Uptr irResidentBytes = getResidentBytes();
+
+    // Compile the module from the generated IR, which the compiled module takes without copying.
+    ModuleRef module = compileModule(std::move(irModule));
+    irModule = IR::Module();
+    const Uptr compiledResidentBytes = getResidentBytes();
+
+    printBytes("function bodies", numFunctionBodyBytes);
+    printBytes("resident, generated IR", irResidentBytes - initialResidentBytes);
+    printBytes("resident, compiled module", compiledResidentBytes - initialResidentBytes);
+    printBytes("peak resident", getPeakResidentBytes());
+
+    // The compiled module mustn't keep the function bodies.
+    for (const FunctionDef &functionDef : getModuleIR(module).functions.defs) {
+        errorUnless(functionDef.code.empty());
+    }
+    return 0;
+}
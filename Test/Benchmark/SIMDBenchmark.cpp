@@ -0,0 +1,182 @@
+// Measures the cost of SIMD operators, to find operators that the JIT lowers to long instruction
+// sequences on the host. Each operator is measured in a loop that applies it to eight independent
+// accumulators, and its cost is compared to the cost of i32x4.add, which lowers to a single
+// instruction on any target with SIMD. Operators that cost more than a few times as much are
+// flagged. Also checks the results of the operators with target-specific lowerings against scalar
+// implementations.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// An operator costing more than this many times as much as i32x4.add is flagged: a single
+// instruction with a longer latency, like pmullw, costs about twice as much.
+static constexpr double maxRelativeCost = 4.0;
+
+static constexpr Uptr numAccumulators = 8;
+
+// Returns a module that applies a binary operator to each accumulator in a loop, with an operand
+// loaded from memory. The operand isn't a constant, so shifts are lowered as shifts of each lane by a
+// variable count.
+static std::string getOperatorWAST(const char *op) {
+    std::string wast = "(module\n"
+                       "  (memory (export \"memory\") 1)\n"
+                       "  (func (export \"apply\") (param v128 v128) (result v128)\n"
+                       "    (" + std::string(op) + " (get_local 0) (get_local 1)))\n"
+                       "  (func (export \"run\") (param $numIterations i32) (result i32)\n"
+                       "    (local $x v128)";
+    for (Uptr accumulatorIndex = 0; accumulatorIndex < numAccumulators; ++accumulatorIndex) {
+        wast += " (local $a" + std::string(1, char('a' + accumulatorIndex)) + " v128)";
+    }
+    wast += "\n    (set_local $x (v128.load (i32.const 0)))\n";
+    for (Uptr accumulatorIndex = 0; accumulatorIndex < numAccumulators; ++accumulatorIndex) {
+        wast += "    (set_local $a" + std::string(1, char('a' + accumulatorIndex)) + " (v128.load (i32.const " +
+                std::to_string(16 * (accumulatorIndex + 1)) + ")))\n";
+    }
+    wast += "    (block $done\n"
+            "      (loop $loop\n"
+            "        (br_if $done (i32.eqz (get_local $numIterations)))\n";
+    for (Uptr accumulatorIndex = 0; accumulatorIndex < numAccumulators; ++accumulatorIndex) {
+        const std::string accumulator = "$a" + std::string(1, char('a' + accumulatorIndex));
+        wast += "        (set_local " + accumulator + " (" + op + " (get_local " + accumulator + ") (get_local $x)))\n";
+    }
+    wast += "        (set_local $numIterations (i32.sub (get_local $numIterations) (i32.const 1)))\n"
+            "        (br $loop)))\n";
+
+    // Combine the accumulators into the result, so none of the loop's work is dead.
+    std::string combined = "(get_local $aa)";
+    for (Uptr accumulatorIndex = 1; accumulatorIndex < numAccumulators; ++accumulatorIndex) {
+        combined = "(v128.xor " + combined + " (get_local $a" + std::string(1, char('a' + accumulatorIndex)) + "))";
+    }
+    wast += "    (i32x4.extract_lane 0 " + combined + ")))\n";
+    return wast;
+}
+
+// Returns a vector with the edge cases of each byte lane: zero, the signed limits and the unsigned
+// maximum, and bytes in between.
+static V128 getTestVector(U8 seed) {
+    static const U8 edgeBytes[] = {0x00, 0x01, 0x02, 0x7e, 0x7f, 0x80, 0x81, 0xfe, 0xff};
+    V128 vector;
+    for (Uptr laneIndex = 0; laneIndex < 16; ++laneIndex) {
+        vector.u8[laneIndex] = laneIndex < sizeof(edgeBytes) ? edgeBytes[(laneIndex + seed) % sizeof(edgeBytes)] : U8(laneIndex * 37 + seed * 11);
+    }
+    return vector;
+}
+
+template<typename Lane, typename Func> static V128 applyLanewise(const V128 &left, const V128 &right, Func &&func) {
+    Lane leftLanes[16 / sizeof(Lane)];
+    Lane rightLanes[16 / sizeof(Lane)];
+    memcpy(leftLanes, left.u8, sizeof(leftLanes));
+    memcpy(rightLanes, right.u8, sizeof(rightLanes));
+    V128 result;
+    for (Uptr laneIndex = 0; laneIndex < 16 / sizeof(Lane); ++laneIndex) {
+        const Lane lane = Lane(func(leftLanes[laneIndex], rightLanes[laneIndex]));
+        memcpy(result.u8 + laneIndex * sizeof(Lane), &lane, sizeof(Lane));
+    }
+    return result;
+}
+
+// Computes the result of the operators with target-specific lowerings.
+static bool getExpectedResult(const char *op, const V128 &left, const V128 &right, V128 &outResult) {
+    const std::string name = op;
+    if (name == "i8x16.mul") {
+        outResult = applyLanewise<U8>(left, right, [](U8 a, U8 b) { return a * b; });
+    } else if (name == "i8x16.add_saturate_u") {
+        outResult = applyLanewise<U8>(left, right, [](U8 a, U8 b) { return a + b > 0xff ? 0xff : a + b; });
+    } else if (name == "i8x16.sub_saturate_u") {
+        outResult = applyLanewise<U8>(left, right, [](U8 a, U8 b) { return a > b ? a - b : 0; });
+    } else if (name == "i16x8.add_saturate_u") {
+        outResult = applyLanewise<U16>(left, right, [](U16 a, U16 b) { return a + b > 0xffff ? 0xffff : a + b; });
+    } else if (name == "i16x8.sub_saturate_u") {
+        outResult = applyLanewise<U16>(left, right, [](U16 a, U16 b) { return a > b ? a - b : 0; });
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void checkOperator(Context *context, ModuleInstance *moduleInstance, const char *op) {
+    Function *function = asFunction(getInstanceExport(moduleInstance, "apply"));
+    for (U8 seed = 0; seed < 9; ++seed) {
+        const V128 left = getTestVector(seed);
+        const V128 right = getTestVector(U8(seed * 5 + 3));
+        V128 expectedResult;
+        if (!getExpectedResult(op, left, right, expectedResult)) {
+            return;
+        }
+        errorUnless(invokeFunctionChecked(context, function, {Value(left), Value(right)})[0].v128 == expectedResult);
+    }
+}
+
+static double runBenchmark(const char *op, Uptr numIterations, U32 numLoopsPerIteration) {
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    ModuleInstance *moduleInstance = instantiateModule(compartment, Benchmark::compileWASTModule(getOperatorWAST(op).c_str()), {}, "benchmark");
+    errorUnless(moduleInstance);
+    checkOperator(context, moduleInstance, op);
+
+    U8 *memoryBase = getMemoryBaseAddress(asMemory(getInstanceExport(moduleInstance, "memory")));
+    for (Uptr vectorIndex = 0; vectorIndex <= numAccumulators; ++vectorIndex) {
+        const V128 vector = getTestVector(U8(vectorIndex));
+        memcpy(memoryBase + vectorIndex * sizeof(V128), &vector, sizeof(V128));
+    }
+
+    Function *function = asFunction(getInstanceExport(moduleInstance, "run"));
+    const std::vector<Value> args{Value(I32(numLoopsPerIteration))};
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        invokeFunctionChecked(context, function, args);
+    });
+    return nanoseconds / (numLoopsPerIteration * numAccumulators);
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numLoopsPerIteration = isQuickRun ? 1000 : 1000000;
+
+    static const char *operators[] = {
+            "i8x16.add",
+            "i8x16.mul",
+            "i16x8.mul",
+            "i32x4.mul",
+            "i8x16.add_saturate_s",
+            "i8x16.add_saturate_u",
+            "i8x16.sub_saturate_s",
+            "i8x16.sub_saturate_u",
+            "i16x8.add_saturate_u",
+            "i16x8.sub_saturate_u",
+            "i8x16.lt_u",
+            "i32x4.lt_u",
+            "f32x4.min",
+            "f32x4.max",
+            "i8x16.shl",
+            "i8x16.shr_s",
+            "i32x4.shl",
+            "i64x2.shr_s",
+    };
+
+    const double baselineNanoseconds = runBenchmark("i32x4.add", numIterations, numLoopsPerIteration);
+    Benchmark::printResult("i32x4.add (per operation)", baselineNanoseconds);
+
+    Uptr numFlaggedOperators = 0;
+    for (const char *op : operators) {
+        const double nanoseconds = runBenchmark(op, numIterations, numLoopsPerIteration);
+        const bool isFlagged = nanoseconds > baselineNanoseconds * maxRelativeCost;
+        Benchmark::printResult((std::string(op) + (isFlagged ? " (per operation) SLOW" : " (per operation)")).c_str(), nanoseconds);
+        numFlaggedOperators += isFlagged ? 1 : 0;
+    }
+
+    // A quick run is too short to time reliably, so only report the flagged operators in a full run.
+    if (!isQuickRun) {
+        printf("%u operator(s) cost more than %.0fx i32x4.add\n", unsigned(numFlaggedOperators), maxRelativeCost);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+// Compares two ways to dispatch between the handlers of an interpreter: a trampoline, where each
+// handler returns the index of the next handler to a loop that calls it, and handlers that call the
+// next handler directly with return_call_indirect.
+//
+// Tail calls rely on every module using the same calling convention, in which callees pop their
+// stack arguments, so this also checks calls with stack arguments between modules, and into
+// WebAssembly code from the runtime.
+
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "WASTModule.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static constexpr Uptr numHandlers = 4;
+
+// Replaces each occurrence of a placeholder character in a string.
+static std::string replacePlaceholder(std::string string, char placeholder, const std::string &replacement) {
+    for (Uptr offset = string.find(placeholder); offset != std::string::npos; offset = string.find(placeholder, offset + replacement.size())) {
+        string.replace(offset, 1, replacement);
+    }
+    return string;
+}
+
+// Each handler mixes its index into the accumulator, and picks the next handler from the
+// accumulator's bits, so the dispatch can't be predicted from the handler alone. In the handler
+// template, @ is replaced by a letter that names the handler, and # by its index.
+static std::string getHandlersWAST(const char *handlerTemplate) {
+    std::string wast = "  (table " + std::to_string(numHandlers) + " anyfunc)\n  (elem (i32.const 0)";
+    for (Uptr handlerIndex = 0; handlerIndex < numHandlers; ++handlerIndex) {
+        wast += " $h" + std::string(1, char('a' + handlerIndex));
+    }
+    wast += ")\n";
+
+    for (Uptr handlerIndex = 0; handlerIndex < numHandlers; ++handlerIndex) {
+        const std::string handler = replacePlaceholder(handlerTemplate, '@', std::string(1, char('a' + handlerIndex)));
+        wast += replacePlaceholder(handler, '#', std::to_string(handlerIndex));
+    }
+    return wast;
+}
+
+// The handlers keep the accumulator in a global, and return the index of the next handler.
+static std::string getTrampolineWAST() {
+    return "(module\n"
+           "  (type $handler (func (result i32)))\n"
+           "  (global $acc (mut i64) (i64.const 1))\n" +
+           getHandlersWAST("  (func $h@ (type $handler)\n"
+                           "    (set_global $acc (i64.add (i64.mul (get_global $acc) (i64.const 31)) (i64.const #)))\n"
+                           "    (i32.wrap/i64 (i64.and (i64.shr_u (get_global $acc) (i64.const 7)) (i64.const 3))))\n") +
+           "  (func (export \"run\") (param $count i32) (result i64)\n"
+           "    (local $next i32)\n"
+           "    (set_global $acc (i64.const 1))\n"
+           "    (block $done\n"
+           "      (loop $loop\n"
+           "        (br_if $done (i32.eqz (get_local $count)))\n"
+           "        (set_local $next (call_indirect (type $handler) (get_local $next)))\n"
+           "        (set_local $count (i32.sub (get_local $count) (i32.const 1)))\n"
+           "        (br $loop)))\n"
+           "    (get_global $acc)))\n";
+}
+
+// The handlers pass the remaining count and the accumulator to the next handler as arguments.
+static std::string getReturnCallWAST() {
+    return "(module\n"
+           "  (type $handler (func (param i32 i64) (result i64)))\n" +
+           getHandlersWAST("  (func $h@ (type $handler) (param $count i32) (param $acc i64) (result i64)\n"
+                           "    (if (result i64) (i32.eqz (get_local $count))\n"
+                           "      (then (get_local $acc))\n"
+                           "      (else\n"
+                           "        (set_local $acc (i64.add (i64.mul (get_local $acc) (i64.const 31)) (i64.const #)))\n"
+                           "        (return_call_indirect (type $handler)\n"
+                           "          (i32.sub (get_local $count) (i32.const 1))\n"
+                           "          (get_local $acc)\n"
+                           "          (i32.wrap/i64 (i64.and (i64.shr_u (get_local $acc) (i64.const 7)) (i64.const 3)))))))\n") +
+           "  (func (export \"run\") (param $count i32) (result i64)\n"
+           "    (call $ha (get_local $count) (i64.const 1))))\n";
+}
+
+static I64 runBenchmark(const char *name, const std::string &wast, Uptr numIterations, U32 numDispatchesPerIteration) {
+    ModuleRef module = Benchmark::compileWASTModule(wast.c_str());
+
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+    Function *function = Benchmark::instantiateAndGetFunction(compartment, module, "run");
+
+    const std::vector<Value> args{Value(I32(numDispatchesPerIteration))};
+    I64 result = 0;
+    const double nanoseconds = Benchmark::measureNanosecondsPerIteration(numIterations, [&]() {
+        result = invokeFunctionChecked(context, function, args)[0].i64;
+    });
+    Benchmark::printResult(name, nanoseconds / numDispatchesPerIteration);
+    return result;
+}
+
+// A function with more arguments than are passed in registers, which weights each argument by its
+// position so a misplaced argument changes the result.
+static const char *stackArgumentsCalleeWAST =
+        "(module\n"
+        "  (func (export \"sum\") (param i64 i64 i64 i64 i64 i64 i64 i64 i64 i64) (result i64)\n"
+        "    (i64.add (i64.add (i64.add (i64.add (i64.mul (get_local 0) (i64.const 1)) (i64.mul (get_local 1) (i64.const 2)))\n"
+        "                               (i64.add (i64.mul (get_local 2) (i64.const 3)) (i64.mul (get_local 3) (i64.const 4))))\n"
+        "                      (i64.add (i64.add (i64.mul (get_local 4) (i64.const 5)) (i64.mul (get_local 5) (i64.const 6)))\n"
+        "                               (i64.add (i64.mul (get_local 6) (i64.const 7)) (i64.mul (get_local 7) (i64.const 8)))))\n"
+        "             (i64.add (i64.mul (get_local 8) (i64.const 9)) (i64.mul (get_local 9) (i64.const 10))))))\n";
+
+// Calls the imported function with a normal call, a call through a table, a return_call from a
+// function with the same prototype, and a return_call from a function with a different prototype.
+static const char *stackArgumentsCallerWAST =
+        "(module\n"
+        "  (type $sum (func (param i64 i64 i64 i64 i64 i64 i64 i64 i64 i64) (result i64)))\n"
+        "  (import \"callee\" \"sum\" (func $sum (type $sum)))\n"
+        "  (table 1 anyfunc)\n"
+        "  (elem (i32.const 0) $sum)\n"
+        "  (func (export \"call\") (type $sum)\n"
+        "    (call $sum (get_local 0) (get_local 1) (get_local 2) (get_local 3) (get_local 4)\n"
+        "               (get_local 5) (get_local 6) (get_local 7) (get_local 8) (get_local 9)))\n"
+        "  (func (export \"callIndirect\") (type $sum)\n"
+        "    (call_indirect (type $sum) (get_local 0) (get_local 1) (get_local 2) (get_local 3) (get_local 4)\n"
+        "                               (get_local 5) (get_local 6) (get_local 7) (get_local 8) (get_local 9)\n"
+        "                               (i32.const 0)))\n"
+        "  (func (export \"returnCall\") (type $sum)\n"
+        "    (return_call $sum (get_local 0) (get_local 1) (get_local 2) (get_local 3) (get_local 4)\n"
+        "                      (get_local 5) (get_local 6) (get_local 7) (get_local 8) (get_local 9)))\n"
+        "  (func (export \"returnCallFromOneArgument\") (param $x i64) (result i64)\n"
+        "    (return_call $sum (get_local $x) (get_local $x) (get_local $x) (get_local $x) (get_local $x)\n"
+        "                      (get_local $x) (get_local $x) (get_local $x) (get_local $x) (get_local $x))))\n";
+
+static void checkStackArgumentCalls(Uptr numCallsPerPath) {
+    Compartment *compartment = createCompartment();
+    Context *context = createContext(compartment);
+
+    Function *sumFunction = Benchmark::instantiateAndGetFunction(compartment, Benchmark::compileWASTModule(stackArgumentsCalleeWAST), "sum");
+    ImportBindings imports;
+    imports.functions.push_back(sumFunction);
+    ModuleInstance *callerInstance = instantiateModule(compartment, Benchmark::compileWASTModule(stackArgumentsCallerWAST), std::move(imports), "caller");
+    errorUnless(callerInstance);
+
+    // sum(1, 2, ..., 10) = 1*1 + 2*2 + ... + 10*10.
+    std::vector<Value> args;
+    for (I64 argIndex = 1; argIndex <= 10; ++argIndex) {
+        args.push_back(Value(argIndex));
+    }
+    const I64 expectedSum = 385;
+
+    // Call each path repeatedly, so a callee that pops its stack arguments when the caller expects
+    // to pop them, or the reverse, unbalances the stack enough to be caught.
+    for (Uptr callIndex = 0; callIndex < numCallsPerPath; ++callIndex) {
+        errorUnless(invokeFunctionChecked(context, sumFunction, args)[0].i64 == expectedSum);
+        for (const char *exportName : {"call", "callIndirect", "returnCall"}) {
+            Function *function = asFunction(getInstanceExport(callerInstance, exportName));
+            errorUnless(invokeFunctionChecked(context, function, args)[0].i64 == expectedSum);
+        }
+
+        // sum(x, x, ..., x) = 55 * x.
+        Function *function = asFunction(getInstanceExport(callerInstance, "returnCallFromOneArgument"));
+        errorUnless(invokeFunctionChecked(context, function, {Value(I64(3))})[0].i64 == 55 * 3);
+    }
+}
+
+int main(int argc, char **argv) {
+    const bool isQuickRun = Benchmark::isQuickRun(argc, argv);
+    const Uptr numIterations = isQuickRun ? 1 : 100;
+    const U32 numDispatchesPerIteration = isQuickRun ? 1000 : 1000000;
+
+    checkStackArgumentCalls(isQuickRun ? 100 : 10000);
+
+    // In a full run, a return_call that grew the stack would overflow it long before the dispatch
+    // loop finished.
+    const I64 trampolineResult = runBenchmark("trampolined dispatch (per dispatch)", getTrampolineWAST(), numIterations, numDispatchesPerIteration);
+    const I64 returnCallResult = runBenchmark("return_call_indirect dispatch (per dispatch)", getReturnCallWAST(), numIterations, numDispatchesPerIteration);
+    errorUnless(trampolineResult == returnCallResult);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string.h>
+#include <functional>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+namespace WAVM {
+    namespace Benchmark {
+        // Parses a WebAssembly text module, lets the caller change its features, and compiles it.
+        inline Runtime::ModuleRef compileWASTModule(const char *wast, const std::function<void(IR::FeatureSpec &)> &setFeatures = {}) {
+            IR::Module irModule;
+            if (!WAST::parseModule(wast, strlen(wast) + 1, irModule)) {
+                Errors::fatal("Failed to parse benchmark module");
+            }
+            if (setFeatures) {
+                setFeatures(irModule.featureSpec);
+            }
+            return Runtime::compileModule(std::move(irModule));
+        }
+
+        // Instantiates a module that has no imports, and returns one of its function exports.
+        inline Runtime::Function *instantiateAndGetFunction(Runtime::Compartment *compartment, Runtime::ModuleConstRefParam module, const char *exportName) {
+            Runtime::ModuleInstance *moduleInstance = Runtime::instantiateModule(compartment, module, {}, "benchmark");
+            if (!moduleInstance) {
+                Errors::fatal("Failed to instantiate benchmark module");
+            }
+            Runtime::Function *function = Runtime::asFunctionNullable(Runtime::getInstanceExport(moduleInstance, exportName));
+            if (!function) {
+                Errors::fatalf("Benchmark module doesn't export %s", exportName);
+            }
+            return function;
+        }
+    }
+}
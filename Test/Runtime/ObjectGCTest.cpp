@@ -0,0 +1,139 @@
+// Tests the incremental tracing collector's handling of the mutator changing the object graph
+// between collector slices. The test inspects the compartment's object maps to check which objects
+// were deleted, so it includes the runtime's private header.
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static const TableType anyrefTableType(ReferenceType::anyref, false, SizeConstraints{1, 1});
+
+static bool containsTable(Compartment *compartment, Uptr tableId) {
+    Lock<Platform::Mutex> tablesLock(compartment->tablesMutex);
+    return compartment->tables.contains(tableId);
+}
+
+static bool containsGlobal(Compartment *compartment, Uptr globalId) {
+    Lock<Platform::Mutex> globalsLock(compartment->globalsMutex);
+    return compartment->globals.contains(globalId);
+}
+
+// Runs collector slices of a single work unit until the collector enters the given phase.
+static void collectUntilPhase(Compartment *compartment, GCPhase phase) {
+    while (compartment->gcState.phase.load(std::memory_order_acquire) != phase) {
+        errorUnless(!collectCompartmentGarbageIncrementally(compartment, 1));
+    }
+}
+
+static void finishCollection(Compartment *compartment) {
+    while (!collectCompartmentGarbageIncrementally(compartment, 1)) {
+    };
+}
+
+// An object that is only reachable from a root that is removed after the root scan, but that is
+// moved to an object that is rooted after the root scan, must survive the collection.
+static void testRootsChangeBetweenSlices() {
+    Compartment *compartment = createCompartment();
+    GCPointer<Compartment> compartmentRoot = compartment;
+
+    GCPointer<Table> oldRoot = createTable(compartment, anyrefTableType, "oldRoot");
+    Table *newRoot = createTable(compartment, anyrefTableType, "newRoot");
+    Global *global = createGlobal(compartment, GlobalType(ValueType::i32, false), Value(I32(0)));
+    setTableElement(oldRoot, 0, asObject(global));
+    const Uptr oldRootId = oldRoot->id;
+    const Uptr newRootId = newRoot->id;
+    const Uptr globalId = global->id;
+
+    // Scan the roots, then move the global from the old root to the new root.
+    collectUntilPhase(compartment, GCPhase::marking);
+    GCPointer<Table> newRootPointer = newRoot;
+    setTableElement(newRoot, 0, asObject(global));
+    setTableElement(oldRoot, 0, nullptr);
+    oldRoot = nullptr;
+    finishCollection(compartment);
+
+    errorUnless(!containsTable(compartment, oldRootId));
+    errorUnless(containsTable(compartment, newRootId));
+    errorUnless(containsGlobal(compartment, globalId));
+    errorUnless(getTableElement(newRoot, 0) == asObject(global));
+
+    // Once nothing is rooted, a full collection deletes the remaining objects and the compartment.
+    newRootPointer = nullptr;
+    compartmentRoot = nullptr;
+    errorUnless(collectCompartmentGarbage(compartment));
+}
+
+// Objects created while the collector is marking are created marked, so they survive the
+// collection even if nothing references them yet, and are deleted by the next collection if they
+// are still unreferenced.
+static void testObjectsCreatedDuringMarking() {
+    Compartment *compartment = createCompartment();
+    GCPointer<Compartment> compartmentRoot = compartment;
+    GCPointer<Table> anchor = createTable(compartment, anyrefTableType, "anchor");
+
+    collectUntilPhase(compartment, GCPhase::marking);
+    Global *unrootedGlobal = createGlobal(compartment, GlobalType(ValueType::i32, true), Value(I32(1)));
+    GCPointer<Table> rootedTable = createTable(compartment, anyrefTableType, "rootedTable");
+    const Uptr unrootedGlobalId = unrootedGlobal->id;
+    const Uptr rootedTableId = rootedTable->id;
+    finishCollection(compartment);
+
+    errorUnless(containsGlobal(compartment, unrootedGlobalId));
+    errorUnless(containsTable(compartment, rootedTableId));
+
+    errorUnless(!collectCompartmentGarbage(compartment));
+    errorUnless(!containsGlobal(compartment, unrootedGlobalId));
+    errorUnless(containsTable(compartment, rootedTableId));
+
+    anchor = nullptr;
+    rootedTable = nullptr;
+    compartmentRoot = nullptr;
+    errorUnless(collectCompartmentGarbage(compartment));
+}
+
+// Objects can't refer to objects in another compartment, but a cloned compartment has a copy of
+// each of the original's reference cycles. Collecting one compartment must delete only its own copy
+// of an unreferenced cycle.
+static void testCyclesInClonedCompartments() {
+    Compartment *original = createCompartment();
+    GCPointer<Compartment> originalRoot = original;
+
+    // Create a cycle between a table and a global.
+    Table *table = createTable(original, anyrefTableType, "table");
+    Global *global = createGlobal(original, GlobalType(ValueType::anyref, false), Value(asObject(table)));
+    setTableElement(table, 0, asObject(global));
+    const Uptr tableId = table->id;
+    const Uptr globalId = global->id;
+
+    // The clone's copy of the cycle must only refer to the clone's objects.
+    Compartment *clone = cloneCompartment(original);
+    Table *clonedTable = clone->tables[tableId];
+    Global *clonedGlobal = clone->globals[globalId];
+    errorUnless(getTableElement(clonedTable, 0) == asObject(clonedGlobal));
+    errorUnless(clonedGlobal->initialValue.object == asObject(clonedTable));
+
+    // Nothing roots the clone or its cycle, so collecting it deletes the cycle and the clone.
+    errorUnless(collectCompartmentGarbage(clone));
+
+    // The original's cycle is unreferenced too, but the original compartment is rooted, so collecting
+    // it deletes the cycle but not the compartment.
+    errorUnless(containsTable(original, tableId));
+    errorUnless(containsGlobal(original, globalId));
+    errorUnless(getTableElement(table, 0) == asObject(global));
+    errorUnless(!collectCompartmentGarbage(original));
+    errorUnless(!containsTable(original, tableId));
+    errorUnless(!containsGlobal(original, globalId));
+
+    originalRoot = nullptr;
+    errorUnless(collectCompartmentGarbage(original));
+}
+
+int main(int argc, char **argv) {
+    testRootsChangeBetweenSlices();
+    testObjectsCreatedDuringMarking();
+    testCyclesInClonedCompartments();
+    return 0;
+}
@@ -1,5 +1,7 @@
+#include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <utility>
 #include <vector>
@@ -106,19 +108,58 @@ inline bool readFile(const char *filename, std::vector<U8> &outFileContents) {
     return true;
 }
 
-static int run(const char *filename, char **args) {
+inline bool writeFile(const char *filename, const std::vector<U8> &fileContents) {
+    I32 file = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        std::cout << "Couldn't open file: " << filename;
+        return false;
+    }
+
+    // write may write fewer bytes than requested, so keep writing until all the bytes are written.
+    Uptr numBytesWritten = 0;
+    while (numBytesWritten < fileContents.size()) {
+        const ssize_t result = write(file, fileContents.data() + numBytesWritten, fileContents.size() - numBytesWritten);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        numBytesWritten += Uptr(result);
+    }
+
+    const bool succeeded = close(file) == 0 && numBytesWritten == fileContents.size();
+    if (!succeeded) {
+        std::cout << "Couldn't write file: " << filename;
+    }
+    return succeeded;
+}
+
+static int run(const char *filename, const char *snapshotFilename, char **args) {
     std::vector<U8> fileBytes;
     if (!readFile(filename, fileBytes)) {
         return false;
     }
-    fileBytes.push_back(0);
 
-    IR::Module irModule;
-    if (!WAST::parseModule((const char *) fileBytes.data(), fileBytes.size(), irModule)) {
-        std::cout << "Error parsing WebAssembly text file";
-    }
+    // Load the module from a saved compiled module (e.g. a snapshot), or parse and compile it.
+    Runtime::ModuleRef module;
+    if (Runtime::isCompiledModuleBytes(fileBytes.data(), fileBytes.size())) {
+        module = Runtime::loadCompiledModule(fileBytes.data(), fileBytes.size());
+        if (!module) {
+            std::cout << "Error loading compiled module file";
+            return EXIT_FAILURE;
+        }
+    } else {
+        fileBytes.push_back(0);
+
+        IR::Module parsedIRModule;
+        if (!WAST::parseModule((const char *) fileBytes.data(), fileBytes.size(), parsedIRModule)) {
+            std::cout << "Error parsing WebAssembly text file";
+        }
 
-    Runtime::ModuleRef module = Runtime::compileModule(irModule);
+        module = Runtime::compileModule(parsedIRModule);
+    }
+    const IR::Module &irModule = Runtime::getModuleIR(module);
 
     Compartment *compartment = Runtime::createCompartment();
     Context *context = Runtime::createContext(compartment);
@@ -147,14 +188,31 @@ static int run(const char *filename, char **args) {
         return EXIT_FAILURE;
     }
 
-    // Call the module start function, if it has one.
-    Function *startFunction = getStartFunction(moduleInstance);
-    if (startFunction) {
-        invokeFunctionChecked(context, startFunction, {});
+    // A snapshot already contains the state produced by the start function and the Emscripten
+    // global initializers, so don't run them again. The imported globals were created for this
+    // instance, so restore the values they had when the snapshot was taken.
+    if (Runtime::isPreinitializedModule(module)) {
+        Runtime::restoreSnapshotImportedGlobals(module, moduleInstance);
+    } else {
+        // Call the module start function, if it has one.
+        Function *startFunction = getStartFunction(moduleInstance);
+        if (startFunction) {
+            invokeFunctionChecked(context, startFunction, {});
+        }
+
+        // Call the Emscripten global initalizers.
+        Emscripten::initializeGlobals(context, irModule, moduleInstance);
     }
 
-    // Call the Emscripten global initalizers.
-    Emscripten::initializeGlobals(context, irModule, moduleInstance);
+    // If requested, save a snapshot of the initialized module instead of running it.
+    if (snapshotFilename) {
+        Runtime::ModuleRef snapshot = Runtime::snapshotModuleInstance(context, module, moduleInstance);
+        if (!snapshot) {
+            std::cout << "Module state can't be saved as a snapshot";
+            return EXIT_FAILURE;
+        }
+        return writeFile(snapshotFilename, Runtime::saveCompiledModule(snapshot)) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     // Look up the function export to call.
     Function *function = asFunctionNullable(getInstanceExport(moduleInstance, "main"));
@@ -195,10 +253,20 @@ static int run(const char *filename, char **args) {
 }
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::cout << "Usage: run [programfile] [--] [arguments]\n"
-                     "  -h|--help             Display this message\n";
+    const char *snapshotFilename = nullptr;
+    char **nextArg = argv + 1;
+    if (argc >= 3 && !strcmp(*nextArg, "--snapshot")) {
+        snapshotFilename = nextArg[1];
+        nextArg += 2;
+    }
+
+    if (!*nextArg || !strcmp(*nextArg, "-h") || !strcmp(*nextArg, "--help")) {
+        std::cout << "Usage: run [options] [programfile] [--] [arguments]\n"
+                     "  -h|--help             Display this message\n"
+                     "  --snapshot <file>     Run the program's initializers, and save the initialized\n"
+                     "                        program to <file> instead of running it. Running the\n"
+                     "                        saved file skips initialization and compilation.\n";
         return EXIT_FAILURE;
     }
-    return run(argv[1], argv + 2);
+    return run(nextArg[0], snapshotFilename, nextArg + 1);
 }